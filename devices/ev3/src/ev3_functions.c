@@ -785,13 +785,12 @@ static sinanbox_t ev3_playSequence(uint8_t argc, sinanbox_t *argv) {
     return NANBOX_OFUNDEF();
   }
 
-  siheap_header_t *arrayp = SIHEAP_NANBOXTOPTR(argv[0]);
-  siheap_array_t *array = (siheap_array_t *)arrayp;
-  if (!NANBOX_ISPTR(argv[0]) || arrayp->type != sitype_array) {
+  siheap_header_t *array = SIHEAP_NANBOXTOPTR(argv[0]);
+  if (!NANBOX_ISPTR(argv[0]) || !siheap_isarray(array)) {
     _Exit(1);
   }
 
-  const size_t num_beeps = array->count / 3;
+  const size_t num_beeps = siarray_length(array) / 3;
   if (!num_beeps) {
     _Exit(1);
   }
@@ -802,9 +801,9 @@ static sinanbox_t ev3_playSequence(uint8_t argc, sinanbox_t *argv) {
 
   for (size_t i = 0; i < num_beeps; ++i) {
     const size_t arrayv_base = i * 3, argv_base = i * 7;
-    sinanbox_t freqv = siarray_get(array, arrayv_base),
-               lengthv = siarray_get(array, arrayv_base + 1),
-               delayv = siarray_get(array, arrayv_base + 2);
+    sinanbox_t freqv = siarray_load(array, arrayv_base),
+               lengthv = siarray_load(array, arrayv_base + 1),
+               delayv = siarray_load(array, arrayv_base + 2);
     if (!NANBOX_ISNUMERIC(freqv) || !NANBOX_ISNUMERIC(lengthv) || !NANBOX_ISNUMERIC(delayv)) {
       _Exit(1);
     }
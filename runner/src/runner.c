@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -72,13 +74,43 @@ static void print_flush(bool is_error) {
   printf("\n");
 }
 
+static void print_stats(void) {
+  eprintf("Call cache: %" PRIu32 " hits, %" PRIu32 " misses\n",
+    sinter_stats.call_cache_hits, sinter_stats.call_cache_misses);
+  eprintf("Environment cache: %" PRIu32 " hits, %" PRIu32 " misses\n",
+    sinter_stats.env_cache_hits, sinter_stats.env_cache_misses);
+}
+
+#ifdef SINTER_RUNNER_AOT
+// the program, translated by svm2c
+extern const sinter_aot_program_t sinter_aot_program;
+#endif
+
 int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    eprintf("Usage: %s <program>\n", argv[0]);
+  bool show_stats = false;
+  int argi = 1;
+  for (; argi < argc && argv[argi][0] == '-'; ++argi) {
+    if (strcmp(argv[argi], "-s") == 0) {
+      show_stats = true;
+    } else if (strcmp(argv[argi], "-j") == 0) {
+      sinter_jit_enabled = true;
+    } else {
+      break;
+    }
+  }
+#ifdef SINTER_RUNNER_AOT
+  if (argi != argc) {
+    eprintf("Usage: %s [-s]\n", argv[0]);
     return 1;
   }
+#else
+  if (argi != argc - 1) {
+    eprintf("Usage: %s [-s] [-j] <program>\n", argv[0]);
+    return 1;
+  }
+  const char *const program_path = argv[argi];
 
-  int program_fd = check_posix(open(argv[1], O_RDONLY), "Failed to open program");
+  int program_fd = check_posix(open(program_path, O_RDONLY), "Failed to open program");
   off_t size;
   {
     struct stat stat_buf;
@@ -89,6 +121,7 @@ int main(int argc, char *argv[]) {
   if (program == MAP_FAILED) {
     check_posix(-1, "mmap failed");
   }
+#endif
 
   sinter_printer_float = print_float;
   sinter_printer_string = print_string;
@@ -98,7 +131,11 @@ int main(int argc, char *argv[]) {
   setup_internals();
 
   sinter_value_t result = { 0 };
+#ifdef SINTER_RUNNER_AOT
+  sinter_fault_t fault = sinter_run_aot(&sinter_aot_program, &result);
+#else
   sinter_fault_t fault = sinter_run(program, size, &result);
+#endif
 
   printf("Program exited with fault %s and result type %s: ",
     fault >= (sizeof(fault_names)/sizeof(fault_names[0])) ? "(unknown fault)" : fault_names[fault],
@@ -134,5 +171,9 @@ int main(int argc, char *argv[]) {
 
   printf("\n");
 
+  if (show_stats) {
+    print_stats();
+  }
+
   return 0;
 }
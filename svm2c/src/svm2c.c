@@ -0,0 +1,594 @@
+/**
+ * svm2c: translates an SVML program into C, to be linked with libsinter and
+ * run with sinter_run_aot.
+ *
+ * Every SVML function reachable from the entry point (through new.c) becomes
+ * a C function. Instructions become calls into the runtime support in
+ * sinter/aot.h, with their operands, including constants, resolved at
+ * translation time; branches become gotos.
+ *
+ * Invalid instructions are translated into faults, so that an invalid program
+ * faults at the same point as it would in the interpreter.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sinter/nanbox.h>
+#include <sinter/opcode.h>
+#include <sinter/program.h>
+
+#define eprintf(...) fprintf(stderr, __VA_ARGS__)
+
+// Flags for each address of the function being translated
+#define ADDR_VISITED 1u
+#define ADDR_LABEL 2u
+
+typedef struct {
+  address_t *items;
+  size_t count;
+  size_t capacity;
+} addrlist_t;
+
+static const unsigned char *program;
+static address_t program_size;
+static FILE *out;
+
+// All functions to be translated, in the order they are found
+static addrlist_t functions;
+// Flags for the function being translated, indexed by address, with one more
+// entry for the end of the program
+static uint8_t *addr_flags;
+
+static void *xrealloc(void *ptr, size_t size) {
+  void *ret = realloc(ptr, size);
+  if (!ret) {
+    eprintf("svm2c: out of memory\n");
+    exit(1);
+  }
+  return ret;
+}
+
+static void addrlist_push(addrlist_t *list, address_t addr) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 16;
+    list->items = xrealloc(list->items, list->capacity * sizeof(address_t));
+  }
+  list->items[list->count++] = addr;
+}
+
+static bool addrlist_contains(const addrlist_t *list, address_t addr) {
+  for (size_t i = 0; i < list->count; ++i) {
+    if (list->items[i] == addr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int compare_addr(const void *a, const void *b) {
+  const address_t l = *(const address_t *) a;
+  const address_t r = *(const address_t *) b;
+  return (l > r) - (l < r);
+}
+
+/**
+ * Gets the size of the instruction at addr, or 0 if it is invalid or
+ * truncated.
+ */
+static address_t instr_size(address_t addr) {
+  if (addr >= program_size) {
+    return 0;
+  }
+  const address_t size = siop_size(program[addr]);
+  return size && size <= program_size - addr ? size : 0;
+}
+
+/**
+ * Checks that a function header at addr is within the program.
+ */
+static bool is_valid_function(address_t addr) {
+  return addr <= program_size && program_size - addr >= offsetof(svm_function_t, code);
+}
+
+/**
+ * Checks that a string constant at addr is within the program.
+ */
+static bool is_valid_string(address_t addr) {
+  if (addr > program_size || program_size - addr < sizeof(svm_constant_t)) {
+    return false;
+  }
+  const svm_constant_t *constant = (const svm_constant_t *) (program + addr);
+  return constant->length <= program_size - addr - sizeof(svm_constant_t);
+}
+
+/**
+ * Gets the target of the branch at addr, or false if it is out of bounds.
+ */
+static bool branch_target(address_t addr, address_t *target) {
+  int64_t t;
+  if (program[addr] == op_jmp) {
+    t = ((const struct op_address *) (program + addr))->address;
+  } else {
+    t = (int64_t) addr + (int64_t) sizeof(struct op_offset) + ((const struct op_offset *) (program + addr))->offset;
+  }
+  if (t < 0 || t > program_size) {
+    return false;
+  }
+  *target = (address_t) t;
+  return true;
+}
+
+/**
+ * Whether execution continues to the next instruction after the given one.
+ */
+static bool falls_through(opcode_t op) {
+  switch (op) {
+  case op_br:
+  case op_jmp:
+  case op_call_t:
+  case op_call_t_p:
+  case op_call_t_v:
+  case op_ret_g:
+  case op_ret_f:
+  case op_ret_b:
+  case op_ret_u:
+  case op_ret_n:
+    return false;
+  default:
+    return true;
+  }
+}
+
+/**
+ * Finds the instructions reachable from the start of the function at
+ * fn_addr, and the functions they create.
+ */
+static void follow_function(address_t fn_addr, addrlist_t *instrs) {
+  addrlist_t worklist = { 0 };
+  addrlist_push(&worklist, fn_addr + offsetof(svm_function_t, code));
+
+  while (worklist.count) {
+    const address_t addr = worklist.items[--worklist.count];
+    if (addr_flags[addr] & ADDR_VISITED) {
+      continue;
+    }
+    addr_flags[addr] |= ADDR_VISITED;
+    addrlist_push(instrs, addr);
+
+    const address_t size = instr_size(addr);
+    if (!size) {
+      continue;
+    }
+
+    const opcode_t op = program[addr];
+    address_t target;
+    switch (op) {
+    case op_br:
+    case op_br_t:
+    case op_br_f:
+    case op_jmp:
+      if (branch_target(addr, &target)) {
+        addr_flags[target] |= ADDR_LABEL;
+        addrlist_push(&worklist, target);
+      }
+      break;
+    case op_new_c: {
+      const address_t fn = ((const struct op_address *) (program + addr))->address;
+      if (is_valid_function(fn) && !addrlist_contains(&functions, fn)) {
+        addrlist_push(&functions, fn);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+
+    if (falls_through(op)) {
+      addrlist_push(&worklist, addr + size);
+    }
+  }
+
+  free(worklist.items);
+}
+
+static void emit_push(sinanbox_t v) {
+  fprintf(out, "  sistack_push(NANBOX_WITH_I32(0x%08" PRIx32 "u));\n", v.as_u32);
+}
+
+static void emit_fault(void) {
+  fprintf(out, "  sifault(sinter_fault_invalid_program);\n");
+}
+
+static void emit_goto(address_t addr, const char *condition) {
+  address_t target;
+  if (condition) {
+    fprintf(out, "  if (%s) ", condition);
+  } else {
+    fprintf(out, "  ");
+  }
+  if (branch_target(addr, &target)) {
+    fprintf(out, "goto l_%" PRIx32 ";\n", target);
+  } else {
+    fprintf(out, "sifault(sinter_fault_invalid_program);\n");
+  }
+}
+
+/**
+ * Emits the C code for the instruction at addr.
+ */
+static void emit_instr(address_t addr) {
+  if (!instr_size(addr)) {
+    emit_fault();
+    return;
+  }
+
+  const unsigned char *instr = program + addr;
+  const sinter_opcode_t op = (sinter_opcode_t) *instr;
+  switch (op) {
+  case op_nop:
+    fprintf(out, "  ;\n");
+    break;
+  case op_ldc_i:
+  case op_lgc_i:
+    emit_push(NANBOX_WRAP_INT(((const struct op_i32 *) instr)->operand));
+    break;
+  case op_ldc_f32:
+  case op_lgc_f32:
+    emit_push(NANBOX_OFFLOAT(((const struct op_f32 *) instr)->operand));
+    break;
+  case op_ldc_f64:
+  case op_lgc_f64:
+    emit_push(NANBOX_OFFLOAT(siop_f64_operand((const struct op_f64 *) instr)));
+    break;
+  case op_ldc_b_0:
+  case op_lgc_b_0:
+    emit_push(NANBOX_OFBOOL(false));
+    break;
+  case op_ldc_b_1:
+  case op_lgc_b_1:
+    emit_push(NANBOX_OFBOOL(true));
+    break;
+  case op_lgc_u:
+    emit_push(NANBOX_OFUNDEF());
+    break;
+  case op_lgc_n:
+    emit_push(NANBOX_OFNULL());
+    break;
+  case op_lgc_s: {
+    const address_t string = ((const struct op_address *) instr)->address;
+    if (is_valid_string(string)) {
+      fprintf(out, "  siaot_lgc_s(0x%" PRIx32 "u);\n", string);
+    } else {
+      emit_fault();
+    }
+    break;
+  }
+  case op_pop_g:
+  case op_pop_b:
+  case op_pop_f:
+    fprintf(out, "  siaot_pop();\n");
+    break;
+  case op_add_g:
+    fprintf(out, "  siaot_add_g();\n");
+    break;
+  case op_add_f:
+    fprintf(out, "  siaot_add_f();\n");
+    break;
+  case op_sub_g:
+  case op_sub_f:
+    fprintf(out, "  siaot_sub();\n");
+    break;
+  case op_mul_g:
+  case op_mul_f:
+    fprintf(out, "  siaot_mul();\n");
+    break;
+  case op_div_g:
+  case op_div_f:
+    fprintf(out, "  siaot_div();\n");
+    break;
+  case op_mod_g:
+  case op_mod_f:
+    fprintf(out, "  siaot_mod();\n");
+    break;
+  case op_not_g:
+  case op_not_b:
+    fprintf(out, "  siaot_not();\n");
+    break;
+  case op_neg_g:
+  case op_neg_f:
+    fprintf(out, "  siaot_neg();\n");
+    break;
+  case op_lt_g:
+    fprintf(out, "  siaot_lt_g();\n");
+    break;
+  case op_lt_f:
+    fprintf(out, "  siaot_lt_f();\n");
+    break;
+  case op_gt_g:
+    fprintf(out, "  siaot_gt_g();\n");
+    break;
+  case op_gt_f:
+    fprintf(out, "  siaot_gt_f();\n");
+    break;
+  case op_le_g:
+    fprintf(out, "  siaot_le_g();\n");
+    break;
+  case op_le_f:
+    fprintf(out, "  siaot_le_f();\n");
+    break;
+  case op_ge_g:
+    fprintf(out, "  siaot_ge_g();\n");
+    break;
+  case op_ge_f:
+    fprintf(out, "  siaot_ge_f();\n");
+    break;
+  case op_eq_g:
+  case op_eq_f:
+  case op_eq_b:
+    fprintf(out, "  siaot_eq(false);\n");
+    break;
+  case op_neq_g:
+  case op_neq_f:
+  case op_neq_b:
+    fprintf(out, "  siaot_eq(true);\n");
+    break;
+  case op_new_c: {
+    const address_t fn = ((const struct op_address *) instr)->address;
+    if (is_valid_function(fn)) {
+      fprintf(out, "  siaot_new_c(0x%" PRIx32 "u);\n", fn);
+    } else {
+      emit_fault();
+    }
+    break;
+  }
+  case op_new_c_p:
+    emit_push(NANBOX_OFIFN_PRIMITIVE(((const struct op_oneindex *) instr)->index));
+    break;
+  case op_new_c_v:
+    emit_push(NANBOX_OFIFN_VM(((const struct op_oneindex *) instr)->index));
+    break;
+  case op_new_a:
+    fprintf(out, "  siaot_new_a();\n");
+    break;
+  case op_ldl_g:
+  case op_ldl_f:
+  case op_ldl_b:
+    fprintf(out, "  siaot_ldl(%u);\n", ((const struct op_oneindex *) instr)->index);
+    break;
+  case op_stl_g:
+  case op_stl_b:
+  case op_stl_f:
+    fprintf(out, "  siaot_stl(%u);\n", ((const struct op_oneindex *) instr)->index);
+    break;
+  case op_ldp_g:
+  case op_ldp_f:
+  case op_ldp_b: {
+    const struct op_twoindex *i = (const struct op_twoindex *) instr;
+    fprintf(out, "  siaot_ldp(%u, %u);\n", i->index, i->envindex);
+    break;
+  }
+  case op_stp_g:
+  case op_stp_b:
+  case op_stp_f: {
+    const struct op_twoindex *i = (const struct op_twoindex *) instr;
+    fprintf(out, "  siaot_stp(%u, %u);\n", i->index, i->envindex);
+    break;
+  }
+  case op_lda_g:
+  case op_lda_b:
+  case op_lda_f:
+    fprintf(out, "  siaot_lda();\n");
+    break;
+  case op_sta_g:
+  case op_sta_b:
+  case op_sta_f:
+    fprintf(out, "  siaot_sta();\n");
+    break;
+  case op_br_t:
+    emit_goto(addr, "siaot_pop_bool()");
+    break;
+  case op_br_f:
+    emit_goto(addr, "!siaot_pop_bool()");
+    break;
+  case op_br:
+  case op_jmp:
+    emit_goto(addr, NULL);
+    break;
+  case op_call:
+  case op_call_t:
+    fprintf(out, "  siaot_call(%u, %s);\n", ((const struct op_call *) instr)->num_args,
+      op == op_call_t ? "true" : "false");
+    break;
+  case op_call_p:
+  case op_call_t_p:
+  case op_call_v:
+  case op_call_t_v: {
+    const struct op_call_internal *i = (const struct op_call_internal *) instr;
+    fprintf(out, "  siaot_call_internal(%u, %u, %s, %s);\n", i->id, i->num_args,
+      op == op_call_p || op == op_call_t_p ? "true" : "false",
+      op == op_call_t_p || op == op_call_t_v ? "true" : "false");
+    break;
+  }
+  case op_ret_g:
+  case op_ret_f:
+  case op_ret_b:
+    fprintf(out, "  siaot_ret();\n");
+    break;
+  case op_ret_u:
+    fprintf(out, "  siaot_ret_value(NANBOX_OFUNDEF());\n");
+    break;
+  case op_ret_n:
+    fprintf(out, "  siaot_ret_value(NANBOX_OFNULL());\n");
+    break;
+  case op_dup:
+    fprintf(out, "  siaot_dup();\n");
+    break;
+  case op_newenv:
+    fprintf(out, "  siaot_newenv(%u);\n", ((const struct op_oneindex *) instr)->index);
+    break;
+  case op_popenv:
+    fprintf(out, "  siaot_popenv();\n");
+    break;
+  }
+
+  // the frame is gone after a tail call or return
+  if (!falls_through(op) && op != op_br && op != op_jmp) {
+    fprintf(out, "  return;\n");
+  }
+}
+
+static void emit_function(address_t fn_addr) {
+  addrlist_t instrs = { 0 };
+  memset(addr_flags, 0, (size_t) program_size + 1);
+  follow_function(fn_addr, &instrs);
+  qsort(instrs.items, instrs.count, sizeof(address_t), compare_addr);
+
+  // instructions are emitted in address order, so we need a goto wherever the
+  // next instruction to run is not the next one emitted
+  const address_t start = fn_addr + offsetof(svm_function_t, code);
+  if (instrs.items[0] != start) {
+    addr_flags[start] |= ADDR_LABEL;
+  }
+  for (size_t i = 0; i < instrs.count; ++i) {
+    const address_t addr = instrs.items[i];
+    const address_t size = instr_size(addr);
+    if (size && falls_through(program[addr])
+      && (i + 1 == instrs.count || instrs.items[i + 1] != addr + size)) {
+      addr_flags[addr + size] |= ADDR_LABEL;
+    }
+  }
+
+  fprintf(out, "\nstatic void fn_%" PRIx32 "(void) {\n", fn_addr);
+  if (instrs.items[0] != start) {
+    fprintf(out, "  goto l_%" PRIx32 ";\n", start);
+  }
+  for (size_t i = 0; i < instrs.count; ++i) {
+    const address_t addr = instrs.items[i];
+    if (addr_flags[addr] & ADDR_LABEL) {
+      fprintf(out, "l_%" PRIx32 ":\n", addr);
+    }
+    emit_instr(addr);
+
+    const address_t size = instr_size(addr);
+    if (size && falls_through(program[addr])
+      && (i + 1 == instrs.count || instrs.items[i + 1] != addr + size)) {
+      fprintf(out, "  goto l_%" PRIx32 ";\n", addr + size);
+    }
+  }
+  fprintf(out, "}\n");
+
+  free(instrs.items);
+}
+
+static unsigned char *read_file(const char *path, size_t *size) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror("svm2c: failed to open program");
+    return NULL;
+  }
+
+  unsigned char *data = NULL;
+  size_t len = 0;
+  size_t capacity = 0;
+  while (true) {
+    if (len == capacity) {
+      capacity = capacity ? capacity * 2 : 4096;
+      data = xrealloc(data, capacity);
+    }
+    const size_t read = fread(data + len, 1, capacity - len, f);
+    if (!read) {
+      break;
+    }
+    len += read;
+  }
+
+  if (ferror(f)) {
+    perror("svm2c: failed to read program");
+    fclose(f);
+    free(data);
+    return NULL;
+  }
+  fclose(f);
+
+  *size = len;
+  return data;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3 || argc > 4) {
+    eprintf("Usage: %s <program> <output> [symbol]\n", argv[0]);
+    return 1;
+  }
+  const char *const symbol = argc == 4 ? argv[3] : "sinter_aot_program";
+
+  size_t size;
+  unsigned char *data = read_file(argv[1], &size);
+  if (!data) {
+    return 1;
+  }
+  if (size > UINT32_MAX - 1) {
+    eprintf("svm2c: program too large\n");
+    return 1;
+  }
+  program = data;
+  program_size = (address_t) size;
+
+  const svm_header_t *header = (const svm_header_t *) program;
+  if (program_size < sizeof(svm_header_t) || header->magic != SVM_MAGIC) {
+    eprintf("svm2c: invalid program header\n");
+    return 1;
+  }
+  if (!is_valid_function(header->entry)) {
+    eprintf("svm2c: entry point out of bounds\n");
+    return 1;
+  }
+
+  out = fopen(argv[2], "w");
+  if (!out) {
+    perror("svm2c: failed to open output");
+    return 1;
+  }
+
+  fprintf(out, "// Generated by svm2c from %s. Do not edit.\n\n", argv[1]);
+  fprintf(out, "#include <sinter/aot.h>\n\n");
+
+  fprintf(out, "static const unsigned char program[] = {");
+  for (address_t i = 0; i < program_size; ++i) {
+    fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n  ", program[i]);
+  }
+  fprintf(out, "\n};\n");
+
+  addr_flags = xrealloc(NULL, (size_t) program_size + 1);
+  addrlist_push(&functions, header->entry);
+  // functions are added to the list as they are found
+  for (size_t i = 0; i < functions.count; ++i) {
+    emit_function(functions.items[i]);
+  }
+
+  qsort(functions.items, functions.count, sizeof(address_t), compare_addr);
+  fprintf(out, "\nstatic const siaot_function_t functions[] = {\n");
+  for (size_t i = 0; i < functions.count; ++i) {
+    fprintf(out, "  { 0x%" PRIx32 "u, fn_%" PRIx32 " },\n", functions.items[i], functions.items[i]);
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "const sinter_aot_program_t %s = {\n", symbol);
+  fprintf(out, "  program, sizeof(program), functions, sizeof(functions)/sizeof(functions[0])\n");
+  fprintf(out, "};\n");
+
+  free(addr_flags);
+  free(functions.items);
+  free(data);
+
+  if (fclose(out)) {
+    perror("svm2c: failed to write output");
+    return 1;
+  }
+
+  return 0;
+}
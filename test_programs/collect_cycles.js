@@ -0,0 +1,25 @@
+// each round leaves behind a circular list, and the environment of the call to
+// f, which holds a function that refers back to it; neither can be freed by
+// reference counting alone
+function f(n) {
+  function g() {
+    return n;
+  }
+  return g();
+}
+
+let total = 0;
+for (let round = 0; round < 40; round = round + 1) {
+  const first = pair(round, null);
+  let last = first;
+  for (let i = 1; i < 300; i = i + 1) {
+    const p = pair(i, null);
+    set_tail(last, p);
+    last = p;
+  }
+  set_tail(last, first);
+  total = total + f(head(tail(last)));
+}
+
+display(total);
+total;
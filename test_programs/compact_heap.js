@@ -0,0 +1,23 @@
+const xs = [];
+for (let i = 0; i < 1300; i = i + 1) {
+  xs[i] = pair(i, null);
+}
+
+// leave holes too small for the array below; it only fits once the heap is
+// compacted
+for (let i = 0; i < 1300; i = i + 2) {
+  xs[i] = null;
+}
+const ys = [];
+for (let i = 0; i < 2500; i = i + 1) {
+  ys[i] = i;
+}
+
+let sum = 0;
+for (let i = 1; i < 1300; i = i + 2) {
+  sum = sum + head(xs[i]);
+}
+
+display(sum);
+display(ys[2499]);
+array_length(ys);
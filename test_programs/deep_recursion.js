@@ -0,0 +1,7 @@
+// the recursion is deeper than one stack segment holds
+function sum(n) {
+  return n === 0 ? 0 : n + sum(n - 1);
+}
+
+display(sum(1000));
+sum(1000);
@@ -0,0 +1,15 @@
+// each round, the list and string of the previous round die when they are
+// overwritten, and are freed without a mark-and-sweep
+let total = 0;
+for (let round = 0; round < 20; round = round + 1) {
+  let xs = null;
+  let s = "";
+  for (let i = 0; i < 400; i = i + 1) {
+    xs = pair(pair(i, null), xs);
+    s = s + "a";
+  }
+  total = total + head(head(xs));
+}
+
+display(total);
+total;
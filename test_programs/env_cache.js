@@ -0,0 +1,18 @@
+// block environments are reused by the next iteration, unless captured
+let fs = null;
+let i = 0;
+while (i < 10) {
+  const j = i * 2;
+  if (i % 3 === 0) {
+    fs = pair(() => j, fs);
+  }
+  i = i + 1;
+}
+
+let total = 0;
+while (!is_null(fs)) {
+  total = total + head(fs)();
+  fs = tail(fs);
+}
+display(total);
+total;
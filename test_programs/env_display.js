@@ -0,0 +1,40 @@
+// deeply nested environments reach their ancestors through their displays
+function deep(n) {
+  let s = 0;
+  let i = 0;
+  while (i < n) {
+    const a = i;
+    {
+      const b = a * 2;
+      {
+        const c = b + 1;
+        {
+          const d = c + 1;
+          s = s + a + b + c + d;
+        }
+      }
+    }
+    i = i + 1;
+  }
+  return s;
+}
+
+function make(x) {
+  const y = x * 10;
+  {
+    const z = y + 1;
+    {
+      const v = z + 1;
+      return () => {
+        const w = 1000;
+        x = x + 1;
+        return x + y + z + v + w;
+      };
+    }
+  }
+}
+
+display(deep(10));
+const f = make(1);
+display(f());
+f();
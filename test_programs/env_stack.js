@@ -0,0 +1,16 @@
+// the environments of sum and its block overflow the environment stack
+function sum(n) {
+  let r = 0;
+  if (n !== 0) {
+    const m = n * 2;
+    r = m + sum(n - 1);
+  }
+  return r;
+}
+
+function count(n, acc) {
+  return n === 0 ? acc : count(n - 1, acc + 1);
+}
+
+display(sum(100));
+count(1000, 0);
@@ -0,0 +1,20 @@
+// each call keeps a pair in its environment, which is only referred to by the
+// frame of the call below it when the deepest call fills up the heap with
+// garbage cycles, so that a mark-sweep runs
+function garbage(n) {
+  for (let i = 0; i < n; i = i + 1) {
+    const p = pair(i, null);
+    set_tail(p, p);
+  }
+  return 0;
+}
+
+function deep(n) {
+  const p = pair(n, null);
+  const rest = n === 0 ? garbage(3000) : deep(n - 1);
+  return head(p) + rest;
+}
+
+// the first calls are made from a primitive
+display(head(map(deep, list(100))));
+deep(50);
@@ -0,0 +1,9 @@
+// every call that is not a tail call takes a frame on the control stack, and
+// the default 256 frames fit the program and 255 nested calls of depth, but no
+// more; the calls take no room on the operand stack, which does not run out
+function depth(n) {
+  return n === 0 ? 0 : depth(n - 1) + 1;
+}
+
+display(depth(254));
+depth(300);
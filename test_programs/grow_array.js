@@ -0,0 +1,16 @@
+const x = [1, 2];
+for (let i = 2; i < 40; i = i + 1) {
+  x[i] = x[i - 1] + i;
+}
+
+display(array_length(x));
+display(x[0]);
+display(x[7]);
+display(x[8]);
+display(x[9]);
+display(x[16]);
+display(x[17]);
+display(x[33]);
+display(x[39]);
+display(x[40]);
+x[20];
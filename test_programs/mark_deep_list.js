@@ -0,0 +1,20 @@
+let xs = null;
+for (let i = 0; i < 500; i = i + 1) {
+  xs = pair(pair(i, null), xs);
+}
+
+// cyclic garbage, which is only freed by a mark-and-sweep
+let p = null;
+for (let i = 0; i < 5000; i = i + 1) {
+  p = pair(i, null);
+  set_tail(p, p);
+}
+
+let sum = 0;
+while (!is_null(xs)) {
+  sum = sum + head(head(xs));
+  xs = tail(xs);
+}
+
+display(sum);
+head(p);
@@ -0,0 +1,19 @@
+// storing past the first four elements converts the pair into an array that
+// is large enough straight away
+const p = pair(1, 2);
+display(is_array(p));
+display(array_length(p));
+display(p[0] + p[1]);
+display(p[2]);
+
+p[1] = 5;
+display(tail(p));
+display(equal(p, [1, 5]));
+display(p);
+
+p[9] = 7;
+display(is_pair(p));
+display(array_length(p));
+display(head(p));
+display(p);
+p[9];
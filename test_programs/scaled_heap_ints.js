@@ -0,0 +1,10 @@
+// the last pairs are past the first 16 MB of the heap, where a scaled pointer
+// has the same bits set as the integer tag
+let xs = null;
+for (let i = 0; i < 600000; i = i + 1) {
+  xs = pair(i, xs);
+}
+
+display(is_number(xs));
+display(head(xs) + 1);
+xs < 1;
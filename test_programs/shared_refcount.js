@@ -0,0 +1,28 @@
+// every element refers to the same pair, which saturates its reference count
+// with either header layout
+function fill(p, n) {
+  let xs = [];
+  for (let i = 0; i < n; i = i + 1) {
+    xs[i] = p;
+  }
+  let count = 0;
+  for (let i = 0; i < n; i = i + 1) {
+    if (xs[i] === p) {
+      count = count + 1;
+    }
+  }
+  return count;
+}
+
+let p = pair(1, 2);
+display(fill(p, 140000));
+// dropping every reference must leave the pair alive
+display(head(p) + tail(p));
+
+// once it is unreachable, it is freed by a mark-sweep
+p = null;
+for (let i = 0; i < 6000; i = i + 1) {
+  const xs = [];
+  xs[200] = xs;
+}
+"done";
@@ -0,0 +1,17 @@
+// every element refers to the same string constant
+let xs = [];
+for (let i = 0; i < 66000; i = i + 1) {
+  xs[i] = "a";
+}
+
+let n = 0;
+for (let i = 0; i < 66000; i = i + 1) {
+  if (xs[i] === "a") {
+    n = n + 1;
+  }
+}
+display(n);
+
+// drop every reference to the constant, which must outlive them
+xs = null;
+"a" + "b";
@@ -0,0 +1,19 @@
+// each call to make leaves behind its environment, and the function in it that
+// refers back to it, which also refer to the live xs; when the lazy sweep frees
+// them, it must drop their references to xs too
+function make(x) {
+  function f() {
+    return x;
+  }
+  return 0;
+}
+
+const xs = pair(1, 2);
+let i = 0;
+while (i < 3000) {
+  make(xs);
+  i = i + 1;
+}
+
+display(head(xs));
+i;
@@ -0,0 +1,23 @@
+// the first block's environment is left in the environment cache while the
+// second block makes garbage cycles; each collection must free the cached
+// environment, even when the heap is swept lazily
+function make(x) {
+  function f() {
+    return x;
+  }
+  return 0;
+}
+
+let i = 0;
+while (i < 3000) {
+  {
+    const a = i;
+    const b = i;
+  }
+  {
+    const j = i;
+    make(j);
+  }
+  i = i + 1;
+}
+i;
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sinter/heap.h>
+#include <sinter/heap_obj.h>
+#include <sinter/stack.h>
+#include <sinter/vm.h>
+
+/*
+ * Allocator microbenchmark.
+ *
+ * Live objects are kept in the current environment, so that they survive a
+ * mark-and-sweep, should one be needed. All objects are allocated as strings,
+ * which have no children, so the benchmark can free them without initialising
+ * their contents.
+ *
+ * Two workloads are run:
+ *
+ * - mixed: repeatedly replaces a random object in a pool with a new one. The
+ *   sizes follow roughly what the VM allocates when running a typical program:
+ *   mostly small environments, closures, pairs and string constants, with some
+ *   strings and the occasional large array.
+ * - holes: fills the heap with pairs, frees every other one, then repeatedly
+ *   allocates and frees a string that does not fit in the holes left behind.
+ *
+ * Usage: heap_bench [iterations]
+ */
+
+#define MIXED_POOL_SIZE 768
+#define HOLES_POOL_SIZE 1024
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rng(void) {
+  rng_state = rng_state * 1103515245u + 12345u;
+  return (rng_state >> 16) & 0x7fff;
+}
+
+static address_t random_size(void) {
+  const uint32_t r = rng() % 100;
+  if (r < 35) {
+    return SIENV_SIZE(1 + rng() % 4);
+  } else if (r < 50) {
+    return sizeof(siheap_function_t);
+  } else if (r < 65) {
+    return SIPAIR_SIZE;
+  } else if (r < 75) {
+    return sizeof(siheap_array_data_t) + 2*sizeof(sinanbox_t);
+  } else if (r < 85) {
+    return sizeof(siheap_strconst_t);
+  } else if (r < 99) {
+    return sizeof(siheap_string_t) + 1 + rng() % 64;
+  } else {
+    return sizeof(siheap_array_data_t) + (16 + rng() % 112)*sizeof(sinanbox_t);
+  }
+}
+
+static void replace(sinanbox_t *slot, address_t size) {
+  siheap_derefbox(*slot);
+  *slot = size ? SIHEAP_PTRTONANBOX(siheap_malloc(size, sitype_string)) : NANBOX_OFNULL();
+}
+
+static void reset(uint16_t pool_size) {
+  siheap_init();
+  sistack_init();
+  sistate.env = NULL;
+  sistate.env = sienv_new(NULL, pool_size);
+}
+
+static void report(const char *name, unsigned long iterations, clock_t start, clock_t end) {
+  const double seconds = (double) (end - start) / CLOCKS_PER_SEC;
+  printf("%-6s %lu allocations in %.3f s (%.1f ns per allocation)\n",
+    name, iterations, seconds, seconds * 1e9 / (double) (iterations ? iterations : 1));
+}
+
+static void run_mixed(unsigned long iterations) {
+  reset(MIXED_POOL_SIZE);
+
+  const clock_t start = clock();
+  for (unsigned long i = 0; i < iterations; ++i) {
+    replace(&sistate.env->entry[rng() % MIXED_POOL_SIZE], random_size());
+  }
+  report("mixed", iterations, start, clock());
+}
+
+static void run_holes(unsigned long iterations) {
+  reset(HOLES_POOL_SIZE);
+
+  sinanbox_t *const pool = sistate.env->entry;
+  for (size_t i = 0; i < HOLES_POOL_SIZE; ++i) {
+    replace(&pool[i], SIPAIR_SIZE);
+  }
+  for (size_t i = 0; i < HOLES_POOL_SIZE; i += 2) {
+    replace(&pool[i], 0);
+  }
+
+  // short-lived strings, like the intermediate results of a concatenation
+  const clock_t start = clock();
+  for (unsigned long i = 0; i < iterations; ++i) {
+    replace(&pool[0], sizeof(siheap_string_t) + 64 + rng() % 64);
+    replace(&pool[0], 0);
+  }
+  report("holes", iterations, start, clock());
+}
+
+int main(int argc, char *argv[]) {
+  const unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+
+#ifndef SINTER_STATIC_HEAP
+  siheap_size = 0x10000;
+  siheap = malloc(siheap_size);
+  if (!siheap) {
+    return 1;
+  }
+#endif
+
+  if (SINTER_FAULTED()) {
+    fprintf(stderr, "Faulted: %d\n", sistate.fault_reason);
+    return 1;
+  }
+
+  run_mixed(iterations);
+  run_holes(iterations);
+
+  return 0;
+}
@@ -54,9 +54,32 @@ typedef struct {
  */
 sinter_fault_t sinter_run(const unsigned char *code, const size_t code_size, sinter_value_t *result);
 
+/**
+ * Whether sinter_run compiles programs into native code before running them.
+ *
+ * This has no effect unless Sinter is built with SINTER_JIT for a supported
+ * host. Programs that cannot be compiled are interpreted. Defaults to false.
+ */
+extern bool sinter_jit_enabled;
+
+/**
+ * A program translated into C by svm2c. See sinter/aot.h.
+ */
+typedef struct sinter_aot_program sinter_aot_program_t;
+
+/**
+ * Runs a program translated into C by svm2c.
+ *
+ * This behaves like sinter_run on the original SVML program.
+ */
+sinter_fault_t sinter_run_aot(const sinter_aot_program_t *program, sinter_value_t *result);
+
 /**
  * Set up the heap.
  *
+ * If the heap is not suitably aligned, or is larger than can be addressed (4 MB,
+ * or 32 MB with SINTER_SCALED_POINTERS), only the part that is usable is used.
+ *
  * This function is a no-op if SINTER_STATIC_HEAP is defined.
  */
 void sinter_setup_heap(void *heap, size_t size);
@@ -91,6 +114,26 @@ typedef void (*sinter_printfn_float)(float value, bool is_error);
  */
 typedef void (*sinter_printfn_flush)(bool is_error);
 
+/**
+ * Statistics about the last program run.
+ *
+ * These are only collected if SINTER_STATS is defined; otherwise, they are
+ * always zero. They are reset at the start of each run.
+ */
+typedef struct {
+  // calls to closures and internal functions whose inline cache matched the
+  // function called (only with SINTER_PREDECODE)
+  uint32_t call_cache_hits;
+  // calls to closures and internal functions whose inline cache did not match
+  uint32_t call_cache_misses;
+  // newenv instructions that reused an environment released by popenv
+  uint32_t env_cache_hits;
+  // newenv instructions that allocated a new environment on the heap
+  uint32_t env_cache_misses;
+} sinter_stats_t;
+
+extern sinter_stats_t sinter_stats;
+
 extern sinter_printfn_string sinter_printer_string;
 extern sinter_printfn_integer sinter_printer_integer;
 extern sinter_printfn_float sinter_printer_float;
@@ -0,0 +1,197 @@
+#ifndef SINTER_AOT_H
+#define SINTER_AOT_H
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../sinter.h"
+#include "opcode.h"
+#include "program.h"
+#include "nanbox.h"
+#include "fault.h"
+#include "heap.h"
+#include "heap_obj.h"
+#include "stack.h"
+#include "vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runtime support for programs translated into C by svm2c.
+ *
+ * Each reachable SVML function becomes a C function that runs on the same
+ * operand stack, environments and heap as the interpreter, so primitives and
+ * the garbage collector work the same way on both. The translated function
+ * runs with its frame and environment already set up, and returns after
+ * pushing its return value onto the caller's stack (ret), or after setting up
+ * the frame of the function it tail calls.
+ *
+ * The SVML program itself is embedded in the generated file, as closures and
+ * string constants still point into it.
+ */
+
+/**
+ * A translated SVML function.
+ */
+typedef void (*siaot_fnptr_t)(void);
+
+typedef struct {
+  // the SVML address of the function header
+  address_t address;
+  siaot_fnptr_t fn;
+} siaot_function_t;
+
+struct sinter_aot_program {
+  const unsigned char *program;
+  size_t program_size;
+  // the translated functions, sorted by address
+  const siaot_function_t *functions;
+  size_t function_count;
+};
+
+/**
+ * Runs the translated function for the given SVML function, and any functions
+ * it tail calls, in the frame that has been set up for it.
+ *
+ * Faults if the function was not translated.
+ */
+void siaot_run(const svm_function_t *fn);
+
+/**
+ * Calls the function below the top num_args entries of the stack (call and
+ * call.t).
+ *
+ * For a tail call, the caller's frame is destroyed first. If the callee is an
+ * SVML function, its frame is set up and it is run once the translated caller
+ * returns, so tail calls do not grow the C stack.
+ */
+void siaot_call(uint8_t num_args, bool is_tailcall);
+
+/**
+ * Calls an internal function (call.p, call.v and their tail variants).
+ */
+void siaot_call_internal(uint8_t id, uint8_t num_args, bool is_primitive, bool is_tailcall);
+
+/**
+ * Destroys the current frame and pushes the return value onto the caller's
+ * stack.
+ */
+void siaot_ret_value(sinanbox_t v);
+
+void siaot_lgc_s(address_t address);
+void siaot_new_c(address_t address);
+void siaot_new_a(void);
+void siaot_newenv(uint8_t entry_count);
+void siaot_popenv(void);
+void siaot_lda(void);
+void siaot_sta(void);
+
+void siaot_add_g(void);
+void siaot_add_f(void);
+void siaot_sub(void);
+void siaot_mul(void);
+void siaot_div(void);
+void siaot_mod(void);
+void siaot_neg(void);
+void siaot_not(void);
+void siaot_lt_g(void);
+void siaot_gt_g(void);
+void siaot_le_g(void);
+void siaot_ge_g(void);
+void siaot_lt_f(void);
+void siaot_gt_f(void);
+void siaot_le_f(void);
+void siaot_ge_f(void);
+void siaot_eq(bool negate);
+
+/*
+ * The simplest instructions are inline, so that the C compiler can keep their
+ * operands in registers.
+ */
+
+SINTER_INLINEIFC void siaot_ldl(uint8_t index);
+SINTER_INLINEIFC void siaot_stl(uint8_t index);
+SINTER_INLINEIFC void siaot_ldp(uint8_t index, uint8_t envindex);
+SINTER_INLINEIFC void siaot_stp(uint8_t index, uint8_t envindex);
+SINTER_INLINEIFC bool siaot_pop_bool(void);
+SINTER_INLINEIFC void siaot_pop(void);
+SINTER_INLINEIFC void siaot_dup(void);
+SINTER_INLINEIFC void siaot_ret(void);
+
+#ifndef __cplusplus
+SINTER_INLINEIFC void siaot_ldl(uint8_t index) {
+  sinanbox_t v = sienv_get(sistate.env, index);
+  if (NANBOX_ISEMPTY(v)) {
+    sifault(sinter_fault_uninitialised_load);
+    return;
+  }
+  siheap_refbox(v);
+  sistack_push(v);
+}
+
+SINTER_INLINEIFC void siaot_stl(uint8_t index) {
+  sienv_put(sistate.env, index, sistack_pop());
+}
+
+SINTER_INLINEIFC void siaot_ldp(uint8_t index, uint8_t envindex) {
+  siheap_env_t *env = sienv_getparent(sistate.env, envindex);
+#ifndef SINTER_DISABLE_CHECKS
+  if (!env) {
+    sifault(sinter_fault_invalid_load);
+    return;
+  }
+#endif
+  sinanbox_t v = sienv_get(env, index);
+  if (NANBOX_ISEMPTY(v)) {
+    sifault(sinter_fault_uninitialised_load);
+    return;
+  }
+  siheap_refbox(v);
+  sistack_push(v);
+}
+
+SINTER_INLINEIFC void siaot_stp(uint8_t index, uint8_t envindex) {
+  siheap_env_t *env = sienv_getparent(sistate.env, envindex);
+#ifndef SINTER_DISABLE_CHECKS
+  if (!env) {
+    sifault(sinter_fault_invalid_load);
+    return;
+  }
+#endif
+  sienv_put(env, index, sistack_pop());
+}
+
+SINTER_INLINEIFC bool siaot_pop_bool(void) {
+  sinanbox_t v = sistack_pop();
+  if (!NANBOX_ISBOOL(v)) {
+    sifault(sinter_fault_type);
+    return false;
+  }
+  return NANBOX_BOOL(v);
+}
+
+SINTER_INLINEIFC void siaot_pop(void) {
+  siheap_derefbox(sistack_pop());
+}
+
+SINTER_INLINEIFC void siaot_dup(void) {
+  sinanbox_t v = sistack_peek(0);
+  siheap_refbox(v);
+  sistack_push(v);
+}
+
+SINTER_INLINEIFC void siaot_ret(void) {
+  siaot_ret_value(sistack_pop());
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,6 +27,60 @@
 #define SINTER_STACK_ENTRIES 0x200
 #endif
 
+#ifndef SINTER_FRAME_ENTRIES
+#define SINTER_FRAME_ENTRIES 0x100
+#endif
+
+#ifndef SINTER_ENV_STACK_SIZE
+#define SINTER_ENV_STACK_SIZE 0x1000
+#endif
+
+#ifndef SINTER_MARK_STACK_ENTRIES
+#define SINTER_MARK_STACK_ENTRIES 0x80
+#endif
+
+#if defined(SINTER_CYCLE_BUDGET) && !defined(SINTER_CYCLE_ROOTS)
+#define SINTER_CYCLE_ROOTS 0x40
+#endif
+
+#if defined(SINTER_THREADED_DISPATCH) && !defined(__GNUC__)
+// Threaded dispatch needs labels as values, a GNU extension
+// Fall back to the portable switch loop
+#undef SINTER_THREADED_DISPATCH
+#endif
+
+#if defined(SINTER_QUICKEN) && !defined(SINTER_PREDECODE)
+// Quickening rewrites the decoded program in place
+#undef SINTER_QUICKEN
+#endif
+
+#if defined(SINTER_DECODE_ADDRESS_MAP) && (!defined(SINTER_PREDECODE) || SINTER_DEBUG_LOGLEVEL < 1)
+// Without decoding, the program counter is already an SVML address, and only
+// debug output reports addresses
+#undef SINTER_DECODE_ADDRESS_MAP
+#endif
+
+#if defined(SINTER_ENV_DISPLAY) && !defined(SINTER_PREDECODE)
+// Display lengths are computed when decoding the program
+#undef SINTER_ENV_DISPLAY
+#endif
+
+#if defined(SINTER_JIT) && !(defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__)))
+// The JIT only emits x86-64 code, and needs mmap for executable memory
+// Programs are interpreted as usual
+#undef SINTER_JIT
+#endif
+
+#if defined(SINTER_FREE_BUDGET) && defined(SINTER_DEBUG_MEMORY_CHECK)
+// The memory check expects dead objects to be freed by the next instruction
+#undef SINTER_FREE_BUDGET
+#endif
+
+#if defined(SINTER_VERIFY) && defined(SINTER_DISABLE_CHECKS)
+// Everything already runs without the checks
+#undef SINTER_VERIFY
+#endif
+
 #ifndef SINTER_INLINE
 #define SINTER_INLINE inline
 #endif
@@ -0,0 +1,236 @@
+#ifndef SINTER_DECODE_H
+#define SINTER_DECODE_H
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "opcode.h"
+#include "program.h"
+#include "nanbox.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The decoded instruction stream.
+ *
+ * With SINTER_PREDECODE, the program is translated into this format when it is
+ * loaded, so that the interpreter never has to do unaligned loads of packed
+ * operands.
+ *
+ * Every instruction starts with a 4-byte cell holding the opcode, followed by
+ * any single-byte operands in the same positions as in the SVML encoding.
+ * 32-bit operands follow the cell in their own aligned word.
+ *
+ * Instructions that load a constant with an operand (ldc/lgc of integers,
+ * floats and strings) are all decoded into ldc_nanbox, which pushes a NaN-box
+ * computed by the decoder. For strings, the NaN-box points to a string
+ * constant object that is created when decoding and lives as long as the
+ * decoded program. Its reference count is saturated, so loading a string
+ * neither allocates nor counts a reference. ldc_nanbox, and the
+ * superinstructions below, use opcodes after the last SVML opcode.
+ *
+ * Branch offsets are relative to the end of the decoded instruction, and the
+ * addresses of jmp and new_c are offsets into the decoded stream. Function
+ * headers are copied, so an svm_function_t pointer works the same way on
+ * decoded code, except that the padding byte holds SIDEC_FUNCTION_* flags.
+ * String constant objects still refer to the string in the original program.
+ *
+ * call and call.t take a second word, which is an inline cache of the last
+ * function called from that instruction. The function is checked when it is
+ * first called; later calls of the same function skip the checks.
+ *
+ * The padding bytes in each cell are reserved for later use (e.g. storing
+ * a decoded handler address). With SINTER_QUICKEN, instructions that can be
+ * quickened use them for type feedback (see below).
+ *
+ * Some common instruction sequences are fused into superinstructions. A
+ * sequence is only fused if none of its instructions, other than the first, is
+ * a branch target. The sequences were chosen from the most frequent opcode
+ * pairs executed by the programs in test_programs:
+ *
+ * - lgc_u; pop (after every expression statement) is removed entirely
+ * - ldl; ldl becomes fused_ldl_ldl
+ * - ldl; any constant load that becomes ldc_nanbox becomes fused_ldl_ldc
+ * - lgc_i; add/sub becomes fused_add_i/fused_sub_i
+ * - lt/gt/le/ge; br_f becomes fused_lt_br_f etc.
+ */
+typedef enum __attribute__((__packed__)) {
+  op_ldc_nanbox      = op_neq_b + 1,
+  op_decoded_last    = op_ldc_nanbox
+} sidec_opcode_t;
+_Static_assert(sizeof(sidec_opcode_t) == 1, "enum sidec_opcode has wrong size");
+
+typedef enum __attribute__((__packed__)) {
+  op_fused_ldl_ldl   = op_decoded_last + 1,
+  op_fused_ldl_ldc,
+  op_fused_add_i,
+  op_fused_sub_i,
+  op_fused_lt_br_f,
+  op_fused_gt_br_f,
+  op_fused_le_br_f,
+  op_fused_ge_br_f,
+  op_fused_last = op_fused_ge_br_f
+} sidec_fused_opcode_t;
+_Static_assert(sizeof(sidec_fused_opcode_t) == 1, "enum sidec_fused_opcode has wrong size");
+
+/*
+ * Quickened instructions.
+ *
+ * With SINTER_QUICKEN, generic arithmetic and comparison instructions record
+ * the kind of operands they see in struct sidec_op_feedback. Once an
+ * instruction has seen the same kind enough times in a row, it is rewritten in
+ * place into a quickened instruction that only handles that kind: two integers
+ * (_ii), two floats (_ff) or two strings (_strstr).
+ *
+ * If a quickened instruction sees any other kind of operand, it is rewritten
+ * back into the generic instruction (deoptimised), which then runs as usual.
+ * An instruction that is deoptimised too often is never quickened again.
+ */
+typedef enum __attribute__((__packed__)) {
+  op_quick_add_ii    = op_fused_last + 1,
+  op_quick_add_ff,
+  op_quick_add_strstr,
+  op_quick_sub_ii,
+  op_quick_sub_ff,
+  op_quick_lt_ii,
+  op_quick_lt_ff,
+  op_quick_gt_ii,
+  op_quick_gt_ff,
+  op_quick_le_ii,
+  op_quick_le_ff,
+  op_quick_ge_ii,
+  op_quick_ge_ff,
+  op_quick_lt_br_f_ii,
+  op_quick_lt_br_f_ff,
+  op_quick_gt_br_f_ii,
+  op_quick_gt_br_f_ff,
+  op_quick_le_br_f_ii,
+  op_quick_le_br_f_ff,
+  op_quick_ge_br_f_ii,
+  op_quick_ge_br_f_ff,
+  op_quick_last = op_quick_ge_br_f_ff
+} sidec_quick_opcode_t;
+_Static_assert(sizeof(sidec_quick_opcode_t) == 1, "enum sidec_quick_opcode has wrong size");
+
+#ifdef SINTER_DECSTRUCT
+#error Conflicting SINTER_DECSTRUCT defined.
+#endif
+#define SINTER_DECSTRUCT(__ident__, __size__, __body__) \
+  struct sidec_ ## __ident__ { \
+    opcode_t opcode; \
+    __body__ \
+  }; \
+  _Static_assert(sizeof(struct sidec_ ## __ident__) == __size__, "struct sidec_" #__ident__ " has wrong size");
+
+SINTER_DECSTRUCT(op, 4,
+  uint8_t padding[3];
+)
+
+SINTER_DECSTRUCT(op_nanbox, 8,
+  uint8_t padding[3];
+  sinanbox_t value;
+)
+
+SINTER_DECSTRUCT(op_address, 8,
+  uint8_t padding[3];
+  address_t address;
+)
+
+SINTER_DECSTRUCT(op_oneindex, 4,
+  uint8_t index;
+  uint8_t padding[2];
+)
+
+SINTER_DECSTRUCT(op_twoindex, 4,
+  uint8_t index;
+  uint8_t envindex;
+  uint8_t padding;
+)
+
+SINTER_DECSTRUCT(op_offset, 8,
+  uint8_t padding[3];
+  offset_t offset;
+)
+
+SINTER_DECSTRUCT(op_call, 8,
+  uint8_t num_args;
+  uint8_t padding[2];
+  // the last function called: the NaN-box of an internal function, or the
+  // offset of a function in the decoded program
+  uint32_t cache;
+)
+
+// The inline cache of a call instruction that has not called anything yet
+#define SIDEC_CALL_CACHE_EMPTY UINT32_MAX
+
+// Set in the padding byte of a decoded function header if the function's
+// environment cannot be captured, so it can live on the environment stack
+#define SIDEC_FUNCTION_NOESCAPE 1
+// The rest of the padding byte holds the length of the display of the
+// function's environments (see sienv_display), which newenv instructions in the
+// function also hold in their first padding byte
+#define SIDEC_FUNCTION_DISPLAY_SHIFT 1
+
+SINTER_DECSTRUCT(op_call_internal, 4,
+  uint8_t id;
+  uint8_t num_args;
+  uint8_t padding;
+)
+
+SINTER_DECSTRUCT(op_twolocal, 4,
+  uint8_t index;
+  uint8_t index2;
+  uint8_t padding;
+)
+
+SINTER_DECSTRUCT(op_local_nanbox, 8,
+  uint8_t index;
+  uint8_t padding[2];
+  sinanbox_t value;
+)
+
+// Overlays the first cell of an instruction that can be quickened
+SINTER_DECSTRUCT(op_feedback, 4,
+  // the quickened opcode matching the operands last seen, or 0 if none
+  uint8_t kind;
+  // the number of times in a row that kind was seen
+  uint8_t count;
+  // the number of times this instruction was deoptimised
+  uint8_t deopts;
+)
+
+#undef SINTER_DECSTRUCT
+
+/**
+ * Decodes the program in sistate.program into a new heap object, and sets
+ * sistate.code and sistate.code_end.
+ *
+ * Only code reachable from the entry point is decoded. Faults if the program
+ * is malformed, or if the heap is too small to hold the decoded program.
+ *
+ * Returns the decoded entry point.
+ */
+const svm_function_t *sidecode_program(void);
+
+/**
+ * Gets the SVML address corresponding to a pointer into the decoded program.
+ *
+ * This is only exact if SINTER_DECODE_ADDRESS_MAP is defined, in which case the
+ * decoder keeps one SVML address for every word of the decoded program.
+ * Otherwise, or for a pointer outside the decoded program, the offset from the
+ * start of the decoded program is returned.
+ *
+ * A fused instruction maps to the address of the first instruction in its
+ * sequence.
+ */
+ptrdiff_t sidecode_pctoaddr(const opcode_t *pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -42,10 +42,11 @@ SINTER_INLINEIFC void sidisplay_strobj(siheap_header_t *obj, _Bool is_error) {
   case sitype_intcont:
   case sitype_array_data:
   case sitype_empty:
-  case sitype_frame:
+  case sitype_code:
   case sitype_free:
   case sitype_env:
   case sitype_array:
+  case sitype_pair:
   case sitype_function:
     break;
   }
@@ -83,15 +84,16 @@ SINTER_INLINEIFC void sidisplay_nanbox(sinanbox_t v, bool is_error) {
       case sitype_string:
         sidisplay_strobj(obj, is_error);
         break;
-      case sitype_array: {
-        siheap_array_t *a = (siheap_array_t *) obj;
+      case sitype_array:
+      case sitype_pair: {
+        const address_t count = siarray_length(obj);
         obj->flag_displayed = true; // mark the array so we don't recursively display it
         SIVMFN_PRINT("[", is_error);
-        for (size_t i = 0; i < a->count; ++i) {
+        for (address_t i = 0; i < count; ++i) {
           if (i) {
             SIVMFN_PRINT(", ", is_error);
           }
-          sidisplay_nanbox(a->data->data[i], is_error);
+          sidisplay_nanbox(siarray_load(obj, i), is_error);
         }
         SIVMFN_PRINT("]", is_error);
         obj->flag_displayed = false;
@@ -105,7 +107,7 @@ SINTER_INLINEIFC void sidisplay_nanbox(sinanbox_t v, bool is_error) {
         break;
       case sitype_array_data:
       case sitype_empty:
-      case sitype_frame:
+      case sitype_code:
       case sitype_free:
       case sitype_env:
       default:
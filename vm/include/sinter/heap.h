@@ -4,8 +4,10 @@
 #include "config.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "opcode.h"
 #include "fault.h"
@@ -19,7 +21,6 @@ extern "C" {
 
 typedef enum __attribute__((__packed__)) {
   sitype_empty = 0,
-  sitype_frame = 20,
   sitype_env = 21,
   sitype_strconst = 22,
   sitype_strpair = 23,
@@ -28,6 +29,8 @@ typedef enum __attribute__((__packed__)) {
   sitype_array_data = 26,
   sitype_function = 27,
   sitype_intcont = 28,
+  sitype_code = 29,
+  sitype_pair = 30,
   sitype_free = 0xFF,
 } siheap_type_t;
 _Static_assert(sizeof(siheap_type_t) == 1, "siheap_type_t wider than needed");
@@ -53,42 +56,258 @@ SINTER_INLINE bool siheap_inrange(const unsigned char *const ent) {
 #else
 #define SIHEAP_INRANGE(ent) (((unsigned char *) (ent)) < siheap + SINTER_HEAP_SIZE)
 #endif
-#define SIHEAP_PTRTONANBOX(ptr) NANBOX_OFPTR((uint32_t) (((unsigned char *) (ptr)) - siheap))
-#define SIHEAP_NANBOXTOPTR(val) ((void *) (siheap + NANBOX_PTR(val)))
+
+/*
+ * A NaN-boxed heap pointer holds a 22-bit offset into the heap. With
+ * SINTER_SCALED_POINTERS, objects are 8-byte aligned, and the offset is stored
+ * divided by 8, so the heap can be up to 32 MB instead of 4 MB.
+ */
+#ifdef SINTER_SCALED_POINTERS
+#define SIHEAP_PTR_SHIFT 3
+#else
+#define SIHEAP_PTR_SHIFT 0
+#endif
+#define SIHEAP_ALIGN ((address_t) 1 << SIHEAP_PTR_SHIFT)
+#define SIHEAP_MAX_SIZE ((size_t) 0x400000 << SIHEAP_PTR_SHIFT)
+
+SINTER_INLINE sinanbox_t siheap_ptrtonanbox(const void *ptr) {
+  const size_t offset = (size_t) ((const unsigned char *) ptr - siheap);
+  assert(offset < SINTER_HEAP_SIZE && !(offset & (SIHEAP_ALIGN - 1)));
+  return NANBOX_OFPTR((uint32_t) (offset >> SIHEAP_PTR_SHIFT));
+}
+
+#define SIHEAP_PTRTONANBOX(ptr) (siheap_ptrtonanbox((ptr)))
+#define SIHEAP_NANBOXTOPTR(val) ((void *) (siheap + ((size_t) NANBOX_PTR(val) << SIHEAP_PTR_SHIFT)))
 
 /**
  * The header of a heap allocation.
+ *
+ * With SINTER_COMPACT_HEADER, the previous block is stored as an offset into
+ * the heap instead of a pointer, and the reference count shares a word with the
+ * type and flags, and is then wider.
+ *
+ * With either layout, the reference count saturates instead of wrapping
+ * around: an object whose count reaches SIHEAP_REFCOUNT_MAX is only freed by
+ * mark-sweep.
  */
 typedef struct siheap_header {
+#ifdef SINTER_COMPACT_HEADER
+  /**
+   * The offset of the previous block from the start of the heap, or
+   * SIHEAP_NO_PREV. Use siheap_prev.
+   */
+  uint32_t prev_offset;
+#else
   struct siheap_header *prev_node;
+#endif
   /**
    * The size of the allocation, including the header.
    */
   address_t size;
+#ifndef SINTER_COMPACT_HEADER
   uint16_t refcount;
-#ifdef SINTER_DEBUG_MEMORY_CHECK
+#endif
+#if defined(SINTER_DEBUG_MEMORY_CHECK) && defined(SINTER_COMPACT_HEADER)
+  uint32_t debug_refcount;
+  uint32_t internal_refcount;
+#elif defined(SINTER_DEBUG_MEMORY_CHECK)
   uint16_t debug_refcount;
   uint16_t internal_refcount;
 #endif
+#ifdef SINTER_COMPACT_HEADER
+  siheap_type_t type : 8;
+#else
   siheap_type_t type;
+#endif
   _Bool flag_marked : 1;
   _Bool flag_destroying : 1;
   _Bool flag_displayed : 1;
+  // used by the cycle collector; see memory.c
+  _Bool flag_buffered : 1;
+  _Bool flag_gray : 1;
+  _Bool flag_white : 1;
+  _Bool flag_pending : 1;
+#ifdef SINTER_COMPACT_HEADER
+  uint32_t refcount : 17;
+#endif
 } siheap_header_t;
 
+#ifdef SINTER_COMPACT_HEADER
+#define SIHEAP_REFCOUNT_MAX 0x1ffff
+#else
+#define SIHEAP_REFCOUNT_MAX UINT16_MAX
+#endif
+
+#ifdef SINTER_COMPACT_HEADER
+#define SIHEAP_NO_PREV UINT32_MAX
+#ifndef SINTER_DEBUG_MEMORY_CHECK
+_Static_assert(sizeof(siheap_header_t) == 12, "compact siheap_header_t not packed");
+#endif
+#endif
+
+SINTER_INLINE siheap_header_t *siheap_prev(const siheap_header_t *ent) {
+#ifdef SINTER_COMPACT_HEADER
+  return ent->prev_offset == SIHEAP_NO_PREV ? NULL : (siheap_header_t *) (siheap + ent->prev_offset);
+#else
+  return ent->prev_node;
+#endif
+}
+
+SINTER_INLINE void siheap_set_prev(siheap_header_t *ent, siheap_header_t *prev) {
+#ifdef SINTER_COMPACT_HEADER
+  ent->prev_offset = prev ? (uint32_t) ((unsigned char *) prev - siheap) : SIHEAP_NO_PREV;
+#else
+  ent->prev_node = prev;
+#endif
+}
+
+/**
+ * Returns whether the reference count of the object has saturated, and no
+ * longer changes.
+ */
+SINTER_INLINE bool siheap_refcount_stuck(const siheap_header_t *ent) {
+  return ent->refcount == SIHEAP_REFCOUNT_MAX;
+}
+
+/**
+ * Saturates the reference count of the object, so that references to it need
+ * not be counted. The object is then only freed by mark-sweep.
+ */
+SINTER_INLINE void siheap_make_permanent(siheap_header_t *ent) {
+  ent->refcount = SIHEAP_REFCOUNT_MAX;
+}
+
 typedef struct siheap_free {
   siheap_header_t header;
   struct siheap_free *prev_free;
   struct siheap_free *next_free;
 } siheap_free_t;
 
-extern siheap_free_t *siheap_first_free;
+/*
+ * Free blocks are kept in segregated free lists, one for each size class.
+ *
+ * The small classes are SIHEAP_CLASS_GRANULE bytes wide, starting from the
+ * smallest possible block. Allocation sizes are rounded up to the granule, so
+ * any block in the class of an allocation fits it exactly. The small classes
+ * cover the sizes of the objects the VM allocates most often (environments,
+ * frames, pairs and string constants), and siheap_free_small_map records which
+ * of them are non-empty.
+ *
+ * Blocks too big for the small classes are binned by the power of two of their
+ * size, and siheap_free_large_map records which of those classes are non-empty.
+ * A large block only has to be searched for in the class of its size. Any block
+ * in a larger class fits.
+ *
+ * With SINTER_SCALED_POINTERS, the granule is the alignment of objects, so
+ * that every block but the last starts and ends on an aligned address.
+ */
+#ifdef SINTER_SCALED_POINTERS
+#define SIHEAP_CLASS_GRANULE SIHEAP_ALIGN
+#else
+#define SIHEAP_CLASS_GRANULE 4
+#endif
+#define SIHEAP_SMALL_CLASSES 32
+#define SIHEAP_LARGE_CLASSES 32
+#define SIHEAP_CLASSES (SIHEAP_SMALL_CLASSES + SIHEAP_LARGE_CLASSES)
+
+extern siheap_free_t *siheap_free_lists[SIHEAP_CLASSES];
+extern uint32_t siheap_free_small_map;
+extern uint32_t siheap_free_large_map;
+
+/**
+ * The stack of objects being destroyed. See memory.c.
+ */
+extern siheap_header_t *siheap_dying;
+
+#ifdef SINTER_SWEEP_BUDGET
+/**
+ * The value of flag_marked of objects marked by the last mark phase. It is
+ * flipped when the sweep ends, which unmarks the objects left. See memory.c.
+ */
+extern bool siheap_mark_epoch;
+/**
+ * The next block to be swept, or NULL if no sweep is in progress.
+ */
+extern siheap_header_t *siheap_sweep_cursor;
+#endif
+
+/**
+ * Returns whether the object is marked.
+ */
+SINTER_INLINE bool siheap_ismarked(const siheap_header_t *ent) {
+#ifdef SINTER_SWEEP_BUDGET
+  return ent->flag_marked == siheap_mark_epoch;
+#else
+  return ent->flag_marked;
+#endif
+}
+
+SINTER_INLINE void siheap_setmarked(siheap_header_t *ent, bool marked) {
+#ifdef SINTER_SWEEP_BUDGET
+  ent->flag_marked = marked == siheap_mark_epoch;
+#else
+  ent->flag_marked = marked;
+#endif
+}
+
+#ifdef SINTER_CYCLE_BUDGET
+/**
+ * The candidate roots of garbage cycles. See memory.c.
+ */
+extern siheap_header_t *siheap_cycle_roots[SINTER_CYCLE_ROOTS];
+extern size_t siheap_cycle_root_count;
+/**
+ * Set when the candidate buffer fills up, and cleared once it is empty.
+ */
+extern bool siheap_cycle_collecting;
+#endif
+
+SINTER_INLINE address_t siheap_round_size(address_t size) {
+  return (size + SIHEAP_CLASS_GRANULE - 1) & ~(address_t) (SIHEAP_CLASS_GRANULE - 1);
+}
+
+SINTER_INLINE unsigned int siheap_ctz32(uint32_t v) {
+#if UINT_MAX >= UINT32_MAX
+  return __builtin_ctz(v);
+#else
+  return __builtin_ctzl(v);
+#endif
+}
+
+SINTER_INLINE unsigned int siheap_log2_32(uint32_t v) {
+#if UINT_MAX >= UINT32_MAX
+  return 31 - (unsigned int) __builtin_clz(v);
+#else
+  return 31 - (unsigned int) __builtin_clzl(v);
+#endif
+}
+
+SINTER_INLINE unsigned int siheap_size_class(address_t size) {
+  assert(size >= sizeof(siheap_free_t));
+  const address_t size_class = (size - sizeof(siheap_free_t)) / SIHEAP_CLASS_GRANULE;
+  return size_class < SIHEAP_SMALL_CLASSES ? size_class : SIHEAP_SMALL_CLASSES + siheap_log2_32(size);
+}
+
+/**
+ * Records whether the free list of the size class is non-empty.
+ */
+SINTER_INLINE void siheap_free_set_map(unsigned int size_class, bool nonempty) {
+  uint32_t *const map = size_class < SIHEAP_SMALL_CLASSES ? &siheap_free_small_map : &siheap_free_large_map;
+  const uint32_t bit = (uint32_t) 1 << (size_class % SIHEAP_SMALL_CLASSES);
+  if (nonempty) {
+    *map |= bit;
+  } else {
+    *map &= ~bit;
+  }
+}
 
 SINTER_INLINE void siheap_ref(void *vent) {
   assert(vent);
   siheap_header_t *ent = (siheap_header_t *) vent;
   assert(ent->type != sitype_free);
-  ent->refcount += 1;
+  if (!siheap_refcount_stuck(ent)) {
+    ent->refcount += 1;
+  }
 }
 
 SINTER_INLINE void siheap_refbox(sinanbox_t ent) {
@@ -104,93 +323,244 @@ SINTER_INLINE siheap_header_t *siheap_next(siheap_header_t *const ent) {
 SINTER_INLINE void siheap_fix_next(siheap_header_t *const ent) {
   siheap_header_t *const next = siheap_next(ent);
   if (SIHEAP_INRANGE(next)) {
-    next->prev_node = ent;
+    siheap_set_prev(next, ent);
   }
 }
 
+/**
+ * Removes a free block from its free list.
+ *
+ * The size of the block must not have changed since it was inserted.
+ */
 SINTER_INLINE void siheap_free_remove(siheap_free_t *cur) {
   if (cur->prev_free) {
     assert(cur->prev_free != cur->next_free);
-    assert(cur->prev_free->prev_free != cur->next_free || cur->next_free == NULL);
     assert(cur->prev_free->next_free == cur);
     cur->prev_free->next_free = cur->next_free;
   } else {
-    assert(siheap_first_free == cur);
-    siheap_first_free = cur->next_free;
+    const unsigned int size_class = siheap_size_class(cur->header.size);
+    assert(siheap_free_lists[size_class] == cur);
+    siheap_free_lists[size_class] = cur->next_free;
+    if (!cur->next_free) {
+      siheap_free_set_map(size_class, false);
+    }
   }
   if (cur->next_free) {
     assert(cur->next_free != cur->prev_free);
-    assert(cur->next_free->next_free != cur->prev_free || cur->prev_free == NULL);
     assert(cur->next_free->prev_free == cur);
     cur->next_free->prev_free = cur->prev_free;
   }
 }
 
-SINTER_INLINE void siheap_free_fix_neighbours(siheap_free_t *cur) {
-  if (cur->prev_free) {
-    assert(cur->prev_free != cur);
-    assert(cur->prev_free->prev_free != cur);
-    cur->prev_free->next_free = cur;
+/**
+ * Inserts a free block into the free list of its size class.
+ */
+SINTER_INLINE void siheap_free_insert(siheap_free_t *cur) {
+  const unsigned int size_class = siheap_size_class(cur->header.size);
+  siheap_free_t *const next = siheap_free_lists[size_class];
+  siheap_free_set_map(size_class, true);
+
+  assert(next != cur);
+  cur->prev_free = NULL;
+  cur->next_free = next;
+  siheap_free_lists[size_class] = cur;
+  if (next) {
+    next->prev_free = cur;
+  }
+}
+
+/**
+ * Puts a free block in the place of another one in the same free list.
+ *
+ * The new block must be in the same size class.
+ */
+SINTER_INLINE void siheap_free_replace(siheap_free_t *cur, siheap_free_t *with) {
+  with->prev_free = cur->prev_free;
+  with->next_free = cur->next_free;
+  if (with->prev_free) {
+    assert(with->prev_free != with);
+    with->prev_free->next_free = with;
   } else {
-    assert(
-      // inserting a new free node to the front of the list
-      siheap_first_free == cur->next_free
-      // from malloc_split: we've split siheap_first_free
-      || cur->header.prev_node == &siheap_first_free->header
-      // from mfree_inner: we're merging with the first free node, which is after us
-      || (siheap_first_free > cur && &siheap_first_free->header < siheap_next(&cur->header)));
-    siheap_first_free = cur;
+    siheap_free_lists[siheap_size_class(with->header.size)] = with;
   }
-  if (cur->next_free) {
-    assert(cur->next_free != cur);
-    assert(cur->next_free->next_free != cur);
-    cur->next_free->prev_free = cur;
+  if (with->next_free) {
+    assert(with->next_free != with);
+    with->next_free->prev_free = with;
   }
 }
 
-SINTER_INLINEIFC void siheap_init(void);
+/**
+ * Creates a free block spanning the given memory, and inserts it into the
+ * free lists.
+ *
+ * The block after it must not be free.
+ */
+SINTER_INLINEIFC siheap_free_t *siheap_free_new(void *at, address_t size, siheap_header_t *prev_node);
 #ifndef __cplusplus
-SINTER_INLINEIFC void siheap_init(void) {
-  siheap_first_free = (siheap_free_t *) siheap;
-  *siheap_first_free = (siheap_free_t) {
+SINTER_INLINEIFC siheap_free_t *siheap_free_new(void *at, address_t size, siheap_header_t *prev_node) {
+  siheap_free_t *const newfree = (siheap_free_t *) at;
+  *newfree = (siheap_free_t) {
     .header = {
       .type = sitype_free,
       .refcount = 0,
-      .prev_node = NULL,
-      .size = SINTER_HEAP_SIZE
+      .size = size
     },
     .prev_free = NULL,
     .next_free = NULL
   };
+  siheap_set_prev(&newfree->header, prev_node);
+  siheap_fix_next(&newfree->header);
+  siheap_free_insert(newfree);
+  return newfree;
+}
+#endif
+
+SINTER_INLINEIFC void siheap_init(void);
+#ifndef __cplusplus
+SINTER_INLINEIFC void siheap_init(void) {
+  for (unsigned int i = 0; i < SIHEAP_CLASSES; ++i) {
+    siheap_free_lists[i] = NULL;
+  }
+  siheap_free_small_map = 0;
+  siheap_free_large_map = 0;
+  siheap_dying = NULL;
+#ifdef SINTER_SWEEP_BUDGET
+  siheap_sweep_cursor = NULL;
+#endif
+#ifdef SINTER_CYCLE_BUDGET
+  siheap_cycle_root_count = 0;
+  siheap_cycle_collecting = false;
+#endif
+  siheap_free_new(siheap, SINTER_HEAP_SIZE, NULL);
 }
 #endif
 
 void siheap_mark_sweep(void);
 
-SINTER_INLINE siheap_free_t *siheap_malloc_find(address_t size) {
-  bool sweeped = false;
-  while (1) {
-    siheap_free_t *cur = siheap_first_free;
-    while (cur) {
-      if (cur->header.size >= size) {
-        break;
-      }
-      cur = cur->next_free;
+#ifdef SINTER_COMPACT_HEAP
+/**
+ * Slides live objects towards the start of the heap, merging the free space.
+ * Objects that the native stack may refer to do not move.
+ *
+ * Must only be called right after siheap_mark_sweep, while a program is
+ * running (see sistate.native_stack_base).
+ */
+void siheap_compact(void);
+#endif
+
+/**
+ * Destroys the given dead object, dereferencing its children, and frees it,
+ * along with any children that die as a result.
+ *
+ * Returns the block that the object was merged into.
+ */
+siheap_header_t *siheap_release(siheap_header_t *ent);
+
+#ifdef SINTER_FREE_BUDGET
+/**
+ * Queues the given dead object to be destroyed and freed later.
+ */
+void siheap_release_later(siheap_header_t *ent);
+
+/**
+ * Destroys and frees up to budget queued objects.
+ */
+void siheap_release_pending(size_t budget);
+#endif
+
+#ifdef SINTER_SWEEP_BUDGET
+/**
+ * Sweeps up to budget blocks, stopping early if a block of at least size bytes
+ * is freed, or if the end of the heap is reached, which ends the sweep.
+ */
+void siheap_sweep_lazily(address_t size, size_t budget);
+#endif
+
+#ifdef SINTER_CYCLE_BUDGET
+/**
+ * Buffers the given object as a candidate root of a garbage cycle, if it can
+ * be part of one, and there is space in the buffer.
+ */
+void siheap_possible_root(siheap_header_t *ent);
+
+/**
+ * Frees the garbage cycles reachable from up to budget candidate roots.
+ */
+void siheap_collect_cycles(size_t budget);
+#endif
+
+/**
+ * Finds a free block that can hold the given (rounded) size, or NULL if there
+ * is none.
+ *
+ * A block in a larger class than the size always fits, so only the class of
+ * the size itself is searched. In a small class, only a block at the very end
+ * of a heap whose size is not a multiple of the granule can be too small, so
+ * the search stops at the first or second block. A large class spans a power
+ * of two, so the search is linear in the number of free blocks in it. This is
+ * the worst case, e.g. when the heap is fragmented into many free blocks of
+ * just under twice the size.
+ */
+SINTER_INLINE siheap_free_t *siheap_free_find(address_t size) {
+  const unsigned int size_class = siheap_size_class(size);
+  for (siheap_free_t *cur = siheap_free_lists[size_class]; cur; cur = cur->next_free) {
+    if (cur->header.size >= size) {
+      return cur;
     }
+  }
 
-    if (!cur) {
-      if (sweeped) {
-        sifault(sinter_fault_out_of_memory);
-        return NULL;
-      } else {
-        sweeped = true;
-        siheap_mark_sweep();
-        continue;
-      }
+  uint32_t larger_large = siheap_free_large_map;
+  if (size_class < SIHEAP_SMALL_CLASSES) {
+    // any block in a larger small class fits
+    const uint32_t larger = siheap_free_small_map & ~(((uint32_t) 2 << size_class) - 1);
+    if (larger) {
+      return siheap_free_lists[siheap_ctz32(larger)];
     }
+  } else {
+    larger_large &= ~(((uint32_t) 2 << (size_class - SIHEAP_SMALL_CLASSES)) - 1);
+  }
+  return larger_large ? siheap_free_lists[SIHEAP_SMALL_CLASSES + siheap_ctz32(larger_large)] : NULL;
+}
 
-    return cur;
+SINTER_INLINE siheap_free_t *siheap_malloc_find(address_t size) {
+  siheap_free_t *cur = siheap_free_find(size);
+#ifdef SINTER_FREE_BUDGET
+  if (!cur && siheap_dying) {
+    siheap_release_pending(SIZE_MAX);
+    cur = siheap_free_find(size);
+  }
+#endif
+#ifdef SINTER_CYCLE_BUDGET
+  if (!cur && siheap_cycle_root_count) {
+    siheap_collect_cycles(SIZE_MAX);
+    cur = siheap_free_find(size);
+  }
+#endif
+#ifdef SINTER_SWEEP_BUDGET
+  if (!cur && siheap_sweep_cursor) {
+    siheap_sweep_lazily(size, SIZE_MAX);
+    cur = siheap_free_find(size);
   }
+#endif
+  if (!cur) {
+    siheap_mark_sweep();
+#ifdef SINTER_SWEEP_BUDGET
+    siheap_sweep_lazily(size, SIZE_MAX);
+#endif
+    cur = siheap_free_find(size);
+#ifdef SINTER_COMPACT_HEAP
+    if (!cur) {
+      // there may be enough free space, but not in one block
+      siheap_compact();
+      cur = siheap_free_find(size);
+    }
+#endif
+    if (!cur) {
+      sifault(sinter_fault_out_of_memory);
+      return NULL;
+    }
+  }
+  return cur;
 }
 
 SINTER_INLINEIFC siheap_header_t *siheap_malloc_split(siheap_free_t *cur, address_t size, siheap_type_t type);
@@ -199,23 +569,28 @@ SINTER_INLINEIFC siheap_header_t *siheap_malloc_split(siheap_free_t *cur, addres
   if (size + sizeof(siheap_free_t) <= cur->header.size) {
     // enough space for a new free node
     // create one
-    siheap_free_t *newfree = (siheap_free_t *) (((unsigned char *) cur) + size);
-    *newfree = (siheap_free_t) {
-      .header = {
-        .type = sitype_free,
-        .refcount = 0,
-        .prev_node = &cur->header,
-        .size = cur->header.size - size
-      },
-      .prev_free = cur->prev_free,
-      .next_free = cur->next_free
-    };
-    assert(cur->prev_free != cur);
-    assert(cur->next_free != cur);
-    assert(cur->prev_free != cur->next_free || cur->prev_free == NULL);
+    const address_t rest = cur->header.size - size;
+    unsigned char *const rest_start = ((unsigned char *) cur) + size;
+    if (siheap_size_class(cur->header.size) == siheap_size_class(rest)) {
+      // the rest of the block stays where the block was in its free list
+      siheap_free_t *const newfree = (siheap_free_t *) rest_start;
+      *newfree = (siheap_free_t) {
+        .header = {
+          .type = sitype_free,
+          .refcount = 0,
+          .size = rest
+        },
+        .prev_free = NULL,
+        .next_free = NULL
+      };
+      siheap_set_prev(&newfree->header, &cur->header);
+      siheap_free_replace(cur, newfree);
+      siheap_fix_next(&newfree->header);
+    } else {
+      siheap_free_remove(cur);
+      siheap_free_new(rest_start, rest, &cur->header);
+    }
     cur->header.size = size;
-    siheap_free_fix_neighbours(newfree);
-    siheap_fix_next(&newfree->header);
   } else {
     // no space for a free header
     siheap_free_remove(cur);
@@ -223,6 +598,11 @@ SINTER_INLINEIFC siheap_header_t *siheap_malloc_split(siheap_free_t *cur, addres
 
   cur->header.type = type;
   cur->header.flag_destroying = cur->header.flag_displayed = cur->header.flag_marked = false;
+  cur->header.flag_buffered = cur->header.flag_gray = cur->header.flag_white = cur->header.flag_pending = false;
+#ifdef SINTER_SWEEP_BUDGET
+  // objects allocated during a sweep must survive it
+  siheap_setmarked(&cur->header, siheap_sweep_cursor != NULL);
+#endif
 #ifdef SINTER_DEBUG_MEMORY_CHECK
   cur->header.internal_refcount = 0;
 #endif
@@ -239,90 +619,94 @@ SINTER_INLINE siheap_header_t *siheap_malloc(address_t size, siheap_type_t type)
   if (size < sizeof(siheap_free_t)) {
     size = sizeof(siheap_free_t);
   }
+  size = siheap_round_size(size);
 
+#ifdef SINTER_SWEEP_BUDGET
+  if (siheap_sweep_cursor) {
+    siheap_sweep_lazily(size, SINTER_SWEEP_BUDGET);
+  }
+#endif
+#ifdef SINTER_FREE_BUDGET
+  if (siheap_dying) {
+    siheap_release_pending(SINTER_FREE_BUDGET);
+  }
+#endif
+#ifdef SINTER_CYCLE_BUDGET
+  if (SINTER_CYCLE_BUDGET && siheap_cycle_collecting) {
+    siheap_collect_cycles(SINTER_CYCLE_BUDGET);
+  }
+#endif
   siheap_free_t *free_block = siheap_malloc_find(size);
   siheap_header_t *allocated = siheap_malloc_split(free_block, size, type);
   siheap_ref(allocated);
   return allocated;
 }
 
-void siheap_mdestroy(siheap_header_t *ent);
 
 SINTER_INLINE siheap_header_t *siheap_mfree_inner(siheap_header_t *ent) {
   assert(ent->size >= sizeof(siheap_free_t));
+#ifdef SINTER_SWEEP_BUDGET
+  // objects that survived the mark phase may die before the sweep ends
+  if (siheap_ismarked(ent) && !siheap_sweep_cursor) {
+#else
   if (ent->flag_marked) {
+#endif
     SIBUGM("Freeing marked object\n");
     assert(false);
   }
 
   siheap_header_t *const next = siheap_next(ent);
-  siheap_header_t *const prev = ent->prev_node;
+  siheap_header_t *const prev = siheap_prev(ent);
   const bool next_inrange = SIHEAP_INRANGE(next);
   const bool next_free = next_inrange && next->type == sitype_free;
   const bool prev_free = prev && prev->type == sitype_free;
-  if (next_free && prev_free) {
-    // we have        [free][ent][free]
-    // we'll merge to [free           ]
-    prev->size = prev->size + ent->size + next->size;
-    siheap_fix_next(prev);
-    siheap_free_remove((siheap_free_t *) next);
-
-    return prev;
-  } else if (next_free) {
-    // we have        [ent][free]
-    // we'll merge to [free     ]
-
-    siheap_free_t *const nextf = (siheap_free_t *) next;
-    siheap_free_t *const entf = (siheap_free_t *) ent;
 
-    assert(entf + 1 <= nextf);
-    ent->size = ent->size + next->size;
-    ent->type = sitype_free;
-    ent->flag_destroying = ent->flag_displayed = ent->flag_marked = false;
-#ifdef SINTER_DEBUG_MEMORY_CHECK
-    ent->internal_refcount = 0;
-#endif
-    entf->prev_free = nextf->prev_free;
-    entf->next_free = nextf->next_free;
-    assert(entf->prev_free != entf);
-    assert(entf->next_free != entf);
-    assert(entf->prev_free != entf->next_free || entf->prev_free == NULL);
-
-    siheap_free_fix_neighbours(entf);
-    siheap_fix_next(ent);
+  // the merged block changes size, so it moves to another free list
+  if (next_free) {
+    siheap_free_remove((siheap_free_t *) next);
+  }
+  if (prev_free) {
+    siheap_free_remove((siheap_free_t *) prev);
+  }
 
-    return ent;
-  } else if (prev_free) {
-    // we have        [free][ent]
+  siheap_header_t *merged = ent;
+  if (prev_free) {
+    // we have        [free][ent]([free])
     // we'll merge to [free     ]
-
-    prev->size = prev->size + ent->size;
-    siheap_fix_next(prev);
-
-    return prev;
+    merged = prev;
+    prev->size += ent->size;
   } else {
-    // create a new free entry
-    siheap_free_t *const entf = (siheap_free_t *) ent;
-
     ent->type = sitype_free;
     ent->flag_destroying = ent->flag_displayed = ent->flag_marked = false;
+    ent->flag_buffered = ent->flag_gray = ent->flag_white = ent->flag_pending = false;
 #ifdef SINTER_DEBUG_MEMORY_CHECK
     ent->internal_refcount = 0;
 #endif
-    entf->prev_free = NULL;
-    entf->next_free = siheap_first_free;
-    assert(entf->next_free != entf);
-    siheap_free_fix_neighbours(entf);
+  }
+  if (next_free) {
+    // we have        ([free])[ent][free]
+    // we'll merge to [free          ]
+    merged->size += next->size;
+  }
 
-    return ent;
+  if (next_free || prev_free) {
+    siheap_fix_next(merged);
+  }
+  siheap_free_insert((siheap_free_t *) merged);
+#ifdef SINTER_SWEEP_BUDGET
+  // the sweep must not be left inside the merged block
+  if (siheap_sweep_cursor > merged && siheap_sweep_cursor < siheap_next(merged)) {
+    siheap_sweep_cursor = merged;
   }
+#endif
+
+  return merged;
 }
 
 SINTER_INLINE siheap_header_t *siheap_mfree(siheap_header_t *ent) {
   assert(ent->refcount == 0);
   assert(ent->type != sitype_free);
-  siheap_mdestroy(ent);
-  return siheap_mfree_inner(ent);
+  return siheap_release(ent);
 }
 
 siheap_header_t *siheap_mrealloc(siheap_header_t *ent, address_t newsize);
@@ -339,11 +723,20 @@ SINTER_INLINE void siheap_deref(void *vent) {
   assert(ent->type != sitype_free || siheap_sweeping);
 #endif
 
-  if (ent->refcount) {
+  if (ent->refcount && !siheap_refcount_stuck(ent)) {
     ent->refcount -= 1;
     if (!ent->refcount && ent->type != sitype_free) {
+#ifdef SINTER_FREE_BUDGET
+      siheap_release_later(ent);
+#else
       siheap_mfree(ent);
+#endif
+    }
+#ifdef SINTER_CYCLE_BUDGET
+    else if (ent->refcount && !ent->flag_buffered) {
+      siheap_possible_root(ent);
     }
+#endif
   }
 }
 
@@ -2,6 +2,9 @@
 #define SINTER_HEAP_OBJ_H
 
 #include "config.h"
+
+#include <string.h>
+
 #include "opcode.h"
 #include "heap.h"
 #include "debug.h"
@@ -19,30 +22,99 @@ typedef struct siheap_env {
   siheap_header_t header;
   struct siheap_env *parent;
   uint16_t entry_count;
+#ifdef SINTER_ENV_DISPLAY
+  // the number of ancestors in the display; see sienv_display
+  uint8_t display_count;
+#endif
   sinanbox_t entry[];
 } siheap_env_t;
 #endif
 
 #define SIENV_SIZE(entry_count) (sizeof(siheap_env_t) + (entry_count)*sizeof(sinanbox_t))
 
+#ifdef SINTER_ENV_DISPLAY
+/*
+ * With SINTER_ENV_DISPLAY, an environment may be followed by a display: its
+ * ancestors from the grandparent on, so that ldp and stp reach any of them with
+ * one load instead of following the parent chain. The decoder records how many
+ * ancestors each function refers to, and its environments (and those of its
+ * blocks) are created with a display that long, copied from the parent's.
+ * A closure thus captures the display along with its environment.
+ *
+ * The display is not reference-counted, and the garbage collector does not
+ * mark through it: the ancestors are kept alive through the parent chain.
+ */
+
+// Functions that only reach ancestors shallower than this get no display, as
+// following the chain is then cheaper than filling in the display
+#define SIENV_DISPLAY_MIN_DEPTH 4
+
+// The most ancestors kept in a display; ldp and stp follow the parent chain
+// beyond that
+#define SIENV_DISPLAY_MAX 8
+
+#define SIENV_DISPLAY_OFFSET(entry_count) \
+  ((SIENV_SIZE(entry_count) + sizeof(siheap_env_t *) - 1) & ~(sizeof(siheap_env_t *) - 1))
+#define SIENV_DISPLAY_SIZE(entry_count, display_count) \
+  (SIENV_DISPLAY_OFFSET(entry_count) + (display_count)*sizeof(siheap_env_t *))
+
+SINTER_INLINEIFC siheap_env_t **sienv_display(siheap_env_t *env);
+#ifndef __cplusplus
+SINTER_INLINEIFC siheap_env_t **sienv_display(siheap_env_t *env) {
+  return (siheap_env_t **) ((unsigned char *) env + SIENV_DISPLAY_OFFSET(env->entry_count));
+}
+#endif
+
 /**
- * Create a new environment heap object.
+ * Fill in the display of a new environment, up to display_count ancestors,
+ * from its parent's display. The allocation must have room for them.
+ */
+void sienv_build_display(siheap_env_t *env, uint8_t display_count);
+
+/**
+ * Like sienv_build_display, but keeps environments without a display (the
+ * common case) off the slow path.
+ */
+SINTER_INLINEIFC void sienv_fill_display(siheap_env_t *env, uint8_t display_count);
+#ifndef __cplusplus
+SINTER_INLINEIFC void sienv_fill_display(siheap_env_t *env, uint8_t display_count) {
+  env->display_count = 0;
+  if (display_count) {
+    sienv_build_display(env, display_count);
+  }
+}
+#endif
+#else
+#define SIENV_DISPLAY_SIZE(entry_count, display_count) ((void) (display_count), SIENV_SIZE(entry_count))
+#endif
+
+/**
+ * Create a new environment heap object, with a display of up to display_count
+ * ancestors (see sienv_display). display_count is ignored without
+ * SINTER_ENV_DISPLAY.
  *
  * This increments the reference count on the parent environment, if any.
  */
-SINTER_INLINEIFC siheap_env_t *sienv_new(
+SINTER_INLINEIFC siheap_env_t *sienv_new_display(
   siheap_env_t *parent,
-  const uint16_t entry_count);
+  const uint16_t entry_count,
+  const uint8_t display_count);
 #ifndef __cplusplus
-SINTER_INLINEIFC siheap_env_t *sienv_new(
+SINTER_INLINEIFC siheap_env_t *sienv_new_display(
   siheap_env_t *parent,
-  const uint16_t entry_count) {
-  siheap_env_t *env = (siheap_env_t *) siheap_malloc(SIENV_SIZE(entry_count), sitype_env);
+  const uint16_t entry_count,
+  const uint8_t display_count) {
+  siheap_env_t *env = (siheap_env_t *) siheap_malloc(SIENV_DISPLAY_SIZE(entry_count, display_count), sitype_env);
   env->parent = parent;
   env->entry_count = entry_count;
   for (size_t i = 0; i < entry_count; ++i) {
     env->entry[i] = NANBOX_OFEMPTY();
   }
+#ifdef SINTER_ENV_DISPLAY
+  sienv_fill_display(env, display_count);
+#else
+  (void) display_count;
+#endif
   if (parent) {
     siheap_ref(parent);
   }
@@ -51,15 +123,79 @@ SINTER_INLINEIFC siheap_env_t *sienv_new(
 }
 #endif
 
-SINTER_INLINEIFC void sienv_destroy(siheap_env_t *const env);
+/**
+ * Create a new environment heap object.
+ *
+ * This increments the reference count on the parent environment, if any.
+ */
+SINTER_INLINEIFC siheap_env_t *sienv_new(
+  siheap_env_t *parent,
+  const uint16_t entry_count);
+#ifndef __cplusplus
+SINTER_INLINEIFC siheap_env_t *sienv_new(
+  siheap_env_t *parent,
+  const uint16_t entry_count) {
+  return sienv_new_display(parent, entry_count, 0);
+}
+#endif
+
+// The number of entry counts for which sienv_cache holds an environment
+#define SIENV_CACHE_SIZES 8
+
+/**
+ * Environments released by popenv, indexed by entry count, for the next newenv
+ * of the same size to reuse. A cached environment has no parent and empty
+ * entries, and the cache holds the only reference to it.
+ *
+ * The cache is emptied at each mark-sweep, which frees the environments in it.
+ */
+extern siheap_env_t *sienv_cache[SIENV_CACHE_SIZES];
+
+/**
+ * Take an environment from sienv_cache, or return NULL if there is none of
+ * that size (including room for a display of display_count ancestors).
+ *
+ * The environment takes over the caller's reference to the parent.
+ */
+SINTER_INLINEIFC siheap_env_t *sienv_cache_take(siheap_env_t *parent, const uint16_t entry_count, const uint8_t display_count);
+#ifndef __cplusplus
+SINTER_INLINEIFC siheap_env_t *sienv_cache_take(siheap_env_t *parent, const uint16_t entry_count, const uint8_t display_count) {
+  if (entry_count >= SIENV_CACHE_SIZES || !sienv_cache[entry_count]
+      || sienv_cache[entry_count]->header.size < SIENV_DISPLAY_SIZE(entry_count, display_count)) {
+    return NULL;
+  }
+  siheap_env_t *env = sienv_cache[entry_count];
+  sienv_cache[entry_count] = NULL;
+  env->parent = parent;
+#ifdef SINTER_ENV_DISPLAY
+  sienv_fill_display(env, display_count);
+#endif
+  return env;
+}
+#endif
+
+/**
+ * Put an environment that is being released into sienv_cache, if nothing else
+ * refers to it and there is room. Returns whether it was cached.
+ *
+ * If so, the caller takes over the environment's reference to its parent.
+ */
+SINTER_INLINEIFC bool sienv_cache_put(siheap_env_t *env);
 #ifndef __cplusplus
-SINTER_INLINEIFC void sienv_destroy(siheap_env_t *const env) {
+SINTER_INLINEIFC bool sienv_cache_put(siheap_env_t *env) {
+  if (env->header.refcount != 1 || env->entry_count >= SIENV_CACHE_SIZES || sienv_cache[env->entry_count]) {
+    return false;
+  }
   for (size_t i = 0; i < env->entry_count; ++i) {
     siheap_derefbox(env->entry[i]);
+    env->entry[i] = NANBOX_OFEMPTY();
   }
-  if (env->parent) {
-    siheap_deref(env->parent);
-  }
+  env->parent = NULL;
+#ifdef SINTER_ENV_DISPLAY
+  env->display_count = 0;
+#endif
+  sienv_cache[env->entry_count] = env;
+  return true;
 }
 #endif
 
@@ -116,6 +252,22 @@ SINTER_INLINEIFC siheap_env_t *sienv_getparent(siheap_env_t *env, unsigned int i
 }
 #endif
 
+/**
+ * Get an ancestor of the environment, like sienv_getparent, using its display
+ * if possible. env must not be NULL.
+ */
+SINTER_INLINEIFC siheap_env_t *sienv_ancestor(siheap_env_t *env, unsigned int index);
+#ifndef __cplusplus
+SINTER_INLINEIFC siheap_env_t *sienv_ancestor(siheap_env_t *env, unsigned int index) {
+#ifdef SINTER_ENV_DISPLAY
+  if (index >= 2 && index - 2 < env->display_count) {
+    return sienv_display(env)[index - 2];
+  }
+#endif
+  return sienv_getparent(env, index);
+}
+#endif
+
 typedef struct {
   siheap_header_t header;
   const svm_function_t *code;
@@ -131,26 +283,6 @@ SINTER_INLINE siheap_function_t *sifunction_new(const svm_function_t *code, sihe
   return fn;
 }
 
-SINTER_INLINE void sifunction_destroy(siheap_function_t *fn) {
-  if (fn->env) {
-    siheap_deref(fn->env);
-  }
-}
-
-typedef struct {
-  siheap_header_t header;
-  const opcode_t *return_address;
-  sinanbox_t *saved_stack_bottom;
-  sinanbox_t *saved_stack_limit;
-  sinanbox_t *saved_stack_top;
-  siheap_env_t *saved_env;
-} siheap_frame_t;
-
-SINTER_INLINE siheap_frame_t *siframe_new(void) {
-  return (siheap_frame_t *) siheap_malloc(
-    sizeof(siheap_frame_t), sitype_frame);
-}
-
 typedef struct {
   siheap_header_t header;
   const svm_constant_t *string;
@@ -185,13 +317,6 @@ SINTER_INLINE siheap_strpair_t *sistrpair_new(siheap_header_t *left, siheap_head
   return obj;
 }
 
-SINTER_INLINE void sistrpair_destroy(siheap_strpair_t *obj) {
-  siheap_deref(obj->left);
-  if (obj->right) {
-    siheap_deref(obj->right);
-  }
-}
-
 #ifdef __cplusplus
 struct siheap_string;
 typedef struct siheap_string siheap_string_t;
@@ -236,10 +361,11 @@ SINTER_INLINEIFC const char *sistrobj_tocharptr(siheap_header_t *obj) {
 
   case sitype_array:
   case sitype_array_data:
+  case sitype_pair:
   case sitype_empty:
   case sitype_free:
   case sitype_function:
-  case sitype_frame:
+  case sitype_code:
   case sitype_env:
   case sitype_intcont:
   default:
@@ -261,10 +387,11 @@ SINTER_INLINE _Bool siheap_is_string(siheap_header_t *h) {
     return false;
   case sitype_array:
   case sitype_array_data:
+  case sitype_pair:
   case sitype_empty:
   case sitype_free:
   case sitype_function:
-  case sitype_frame:
+  case sitype_code:
   case sitype_env:
   case sitype_intcont:
   default:
@@ -282,6 +409,14 @@ typedef struct siheap_array_data {
 } siheap_array_data_t;
 #endif
 
+/**
+ * An array.
+ *
+ * Arrays of up to SIARRAY_INLINE_MAX elements store them inline, directly
+ * after the array object, and data is NULL. Larger arrays, and arrays that
+ * have grown past their inline storage, store them in a separate
+ * siheap_array_data_t. Use siarray_data to get the elements.
+ */
 typedef struct {
   siheap_header_t header;
   address_t alloc_size;
@@ -289,20 +424,45 @@ typedef struct {
   siheap_array_data_t *data;
 } siheap_array_t;
 
+#define SIARRAY_INLINE_MAX 8
+
+/**
+ * Returns the number of elements to allocate for an array of alloc_size
+ * elements to hold the given index: alloc_size, doubled until it is large
+ * enough.
+ */
+SINTER_INLINE address_t siarray_grow_size(address_t alloc_size, address_t index) {
+  address_t new_size = alloc_size;
+  while (new_size && new_size <= index) {
+    new_size <<= 1;
+  }
+  return new_size ? new_size : UINT32_MAX;
+}
+
+SINTER_INLINEIFC sinanbox_t *siarray_data(siheap_array_t *array);
 SINTER_INLINEIFC siheap_array_t *siarray_new(address_t alloc_size);
 SINTER_INLINEIFC sinanbox_t siarray_get(siheap_array_t *array, address_t index);
 SINTER_INLINEIFC void siarray_put(siheap_array_t *array, address_t index, sinanbox_t v);
-SINTER_INLINEIFC void siarray_destroy(siheap_array_t *array);
 
 #ifndef __cplusplus
+SINTER_INLINEIFC sinanbox_t *siarray_data(siheap_array_t *array) {
+  return array->data ? array->data->data : (sinanbox_t *) (array + 1);
+}
+
 SINTER_INLINEIFC siheap_array_t *siarray_new(address_t alloc_size) {
-  siheap_array_t *array = (siheap_array_t *) siheap_malloc(sizeof(siheap_array_t), sitype_array);
+  const bool is_inline = alloc_size <= SIARRAY_INLINE_MAX;
+  siheap_array_t *array = (siheap_array_t *) siheap_malloc(
+    sizeof(siheap_array_t) + (is_inline ? alloc_size*sizeof(sinanbox_t) : 0), sitype_array);
   array->count = 0;
   array->alloc_size = alloc_size;
-  array->data = (siheap_array_data_t *) siheap_malloc(sizeof(siheap_array_data_t) + alloc_size*sizeof(sinanbox_t), sitype_array_data);
+  array->data = NULL;
+  if (!is_inline) {
+    array->data = (siheap_array_data_t *) siheap_malloc(sizeof(siheap_array_data_t) + alloc_size*sizeof(sinanbox_t), sitype_array_data);
+  }
 
+  sinanbox_t *data = siarray_data(array);
   for (address_t i = 0; i < alloc_size; ++i) {
-    array->data->data[i] = NANBOX_OFUNDEF();
+    data[i] = NANBOX_OFUNDEF();
   }
 
   return array;
@@ -313,38 +473,124 @@ SINTER_INLINEIFC sinanbox_t siarray_get(siheap_array_t *array, address_t index)
     return NANBOX_OFUNDEF();
   }
 
-  return array->data->data[index];
+  return siarray_data(array)[index];
 }
 
 SINTER_INLINEIFC void siarray_put(siheap_array_t *array, address_t index, sinanbox_t v) {
   if (index >= array->alloc_size) {
-    address_t new_size = array->alloc_size;
-    while (new_size && new_size <= index) {
-      new_size <<= 1;
-    }
-    if (!new_size) {
-      new_size = UINT32_MAX;
+    const address_t new_size = siarray_grow_size(array->alloc_size, index);
+    if (array->data) {
+      array->data = (siheap_array_data_t *) siheap_mrealloc(&array->data->header,
+        sizeof(siheap_array_data_t) + new_size*sizeof(sinanbox_t));
+    } else {
+      // spill the inline elements into a separate block; the inline storage
+      // is left unused
+      siheap_array_data_t *data = (siheap_array_data_t *) siheap_malloc(
+        sizeof(siheap_array_data_t) + new_size*sizeof(sinanbox_t), sitype_array_data);
+      memcpy(data->data, siarray_data(array), array->alloc_size*sizeof(sinanbox_t));
+      array->data = data;
     }
-    array->data = (siheap_array_data_t *) siheap_mrealloc(&array->data->header,
-      sizeof(siheap_array_data_t) + new_size*sizeof(sinanbox_t));
     for (address_t i = array->alloc_size; i < new_size; ++i) {
       array->data->data[i] = NANBOX_OFUNDEF();
     }
     array->alloc_size = new_size;
   }
 
-  siheap_derefbox(array->data->data[index]);
-  array->data->data[index] = v;
+  sinanbox_t *data = siarray_data(array);
+  siheap_derefbox(data[index]);
+  data[index] = v;
   if (array->count <= index) {
     array->count = index + 1;
   }
 }
+#endif
+
+/**
+ * A pair: an array of two elements, stored inline.
+ *
+ * Source programs cannot tell a pair from an array of two elements. A pair is
+ * converted into an array in place when an element beyond the second is
+ * stored, which is why a pair is allocated with enough space for an array.
+ *
+ * Code that accepts arrays should use siheap_isarray, siarray_length,
+ * siarray_load and siarray_store, which handle both.
+ */
+typedef struct {
+  siheap_header_t header;
+  sinanbox_t data[2];
+} siheap_pair_t;
+
+#define SIPAIR_SIZE (sizeof(siheap_pair_t) > sizeof(siheap_array_t) ? sizeof(siheap_pair_t) : sizeof(siheap_array_t))
+
+/**
+ * Creates a pair. The pair takes over the references to its elements.
+ */
+SINTER_INLINE siheap_pair_t *sipair_new(sinanbox_t head, sinanbox_t tail) {
+  siheap_pair_t *pair = (siheap_pair_t *) siheap_malloc(SIPAIR_SIZE, sitype_pair);
+  pair->data[0] = head;
+  pair->data[1] = tail;
+  return pair;
+}
+
+SINTER_INLINE bool siheap_isarray(const siheap_header_t *obj) {
+  return obj->type == sitype_array || obj->type == sitype_pair;
+}
+
+SINTER_INLINE address_t siarray_length(const siheap_header_t *obj) {
+  return obj->type == sitype_pair ? 2 : ((const siheap_array_t *) obj)->count;
+}
+
+SINTER_INLINEIFC siheap_array_t *sipair_toarray(siheap_pair_t *pair, address_t index);
+SINTER_INLINEIFC sinanbox_t siarray_load(siheap_header_t *obj, address_t index);
+SINTER_INLINEIFC void siarray_store(siheap_header_t *obj, address_t index, sinanbox_t v);
+
+#ifndef __cplusplus
+/**
+ * Converts a pair into an array in place, with room for an element at the
+ * given index.
+ */
+SINTER_INLINEIFC siheap_array_t *sipair_toarray(siheap_pair_t *pair, address_t index) {
+  // sized as siarray_put would grow a 4-element array, so that storing the
+  // element does not reallocate straight away
+  const address_t alloc_size = siarray_grow_size(4, index);
+  // the elements stay in the pair until the data is allocated, so that they
+  // are marked if this collects garbage
+  siheap_array_data_t *data = (siheap_array_data_t *) siheap_malloc(
+    sizeof(siheap_array_data_t) + alloc_size*sizeof(sinanbox_t), sitype_array_data);
+  data->data[0] = pair->data[0];
+  data->data[1] = pair->data[1];
+  for (address_t i = 2; i < alloc_size; ++i) {
+    data->data[i] = NANBOX_OFUNDEF();
+  }
+
+  siheap_array_t *array = (siheap_array_t *) pair;
+  array->header.type = sitype_array;
+  array->alloc_size = alloc_size;
+  array->count = 2;
+  array->data = data;
+  return array;
+}
 
-SINTER_INLINEIFC void siarray_destroy(siheap_array_t *array) {
-  for (address_t i = 0; i < array->alloc_size; ++i) {
-    siheap_derefbox(array->data->data[i]);
+SINTER_INLINEIFC sinanbox_t siarray_load(siheap_header_t *obj, address_t index) {
+  if (obj->type == sitype_pair) {
+    return index < 2 ? ((siheap_pair_t *) obj)->data[index] : NANBOX_OFUNDEF();
   }
-  siheap_deref(array->data);
+
+  return siarray_get((siheap_array_t *) obj, index);
+}
+
+SINTER_INLINEIFC void siarray_store(siheap_header_t *obj, address_t index, sinanbox_t v) {
+  if (obj->type == sitype_pair) {
+    siheap_pair_t *pair = (siheap_pair_t *) obj;
+    if (index < 2) {
+      siheap_derefbox(pair->data[index]);
+      pair->data[index] = v;
+      return;
+    }
+    sipair_toarray(pair, index);
+  }
+
+  siarray_put((siheap_array_t *) obj, index, v);
 }
 #endif
 
@@ -361,7 +607,6 @@ typedef struct siheap_intcont {
 #endif
 
 SINTER_INLINEIFC siheap_intcont_t *siintcont_new(sivmfnptr_t fn, address_t argc);
-SINTER_INLINEIFC void siintcont_destroy(siheap_intcont_t *ic);
 
 #ifndef __cplusplus
 SINTER_INLINEIFC siheap_intcont_t *siintcont_new(sivmfnptr_t fn, address_t argc) {
@@ -370,12 +615,26 @@ SINTER_INLINEIFC siheap_intcont_t *siintcont_new(sivmfnptr_t fn, address_t argc)
   ic->fn = fn;
   return ic;
 }
+#endif
 
-SINTER_INLINEIFC void siintcont_destroy(siheap_intcont_t *ic) {
-  for (address_t i = 0; i < ic->argc; ++i) {
-    siheap_derefbox(ic->argv[i]);
-  }
-}
+/**
+ * The decoded program, if SINTER_PREDECODE is enabled. See decode.h.
+ *
+ * This is allocated when the program is loaded and lives until the next
+ * program is loaded.
+ */
+#ifdef __cplusplus
+struct siheap_code;
+typedef struct siheap_code siheap_code_t;
+#else
+typedef struct siheap_code {
+  siheap_header_t header;
+  // the string constant objects loaded by the program, which are stored after
+  // the decoded program; each holds a reference to its object
+  sinanbox_t *strings;
+  address_t string_count;
+  uint32_t code[];
+} siheap_code_t;
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,39 @@
+#ifndef SINTER_JIT_H
+#define SINTER_JIT_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+#include "aot.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A baseline JIT compiler for x86-64 hosts, enabled with SINTER_JIT.
+ *
+ * Each reachable SVML function is compiled into native code by copying a
+ * template for each instruction. The templates call the same runtime support
+ * as programs translated by svm2c (see aot.h), and branches become native
+ * jumps. The compiled program is then run like a translated program.
+ */
+
+#ifdef SINTER_JIT
+/**
+ * Compiles the program into native code.
+ *
+ * Returns NULL if the host is not supported, or if executable memory cannot
+ * be mapped, in which case the program should be interpreted instead.
+ *
+ * The compiled program remains valid until the next call.
+ */
+const sinter_aot_program_t *sijit_compile(const unsigned char *program, size_t program_size);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
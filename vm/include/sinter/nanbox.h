@@ -77,6 +77,7 @@ sinanbox_t
 _Static_assert(sizeof(sinanbox_t) == 4, "sinanbox_t has wrong size");
 
 #define NANBOX_TYPEMASK 0xfff00000u
+#define NANBOX_INTMASK 0xffe00000u
 #define NANBOX_TEMPTY 0x7f900000u
 #define NANBOX_TUNDEF 0x7fa00000u
 #define NANBOX_TNULL 0x7fb00000u
@@ -95,10 +96,14 @@ _Static_assert(sizeof(sinanbox_t) == 4, "sinanbox_t has wrong size");
 #define NANBOX_ISUNDEF(val) ((val).as_u32 == NANBOX_TUNDEF)
 #define NANBOX_ISNULL(val) ((val).as_u32 == NANBOX_TNULL)
 #define NANBOX_ISBOOL(val) (NANBOX_GETTYPE(val) == NANBOX_TBOOL)
-#define NANBOX_ISINT(val) (((val).as_u32 & NANBOX_TINT) == NANBOX_TINT)
+#define NANBOX_ISINT(val) (((val).as_u32 & NANBOX_INTMASK) == NANBOX_TINT)
 #define NANBOX_ISPTR(val) (((val).as_u32 & NANBOX_TPTR) == NANBOX_TPTR)
 #define NANBOX_ISIFN(val) (NANBOX_GETTYPE(val) == NANBOX_TIFN)
 #define NANBOX_ISNUMERIC(val) (NANBOX_ISFLOAT(val) || NANBOX_ISINT(val))
+// both are integers iff both have the integer tag bits set, and neither has the
+// sign bit set, which all pointers have
+#define NANBOX_ISBOTHINT(v0, v1) (((((v0).as_u32 & (v1).as_u32) \
+  | (((v0).as_u32 | (v1).as_u32) & 0x80000000u)) & NANBOX_INTMASK) == NANBOX_TINT)
 
 #define NANBOX_FLOAT(val) ((val).as_float)
 #define NANBOX_BOOL(val) ((val).as_u32 & 1u)
@@ -4,6 +4,7 @@
 #include "config.h"
 
 #include <float.h>
+#include <math.h>
 #include <stdint.h>
 
 typedef unsigned char opcode_t;
@@ -159,4 +160,158 @@ SINTER_OPSTRUCT(call_internal, 2,
 
 #undef SINTER_OPSTRUCT
 
+/**
+ * Gets the operand of an f64 instruction as a float.
+ */
+SINTER_INLINE float siop_f64_operand(const struct op_f64 *instr) {
+#ifdef SINTER_SHORT_DOUBLE_WORKAROUND
+  // for systems (e.g. Arduino AVR) where double is actually an alias of float...
+  // manually convert the double into a float
+  union {
+    float value;
+    uint32_t bits;
+  } float_value;
+  _Static_assert(sizeof(float_value) == 4, "union of float and uint32_t is not 32-bit");
+
+  float_value.bits = 0;
+  // sign bit
+  if (instr->operand_u64 & (((uint64_t)1) << 63)) {
+    float_value.bits |= ((uint32_t)1) << 31;
+  }
+
+  const uint32_t offset_exponent = (instr->operand_u64 >> 52) & 0x7FFu;
+  const int32_t real_exponent = ((int32_t)offset_exponent) - 1023;
+  const uint64_t f64_mantissa = instr->operand_u64 & 0xFFFFFFFFFFFFFu;
+  // lop off the bottom 29 bits..
+  const uint32_t f32_mantissa = (instr->operand_u64 >> 29) & 0x7FFFFFu;
+  if (offset_exponent == 0x7FF) {
+    // NaN or infinity
+    // set all the exponent bits
+    float_value.bits |= 0x7F800000u;
+    if (f64_mantissa) {
+      // NaN, just set this to canonical NaN
+      float_value.bits = 0x7FC00000u;
+    }
+  } else if (offset_exponent == 0) {
+    // zero/subnormal
+    float_value.bits |= f32_mantissa;
+  } else if (real_exponent >= -126 && real_exponent <= 127) {
+    float_value.bits |= (real_exponent + 127) << 23;
+    float_value.bits |= f32_mantissa;
+  } else if (real_exponent < -126) {
+    float_value.value = -INFINITY;
+  } else if (real_exponent > 127) {
+    float_value.value = INFINITY;
+  }
+  return float_value.value;
+#else
+  return (float) instr->operand;
+#endif
+}
+
+/**
+ * Gets the size of an SVML instruction, or 0 if the opcode is invalid.
+ */
+SINTER_INLINE address_t siop_size(opcode_t op) {
+  switch (op) {
+  case op_nop:
+  case op_ldc_b_0:
+  case op_ldc_b_1:
+  case op_lgc_b_0:
+  case op_lgc_b_1:
+  case op_lgc_u:
+  case op_lgc_n:
+  case op_pop_g:
+  case op_pop_b:
+  case op_pop_f:
+  case op_add_g:
+  case op_add_f:
+  case op_sub_g:
+  case op_sub_f:
+  case op_mul_g:
+  case op_mul_f:
+  case op_div_g:
+  case op_div_f:
+  case op_mod_g:
+  case op_mod_f:
+  case op_not_g:
+  case op_not_b:
+  case op_lt_g:
+  case op_lt_f:
+  case op_gt_g:
+  case op_gt_f:
+  case op_le_g:
+  case op_le_f:
+  case op_ge_g:
+  case op_ge_f:
+  case op_eq_g:
+  case op_eq_f:
+  case op_eq_b:
+  case op_new_a:
+  case op_lda_g:
+  case op_lda_b:
+  case op_lda_f:
+  case op_sta_g:
+  case op_sta_b:
+  case op_sta_f:
+  case op_ret_g:
+  case op_ret_f:
+  case op_ret_b:
+  case op_ret_u:
+  case op_ret_n:
+  case op_dup:
+  case op_popenv:
+  case op_neg_g:
+  case op_neg_f:
+  case op_neq_g:
+  case op_neq_f:
+  case op_neq_b:
+    return sizeof(opcode_t);
+  case op_ldc_i:
+  case op_lgc_i:
+    return sizeof(struct op_i32);
+  case op_ldc_f32:
+  case op_lgc_f32:
+    return sizeof(struct op_f32);
+  case op_ldc_f64:
+  case op_lgc_f64:
+    return sizeof(struct op_f64);
+  case op_lgc_s:
+  case op_new_c:
+  case op_jmp:
+    return sizeof(struct op_address);
+  case op_ldl_g:
+  case op_ldl_f:
+  case op_ldl_b:
+  case op_stl_g:
+  case op_stl_b:
+  case op_stl_f:
+  case op_newenv:
+  case op_new_c_p:
+  case op_new_c_v:
+    return sizeof(struct op_oneindex);
+  case op_ldp_g:
+  case op_ldp_f:
+  case op_ldp_b:
+  case op_stp_g:
+  case op_stp_b:
+  case op_stp_f:
+    return sizeof(struct op_twoindex);
+  case op_br_t:
+  case op_br_f:
+  case op_br:
+    return sizeof(struct op_offset);
+  case op_call:
+  case op_call_t:
+    return sizeof(struct op_call);
+  case op_call_p:
+  case op_call_t_p:
+  case op_call_v:
+  case op_call_t_v:
+    return sizeof(struct op_call_internal);
+  default:
+    return 0;
+  }
+}
+
 #endif // SINTER_OPCODE_H
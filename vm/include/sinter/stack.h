@@ -4,6 +4,7 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #include "nanbox.h"
 #include "heap_obj.h"
@@ -17,14 +18,89 @@ extern "C" {
 extern sinanbox_t sistack[SINTER_STACK_ENTRIES];
 
 // (Inclusive) Bottom of the current function's operand stack, as an index into
-// sistack.
+// the current stack segment.
 extern sinanbox_t *sistack_bottom;
 // (Exclusive) Limit of the current function's operand stack, as an index into
-// sistack.
+// the current stack segment.
 extern sinanbox_t *sistack_limit;
 // Index of the next empty entry of the current function's operand stack.
 extern sinanbox_t *sistack_top;
 
+/**
+ * The state of a caller, saved while the callee runs.
+ *
+ * The saved environment is not counted separately: the caller's reference to
+ * it is kept until the callee returns.
+ */
+typedef struct {
+  const opcode_t *return_address;
+  siheap_env_t *saved_env;
+  sinanbox_t *saved_stack_bottom;
+  sinanbox_t *saved_stack_limit;
+} siframe_t;
+
+// The control stack, which holds a frame for each active call.
+extern siframe_t siframes[SINTER_FRAME_ENTRIES];
+// The next empty entry of the control stack.
+extern siframe_t *siframes_top;
+
+/**
+ * A segment of the operand stack and the control stack.
+ *
+ * sistack and siframes are the bottom segment. With SINTER_STACK_SEGMENTS, a
+ * call that does not fit in the current segment moves on to a new segment
+ * allocated from the host, and returns to the segment below when that call
+ * returns. Without it, the bottom segment is the only one.
+ */
+typedef struct sistack_segment {
+  // The segment below; NULL for the bottom segment.
+  struct sistack_segment *below;
+  // The segment above, if one has been allocated. It is kept when the stack
+  // shrinks back below it, to be reused the next time the stack grows.
+  struct sistack_segment *above;
+  // The tops of the stacks in the segment below, when this segment was entered.
+  sinanbox_t *below_stack_top;
+  siframe_t *below_frames_top;
+  sinanbox_t *stack;
+  sinanbox_t *stack_end;
+  siframe_t *frames;
+  siframe_t *frames_end;
+} sistack_segment_t;
+
+extern sistack_segment_t sistack_bottom_segment;
+// The segment holding sistack_top and siframes_top.
+extern sistack_segment_t *sistack_segment;
+
+// The (exclusive) top of the operand stack in a segment in use.
+SINTER_INLINE sinanbox_t *sistack_segment_top(const sistack_segment_t *segment) {
+  return segment == sistack_segment ? sistack_top : segment->above->below_stack_top;
+}
+
+// The (exclusive) top of the control stack in a segment in use.
+SINTER_INLINE siframe_t *siframes_segment_top(const sistack_segment_t *segment) {
+  return segment == sistack_segment ? siframes_top : segment->above->below_frames_top;
+}
+
+#ifdef SINTER_STACK_SEGMENTS
+/**
+ * Moves on to the next segment, allocating it if needed. Returns false if
+ * there are already SINTER_STACK_SEGMENTS segments above the bottom one, the
+ * host is out of memory, or a segment cannot hold size entries.
+ */
+bool sistack_grow(unsigned int size);
+
+/**
+ * Moves back to the segment below, once the first frame of the current
+ * segment has been destroyed.
+ */
+SINTER_INLINE void sistack_shrink(void) {
+  sistack_segment_t *const segment = sistack_segment;
+  sistack_top = segment->below_stack_top;
+  siframes_top = segment->below_frames_top;
+  sistack_segment = segment->below;
+}
+#endif
+
 SINTER_INLINE void sistack_push_force(sinanbox_t entry) {
 #if SINTER_DEBUG_LOGLEVEL >= 2
   SIDEBUG("Pushed onto stack: ");
@@ -73,15 +149,29 @@ SINTER_INLINE sinanbox_t sistack_peek(unsigned int index) {
 }
 
 SINTER_INLINE void sistack_new(unsigned int size, const opcode_t *return_address, siheap_env_t *return_env) {
-  siheap_frame_t *frame = siframe_new();
+  // this is checked even with SINTER_DISABLE_CHECKS, since the verifier cannot
+  // bound the depth of recursion
+#ifdef SINTER_STACK_SEGMENTS
+  if ((sistack_top + size > sistack_segment->stack_end || siframes_top == sistack_segment->frames_end)
+      && !sistack_grow(size)) {
+    sifault(sinter_fault_stack_overflow);
+    return;
+  }
+#else
+  if (sistack_top + size > sistack + SINTER_STACK_ENTRIES
+      || siframes_top == siframes + SINTER_FRAME_ENTRIES) {
+    sifault(sinter_fault_stack_overflow);
+    return;
+  }
+#endif
+
+  siframe_t *const frame = siframes_top++;
   frame->return_address = return_address;
   frame->saved_env = return_env;
   frame->saved_stack_bottom = sistack_bottom;
   frame->saved_stack_limit = sistack_limit;
-  frame->saved_stack_top = sistack_top;
-
-  sistack_push_force(SIHEAP_PTRTONANBOX(frame));
 
+  // the callee's operand stack starts at the caller's top
   sistack_bottom = sistack_top;
   sistack_limit = sistack_bottom + size;
 }
@@ -92,17 +182,153 @@ SINTER_INLINE void sistack_destroy(const opcode_t **return_address, siheap_env_t
     siheap_derefbox(v);
   }
 
-  siheap_frame_t *frame = (siheap_frame_t *) SIHEAP_NANBOXTOPTR(*(sistack_bottom - 1));
-  assert(frame->header.type == sitype_frame);
+  assert(siframes_top > siframes);
+  const siframe_t *const frame = --siframes_top;
 
   *return_address = frame->return_address;
   *return_env = frame->saved_env;
   sistack_bottom = frame->saved_stack_bottom;
   sistack_limit = frame->saved_stack_limit;
-  sistack_top = frame->saved_stack_top;
+#ifdef SINTER_STACK_SEGMENTS
+  // the caller's stack may be in the segment below
+  if (frame == sistack_segment->frames && sistack_segment->below) {
+    sistack_shrink();
+  }
+#endif
+}
+
+/**
+ * The environment stack.
+ *
+ * With SINTER_PREDECODE, functions whose environment cannot be captured (see
+ * SIDEC_FUNCTION_NOESCAPE) get their environment here instead of on the heap,
+ * as do the blocks within them. Nothing on the heap refers to an environment on
+ * the stack, so these are not reference-counted: each is owned by sistate.env,
+ * a frame, or the environment above it, and is released with sienv_release.
+ * Like heap environments, they hold references to their entries and, if it is
+ * on the heap, their parent.
+ *
+ * An environment that turns out to be captured after all is moved to the heap
+ * by sienv_promote, leaving a dead (sitype_free) slot behind that is reclaimed
+ * when the environments below it are released.
+ */
+#ifdef SINTER_PREDECODE
+extern unsigned char sienvstack[SINTER_ENV_STACK_SIZE];
+// The end of the last environment on the environment stack.
+extern unsigned char *sienvstack_top;
+
+SINTER_INLINE bool sienv_onstack(const siheap_env_t *env) {
+  return (const unsigned char *) env >= sienvstack
+    && (const unsigned char *) env < sienvstack + SINTER_ENV_STACK_SIZE;
+}
+
+/**
+ * Creates an environment on the environment stack, with a display of up to
+ * display_count ancestors (see sienv_new_display), or returns NULL if there is
+ * no room.
+ *
+ * This increments the reference count on the parent environment, if it is on
+ * the heap.
+ */
+SINTER_INLINEIFC siheap_env_t *sienvstack_push(siheap_env_t *parent, uint16_t entry_count, uint8_t display_count);
+#ifndef __cplusplus
+SINTER_INLINEIFC siheap_env_t *sienvstack_push(siheap_env_t *parent, uint16_t entry_count, uint8_t display_count) {
+  const size_t align = _Alignof(siheap_env_t);
+  const address_t size = (address_t) ((SIENV_DISPLAY_SIZE(entry_count, display_count) + align - 1) & ~(align - 1));
+  if (size > (size_t) (sienvstack + SINTER_ENV_STACK_SIZE - sienvstack_top)) {
+    return NULL;
+  }
+
+  siheap_env_t *const env = (siheap_env_t *) sienvstack_top;
+  sienvstack_top += size;
+  env->header = (siheap_header_t) { .size = size, .type = sitype_env };
+  env->parent = parent;
+  env->entry_count = entry_count;
+  for (size_t i = 0; i < entry_count; ++i) {
+    env->entry[i] = NANBOX_OFEMPTY();
+  }
+#ifdef SINTER_ENV_DISPLAY
+  sienv_fill_display(env, display_count);
+#else
+  (void) display_count;
+#endif
+  if (parent && !sienv_onstack(parent)) {
+    siheap_ref(parent);
+  }
+
+  return env;
+}
+#endif
+
+/**
+ * Releases an environment on the environment stack, along with anything above
+ * it. Returns its parent; the caller takes over the reference to it, if any.
+ */
+SINTER_INLINEIFC siheap_env_t *sienvstack_pop(siheap_env_t *env);
+#ifndef __cplusplus
+SINTER_INLINEIFC siheap_env_t *sienvstack_pop(siheap_env_t *env) {
+  for (size_t i = 0; i < env->entry_count; ++i) {
+    siheap_derefbox(env->entry[i]);
+  }
+  sienvstack_top = (unsigned char *) env;
+  return env->parent;
+}
+#endif
+#else
+// Without SINTER_PREDECODE, no function is marked SIDEC_FUNCTION_NOESCAPE, so
+// the environment stack is never used
+SINTER_INLINE bool sienv_onstack(const siheap_env_t *env) {
+  (void) env;
+  return false;
+}
+#endif
 
-  siheap_deref(frame);
+/**
+ * Releases a reference to an environment, which may be on the environment
+ * stack.
+ */
+SINTER_INLINEIFC void sienv_release(siheap_env_t *env);
+#ifndef __cplusplus
+SINTER_INLINEIFC void sienv_release(siheap_env_t *env) {
+#ifdef SINTER_PREDECODE
+  while (env && sienv_onstack(env)) {
+    env = sienvstack_pop(env);
+  }
+#endif
+  if (env) {
+    siheap_deref(env);
+  }
 }
+#endif
+
+#ifdef SINTER_PREDECODE
+/**
+ * Moves an environment on the environment stack down to the top of the stack,
+ * if the environments below it have been released. Returns its new address.
+ *
+ * This is used by tail calls, which release the caller's environment after
+ * creating the callee's.
+ */
+SINTER_INLINEIFC siheap_env_t *sienvstack_lower(siheap_env_t *env);
+#ifndef __cplusplus
+SINTER_INLINEIFC siheap_env_t *sienvstack_lower(siheap_env_t *env) {
+  if (sienv_onstack(env) && (unsigned char *) env > sienvstack_top) {
+    const address_t size = env->header.size;
+    memmove(sienvstack_top, env, size);
+    env = (siheap_env_t *) sienvstack_top;
+    sienvstack_top += size;
+  }
+  return env;
+}
+#endif
+
+/**
+ * Moves an environment on the environment stack, and its ancestors on the
+ * environment stack, to the heap, and updates all references to them. Returns
+ * the environment on the heap. Environments on the heap are returned as-is.
+ */
+siheap_env_t *sienv_promote(siheap_env_t *env);
+#endif
 
 void sistack_init(void);
 
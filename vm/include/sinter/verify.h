@@ -0,0 +1,33 @@
+#ifndef SINTER_VERIFY_H
+#define SINTER_VERIFY_H
+
+#include "config.h"
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Checks whether the program in sistate.program can run without the runtime
+ * stack and environment checks.
+ *
+ * The program passes if, for every function reachable from the entry point:
+ *
+ * - the operand stack never underflows, or grows beyond the function's
+ *   stack_size
+ * - every environment load and store is within the environment it refers to
+ * - every branch and jump lands on the start of an instruction
+ * - every lgc.s refers to a string constant in the constant pool
+ *
+ * This never faults; a program that does not pass (including malformed
+ * programs) simply runs with the checks.
+ */
+bool siverify_program(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,6 +13,7 @@
 #include "fault.h"
 #include "../sinter.h"
 #include "internal_fn.h"
+#include "decode.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,7 +25,24 @@ struct sistate {
   const opcode_t *pc;
   const opcode_t *program;
   const opcode_t *program_end;
+#ifdef SINTER_PREDECODE
+  const opcode_t *code;
+  const opcode_t *code_end;
+#endif
   siheap_env_t *env;
+  // the program being run, if it was translated into C by svm2c; NULL if it
+  // is interpreted
+  const sinter_aot_program_t *aot;
+#ifdef SINTER_COMPACT_HEAP
+  // the address of the native stack frame of the outermost call to siexec, or
+  // 0 if no program is running; the native stack above it is scanned for heap
+  // references when the heap is compacted
+  uintptr_t native_stack_base;
+#endif
+#ifdef SINTER_VERIFY
+  // whether the program passed the verifier, and runs without runtime checks
+  bool verified;
+#endif
 };
 
 extern struct sistate sistate;
@@ -63,12 +81,13 @@ SINTER_INLINEIFC __attribute__((warn_unused_result)) sinanbox_t siexec_nanbox(si
       return f->fn(f->argc, f->argv);
     }
     case sitype_empty:
-    case sitype_frame:
+    case sitype_code:
     case sitype_env:
     case sitype_strconst:
     case sitype_strpair:
     case sitype_string:
     case sitype_array:
+    case sitype_pair:
     case sitype_array_data:
     case sitype_free:
     default:
@@ -84,8 +103,31 @@ SINTER_INLINEIFC __attribute__((warn_unused_result)) sinanbox_t siexec_nanbox(si
 
 bool sivm_equal(sinanbox_t l, sinanbox_t r);
 
-#define SISTATE_CURADDR (sistate.pc - sistate.program)
-#define SISTATE_ADDRTOPC(addr) (sistate.program + (addr))
+#ifdef SINTER_VERIFY
+/**
+ * Runs the main interpreter loop without runtime stack and environment checks.
+ * This must only be used for programs that pass siverify_program.
+ */
+void sivm_main_loop_unchecked(void);
+#endif
+
+#ifdef SINTER_PREDECODE
+#define SISTATE_CODE (sistate.code)
+#define SISTATE_CODE_END (sistate.code_end)
+#define SISTATE_PCTOADDR(pc) sidecode_pctoaddr(pc)
+#else
+#define SISTATE_CODE (sistate.program)
+#define SISTATE_CODE_END (sistate.program_end)
+#define SISTATE_PCTOADDR(pc) ((pc) - sistate.program)
+#endif
+#define SISTATE_CURADDR SISTATE_PCTOADDR(sistate.pc)
+
+#ifdef SINTER_STATS
+#define SISTATS_INC(counter) ((void) ++sinter_stats.counter)
+#else
+#define SISTATS_INC(counter) ((void) 0)
+#endif
+#define SISTATE_ADDRTOPC(addr) (SISTATE_CODE + (addr))
 
 #ifdef __cplusplus
 }
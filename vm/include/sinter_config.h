@@ -48,4 +48,200 @@
  */
 // #define SINTER_STACK_ENTRIES 0x200
 
+/**
+ * Set the number of entries of the statically-allocated control stack, which
+ * limits the depth of (non-tail) calls. Each entry holds four pointers.
+ *
+ * Defaults to 0x100.
+ */
+// #define SINTER_FRAME_ENTRIES 0x100
+
+/**
+ * Allow the operand stack and control stack to grow by up to this many
+ * segments, allocated with malloc, each of SINTER_STACK_ENTRIES entries and
+ * SINTER_FRAME_ENTRIES frames. This allows much deeper (non-tail) recursion,
+ * for hosts that have the memory for it.
+ *
+ * Unset by default, i.e. the stacks are only the statically-allocated arrays.
+ */
+// #define SINTER_STACK_SEGMENTS 0x400
+
+/**
+ * Set the size in bytes of the statically-allocated environment stack, which
+ * holds the environments of functions that do not create closures. When it is
+ * full, environments are allocated on the heap instead. There is no
+ * environment stack without SINTER_PREDECODE.
+ *
+ * Defaults to 0x1000.
+ */
+// #define SINTER_ENV_STACK_SIZE 0x1000
+
+/**
+ * Use a compact heap object header, which stores the link to the previous
+ * block as a 32-bit offset into the heap rather than a pointer, and packs a
+ * 17-bit reference count with the type and flags. The header is 12 bytes on
+ * all hosts. Reference counts saturate instead of wrapping around, and an
+ * object whose count saturates is only freed by mark-sweep.
+ *
+ * Off by default.
+ */
+// #define SINTER_COMPACT_HEADER
+
+/**
+ * Align heap objects to 8 bytes, and store heap pointers in NaN-boxes as the
+ * offset divided by 8. This raises the largest heap from 4 MB to 32 MB, at the
+ * cost of up to 4 more bytes of padding per object.
+ *
+ * Off by default.
+ */
+// #define SINTER_SCALED_POINTERS
+
+/**
+ * Set the number of entries of the mark stack used by the garbage collector.
+ * Each entry is a pointer. If the mark stack overflows, the heap is rescanned
+ * instead.
+ *
+ * Defaults to 0x80.
+ */
+// #define SINTER_MARK_STACK_ENTRIES 0x80
+
+/**
+ * Defer freeing objects whose reference count drops to zero, and free at most
+ * this many of them at each allocation.
+ *
+ * This bounds the pause when the last reference to a large structure is
+ * dropped, at the cost of memory being reclaimed later.
+ *
+ * Off by default.
+ */
+// #define SINTER_FREE_BUDGET 4
+
+/**
+ * Sweep the heap lazily after marking: each allocation sweeps at most this
+ * many blocks, stopping as soon as it frees one that fits.
+ *
+ * This bounds the pause of a mark-sweep, at the cost of memory being
+ * reclaimed later.
+ *
+ * Off by default.
+ */
+// #define SINTER_SWEEP_BUDGET 32
+
+/**
+ * Collect garbage cycles by trial deletion, without waiting for the heap to
+ * fill up. Objects that may have become cyclic garbage are buffered as
+ * candidates, and once the buffer is full, this many of them are processed at
+ * each allocation. If 0, the candidates are only processed when an allocation
+ * fails.
+ *
+ * Mark-and-sweep still runs if an allocation fails after that.
+ *
+ * Off by default.
+ */
+// #define SINTER_CYCLE_BUDGET 8
+
+/**
+ * Set the number of candidates buffered by the cycle collector. Each entry is
+ * a pointer.
+ *
+ * Defaults to 0x40.
+ */
+// #define SINTER_CYCLE_ROOTS 0x40
+
+/**
+ * Use threaded dispatch in the interpreter loop.
+ *
+ * Each instruction handler jumps directly to the next instruction's handler,
+ * instead of going through a single switch statement. This requires the labels
+ * as values extension supported by GCC and Clang; it is ignored on other
+ * compilers.
+ *
+ * Off by default here; on by default in the CMake build.
+ */
+// #define SINTER_THREADED_DISPATCH
+
+/**
+ * Decode the program into a word-aligned internal format when it is loaded.
+ *
+ * This avoids unaligned loads of instruction operands in the interpreter loop,
+ * which are slow (or trap) on some microcontrollers. The decoded program is
+ * stored on the heap, and takes up to four times the size of the SVML program.
+ *
+ * Off by default here; on by default in the CMake build, unless
+ * cross-compiling.
+ */
+// #define SINTER_PREDECODE
+
+/**
+ * Keep a map from the decoded program back to SVML addresses, so that debug
+ * output refers to SVML addresses rather than offsets into the decoded
+ * program. The map is as large as the decoded program. This requires
+ * SINTER_PREDECODE and SINTER_DEBUG_LOGLEVEL >= 1; it is ignored otherwise.
+ *
+ * Off by default here; on by default in the CMake build if
+ * SINTER_DEBUG_LOGLEVEL >= 1.
+ */
+// #define SINTER_DECODE_ADDRESS_MAP
+
+/**
+ * Quicken generic arithmetic and comparison instructions based on the types
+ * of operands they see at runtime.
+ *
+ * An instruction that keeps seeing e.g. two integers is rewritten into a
+ * version that only handles two integers, and is rewritten back if it ever
+ * sees anything else. This requires SINTER_PREDECODE; it is ignored otherwise.
+ *
+ * Off by default here; on by default in the CMake build, unless
+ * cross-compiling.
+ */
+// #define SINTER_QUICKEN
+
+/**
+ * Give environments a display: a vector of their ancestors, so that ldp and
+ * stp instructions that reach far up the environment chain load the ancestor
+ * directly instead of following parent pointers.
+ *
+ * Only functions that refer to ancestors at least SIENV_DISPLAY_MIN_DEPTH
+ * levels up get a display, as filling it in costs more than following a short
+ * chain. This requires SINTER_PREDECODE; it is ignored otherwise.
+ *
+ * Off by default.
+ */
+// #define SINTER_ENV_DISPLAY
+
+/**
+ * Verify programs when they are loaded, and run programs that pass without
+ * runtime stack and environment checks.
+ *
+ * The verifier checks stack depths and environment indices ahead of time (see
+ * sinter/verify.h). Programs that do not pass run with the checks as usual.
+ * This compiles a second copy of the interpreter loop, which roughly doubles
+ * its code size. Ignored if SINTER_DISABLE_CHECKS is set.
+ *
+ * Off by default here; on by default in the CMake build.
+ */
+// #define SINTER_VERIFY
+
+/**
+ * Compact the heap when an allocation fails even after a mark-sweep, so that
+ * free space split between live objects can be used.
+ *
+ * Objects that C code may hold on to are found by scanning the native stack
+ * conservatively, which assumes that the stack is one contiguous block, that
+ * setjmp (or __builtin_unwind_init) spills the callee-saved registers onto it,
+ * and that pointers and NaN-boxes on it are 4-byte aligned. This holds for the
+ * usual x86-64, AArch64 and 32-bit ARM (AAPCS) ABIs, but not e.g. for AVR,
+ * whose pointers need not be aligned, or for Xtensa's windowed registers.
+ *
+ * Off by default.
+ */
+// #define SINTER_COMPACT_HEAP
+
+/**
+ * Collect runtime statistics in sinter_stats (see sinter.h).
+ *
+ * Off by default.
+ */
+// #define SINTER_STATS
+
 #endif
@@ -0,0 +1,437 @@
+#include <sinter/config.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <sinter.h>
+
+#include <sinter/aot.h>
+#include <sinter/fault.h>
+#include <sinter/nanbox.h>
+#include <sinter/heap.h>
+#include <sinter/heap_obj.h>
+#include <sinter/internal_fn.h>
+#include <sinter/stack.h>
+#include <sinter/vm.h>
+#include <sinter/debug.h>
+#include <sinter/program.h>
+
+/*
+ * These follow the generic handlers in the main loop in vm.c. Translated code
+ * never needs the return address in a frame, so frames are created with a
+ * NULL return address.
+ */
+
+// The function to run next, set by a tail call to an SVML function
+static const svm_function_t *pending_fn = NULL;
+
+static siaot_fnptr_t find_function(const svm_function_t *fn) {
+  const address_t address = (address_t) ((const unsigned char *) fn - sistate.aot->program);
+  const siaot_function_t *functions = sistate.aot->functions;
+  size_t lo = 0, hi = sistate.aot->function_count;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (functions[mid].address < address) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo == sistate.aot->function_count || functions[lo].address != address) {
+    SIDEBUG("No translated function at address 0x%x\n", (unsigned int) address);
+    sifault(sinter_fault_invalid_program);
+    return NULL;
+  }
+  return functions[lo].fn;
+}
+
+void siaot_run(const svm_function_t *fn) {
+  while (fn) {
+    siaot_fnptr_t impl = find_function(fn);
+    pending_fn = NULL;
+    impl();
+    fn = pending_fn;
+  }
+}
+
+/**
+ * Destroys the current frame, restoring the caller's environment.
+ */
+static inline void destroy_frame(void) {
+  const opcode_t *return_address;
+  sienv_release(sistate.env);
+  sistack_destroy(&return_address, &sistate.env);
+}
+
+static void call_internal_function(const sivmfnptr_t fn, const uint8_t num_args, const bool is_tailcall, const bool pop_fn) {
+  // check that there are enough items on the stack
+  if (num_args > 0) {
+    sistack_peek(num_args - 1);
+  }
+
+  sinanbox_t retv = fn(num_args, sistack_top - num_args);
+
+  for (unsigned int i = 0; i < num_args; ++i) {
+    siheap_derefbox(sistack_pop());
+  }
+
+  if (pop_fn) {
+    siheap_derefbox(sistack_pop());
+  }
+
+  if (is_tailcall) {
+    destroy_frame();
+  }
+
+  sistack_push(retv);
+}
+
+static sivmfnptr_t get_internal_function(const uint8_t id, const bool is_primitive) {
+  if ((is_primitive && id >= SIVMFN_PRIMITIVE_COUNT) || (!is_primitive && id >= sivmfn_vminternal_count)) {
+    SIDEBUG("Invalid %s function index %d\n", is_primitive ? "primitive" : "VM-internal", id);
+    sifault(sinter_fault_invalid_program);
+    return NULL;
+  }
+
+  return (is_primitive ? sivmfn_primitives : sivmfn_vminternals)[id];
+}
+
+void siaot_call(uint8_t num_args, bool is_tailcall) {
+  sinanbox_t fn_ptr = sistack_peek(num_args);
+
+  if (NANBOX_ISIFN(fn_ptr)) {
+    const sivmfnptr_t fn = get_internal_function(NANBOX_IFN_NUMBER(fn_ptr), NANBOX_IFN_TYPE(fn_ptr) == 0);
+    call_internal_function(fn, num_args, is_tailcall, true);
+    return;
+  }
+
+  if (!NANBOX_ISPTR(fn_ptr)) {
+    sifault(sinter_fault_type);
+    return;
+  }
+
+  siheap_header_t *obj = SIHEAP_NANBOXTOPTR(fn_ptr);
+  if (obj->type == sitype_function) {
+    siheap_function_t *fn_obj = (siheap_function_t *) obj;
+    const svm_function_t *fn_code = fn_obj->code;
+
+    if (num_args != fn_code->num_args) {
+      sifault(sinter_fault_function_arity);
+      return;
+    }
+
+    if (fn_code->num_args > fn_code->env_size) {
+      sifault(sinter_fault_invalid_load);
+      return;
+    }
+
+    siheap_env_t *new_env = sienv_new(fn_obj->env, fn_code->env_size);
+
+    sistack_top -= fn_code->num_args;
+#ifndef SINTER_DISABLE_CHECKS
+    if (sistack_top < sistack_bottom) {
+      sifault(sinter_fault_stack_underflow);
+      return;
+    }
+#endif
+    memcpy(new_env->entry, sistack_top, fn_code->num_args*sizeof(sinanbox_t));
+
+    // pop the function off the caller's stack
+    siheap_derefbox(sistack_pop());
+
+    if (is_tailcall) {
+      destroy_frame();
+    }
+
+    siheap_env_t *const return_env = sistate.env;
+    sistate.env = new_env;
+    sistack_new(fn_code->stack_size, NULL, return_env);
+
+    if (is_tailcall) {
+      // run by siaot_run once the caller returns
+      pending_fn = fn_code;
+    } else {
+      siaot_run(fn_code);
+    }
+  } else if (obj->type == sitype_intcont) {
+    siheap_intcont_t *fn_obj = (siheap_intcont_t *) obj;
+
+    // continuations are zero-arity
+    if (num_args) {
+      sifault(sinter_fault_function_arity);
+      return;
+    }
+
+    sinanbox_t retv = fn_obj->fn(fn_obj->argc, fn_obj->argv);
+    siheap_derefbox(sistack_pop());
+
+    if (is_tailcall) {
+      destroy_frame();
+    }
+
+    sistack_push(retv);
+  } else {
+    sifault(sinter_fault_type);
+  }
+}
+
+void siaot_call_internal(uint8_t id, uint8_t num_args, bool is_primitive, bool is_tailcall) {
+  call_internal_function(get_internal_function(id, is_primitive), num_args, is_tailcall, false);
+}
+
+void siaot_ret_value(sinanbox_t v) {
+  destroy_frame();
+  sistack_push(v);
+}
+
+void siaot_lgc_s(address_t address) {
+  const svm_constant_t *string = (const svm_constant_t *) (sistate.program + address);
+  siheap_strconst_t *obj = sistrconst_new(string);
+  sistack_push(SIHEAP_PTRTONANBOX(obj));
+}
+
+void siaot_new_c(address_t address) {
+  const svm_function_t *fn_code = (const svm_function_t *) (sistate.program + address);
+  siheap_function_t *fn_obj = sifunction_new(fn_code, sistate.env);
+  sistack_push(SIHEAP_PTRTONANBOX(fn_obj));
+}
+
+void siaot_new_a(void) {
+  siheap_array_t *array = siarray_new(8);
+  sistack_push(SIHEAP_PTRTONANBOX(array));
+}
+
+void siaot_newenv(uint8_t entry_count) {
+  siheap_env_t *new_env = sienv_cache_take(sistate.env, entry_count, 0);
+  if (new_env) {
+    SISTATS_INC(env_cache_hits);
+  } else {
+    SISTATS_INC(env_cache_misses);
+    new_env = sienv_new(sistate.env, entry_count);
+    siheap_deref(sistate.env);
+  }
+  sistate.env = new_env;
+}
+
+void siaot_popenv(void) {
+  siheap_env_t *old_env = sistate.env;
+  sistate.env = old_env->parent;
+  if (!sienv_cache_put(old_env)) {
+    siheap_ref(sistate.env);
+    siheap_deref(old_env);
+  }
+}
+
+static void pop_array_args(siheap_header_t **array, address_t *index) {
+  sinanbox_t indexv = sistack_pop();
+  sinanbox_t arrayv = sistack_pop();
+  *array = SIHEAP_NANBOXTOPTR(arrayv);
+
+  if (!NANBOX_ISPTR(arrayv) || !siheap_isarray(*array)) {
+    sifault(sinter_fault_type);
+    return;
+  }
+
+  if (NANBOX_ISINT(indexv)) {
+    int32_t t = NANBOX_INT(indexv);
+    if (t < 0) {
+      sifault(sinter_fault_invalid_load);
+      return;
+    }
+    *index = (address_t) t;
+  } else if (NANBOX_ISFLOAT(indexv)) {
+    float t = (address_t) NANBOX_FLOAT(indexv);
+    if (t < 0) {
+      sifault(sinter_fault_invalid_load);
+      return;
+    }
+    *index = (address_t) t;
+  }
+}
+
+void siaot_lda(void) {
+  siheap_header_t *array = NULL;
+  address_t index = 0;
+  pop_array_args(&array, &index);
+
+  sinanbox_t loadv = siarray_load(array, index);
+  siheap_refbox(loadv);
+  siheap_deref(array);
+
+  sistack_push(loadv);
+}
+
+void siaot_sta(void) {
+  sinanbox_t storev = sistack_pop();
+  siheap_header_t *array = NULL;
+  address_t index = 0;
+  pop_array_args(&array, &index);
+
+  siarray_store(array, index, storev);
+  siheap_deref(array);
+}
+
+static inline bool is_string(sinanbox_t v) {
+  return NANBOX_ISPTR(v) && siheap_is_string(SIHEAP_NANBOXTOPTR(v));
+}
+
+// Converts a value known to be a number to a float
+#define NUMERIC_TOFLOAT(v) (NANBOX_ISINT(v) ? (float) NANBOX_INT(v) : NANBOX_FLOAT(v))
+
+// Binary operation on two numbers, as in NUMERIC_OP in vm.c
+#define NUMERIC_OP(int_expr, float_expr) do { \
+  sinanbox_t v1 = sistack_pop(); \
+  sinanbox_t v0 = sistack_pop(); \
+  sinanbox_t r; \
+  if (NANBOX_ISBOTHINT(v0, v1)) { \
+    const int32_t a = NANBOX_INT(v0); \
+    const int32_t b = NANBOX_INT(v1); \
+    r = (int_expr); \
+  } else { \
+    if (!NANBOX_ISNUMERIC(v0) || !NANBOX_ISNUMERIC(v1)) { \
+      sifault(sinter_fault_type); \
+      return; \
+    } \
+    const float a = NUMERIC_TOFLOAT(v0); \
+    const float b = NUMERIC_TOFLOAT(v1); \
+    r = (float_expr); \
+  } \
+  sistack_push(r); \
+} while (0)
+
+void siaot_add_g(void) {
+  sinanbox_t v1 = sistack_pop();
+  sinanbox_t v0 = sistack_pop();
+  sinanbox_t r;
+
+  if (NANBOX_ISBOTHINT(v0, v1)) {
+    r = NANBOX_WRAP_INT(NANBOX_INT(v0) + NANBOX_INT(v1));
+  } else if (NANBOX_ISNUMERIC(v0) && NANBOX_ISNUMERIC(v1)) {
+    r = NANBOX_OFFLOAT(NUMERIC_TOFLOAT(v0) + NUMERIC_TOFLOAT(v1));
+  } else if (is_string(v0) && is_string(v1)) {
+    siheap_header_t *hv0 = SIHEAP_NANBOXTOPTR(v0);
+    siheap_header_t *hv1 = SIHEAP_NANBOXTOPTR(v1);
+    if (hv0->type == sitype_strconst && *(((siheap_strconst_t *) hv0)->string->data) == '\0') {
+      siheap_ref(hv1);
+      r = v1;
+    } else if (hv1->type == sitype_strconst && *(((siheap_strconst_t *) hv1)->string->data) == '\0') {
+      siheap_ref(hv0);
+      r = v0;
+    } else {
+      r = SIHEAP_PTRTONANBOX(sistrpair_new(hv0, hv1));
+    }
+  } else {
+    SIDEBUG("Invalid operands to add.\n");
+    sifault(sinter_fault_type);
+    return;
+  }
+
+  sistack_push(r);
+  siheap_derefbox(v0);
+  siheap_derefbox(v1);
+}
+
+void siaot_add_f(void) {
+  NUMERIC_OP(NANBOX_WRAP_INT(a + b), NANBOX_OFFLOAT(a + b));
+}
+
+void siaot_sub(void) {
+  NUMERIC_OP(NANBOX_WRAP_INT(a - b), NANBOX_OFFLOAT(a - b));
+}
+
+void siaot_mul(void) {
+  NUMERIC_OP(NANBOX_WRAP_INT((int64_t) a * b), NANBOX_OFFLOAT(a * b));
+}
+
+void siaot_div(void) {
+  NUMERIC_OP(NANBOX_OFFLOAT((float) a / b), NANBOX_OFFLOAT(a / b));
+}
+
+static inline sinanbox_t int_mod(int32_t a, int32_t b) {
+  if (b == 0) {
+    return NANBOX_CANONICAL_NAN;
+  }
+  const int32_t r = a % b;
+  if (r == 0 && a < 0) {
+    return NANBOX_OFFLOAT(-0.0f);
+  }
+  return NANBOX_OFINT(r);
+}
+
+void siaot_mod(void) {
+  NUMERIC_OP(int_mod(a, b), NANBOX_OFFLOAT(fmodf(a, b)));
+}
+
+void siaot_neg(void) {
+  sinanbox_t v = sistack_pop();
+  if (NANBOX_ISINT(v)) {
+    sistack_push(NANBOX_WRAP_INT(-NANBOX_INT(v)));
+  } else if (NANBOX_ISFLOAT(v)) {
+    sistack_push(NANBOX_OFFLOAT(-NANBOX_FLOAT(v)));
+  } else {
+    sifault(sinter_fault_type);
+  }
+}
+
+void siaot_not(void) {
+  sinanbox_t v = sistack_pop();
+  if (!NANBOX_ISBOOL(v)) {
+    sifault(sinter_fault_type);
+    return;
+  }
+  sistack_push(NANBOX_OFBOOL(!NANBOX_BOOL(v)));
+}
+
+// Comparison of two numbers or two strings, as in COMPARE_POP in vm.c
+#define COMPARISON_OP_G(name, op) \
+  void name(void) { \
+    sinanbox_t v1 = sistack_pop(); \
+    sinanbox_t v0 = sistack_pop(); \
+    bool r = false; \
+    if (NANBOX_ISBOTHINT(v0, v1)) { \
+      r = NANBOX_INT(v0) op NANBOX_INT(v1); \
+    } else if (NANBOX_ISNUMERIC(v0) && NANBOX_ISNUMERIC(v1)) { \
+      r = NUMERIC_TOFLOAT(v0) op NUMERIC_TOFLOAT(v1); \
+    } else if (is_string(v0) && is_string(v1)) { \
+      r = strcmp(sistrobj_tocharptr(SIHEAP_NANBOXTOPTR(v0)), sistrobj_tocharptr(SIHEAP_NANBOXTOPTR(v1))) op 0; \
+    } else { \
+      SIDEBUG("Invalid operands to comparison.\n"); \
+      sifault(sinter_fault_type); \
+      return; \
+    } \
+    siheap_derefbox(v0); \
+    siheap_derefbox(v1); \
+    sistack_push(NANBOX_OFBOOL(r)); \
+  }
+
+// Comparison of two numbers; anything else is a type error
+#define COMPARISON_OP_F(name, op) \
+  void name(void) { \
+    NUMERIC_OP(NANBOX_OFBOOL(a op b), NANBOX_OFBOOL(a op b)); \
+  }
+
+COMPARISON_OP_G(siaot_lt_g, <)
+COMPARISON_OP_G(siaot_gt_g, >)
+COMPARISON_OP_G(siaot_le_g, <=)
+COMPARISON_OP_G(siaot_ge_g, >=)
+COMPARISON_OP_F(siaot_lt_f, <)
+COMPARISON_OP_F(siaot_gt_f, >)
+COMPARISON_OP_F(siaot_le_f, <=)
+COMPARISON_OP_F(siaot_ge_f, >=)
+
+void siaot_eq(bool negate) {
+  sinanbox_t v0 = sistack_pop();
+  sinanbox_t v1 = sistack_pop();
+  bool r;
+  if (NANBOX_ISBOTHINT(v0, v1) || (NANBOX_ISBOOL(v0) && NANBOX_ISBOOL(v1))) {
+    r = NANBOX_IDENTICAL(v0, v1);
+  } else {
+    r = sivm_equal(v1, v0);
+  }
+
+  sistack_push(NANBOX_OFBOOL(r != negate));
+  siheap_derefbox(v0);
+  siheap_derefbox(v1);
+}
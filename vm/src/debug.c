@@ -129,10 +129,44 @@ const char *get_opcode_name(opcode_t op) {
     "neg_f",
     "neq_g",
     "neq_f",
-    "neq_b"
+    "neq_b",
+#ifdef SINTER_PREDECODE
+    "ldc_nanbox",
+    "fused_ldl_ldl",
+    "fused_ldl_ldc",
+    "fused_add_i",
+    "fused_sub_i",
+    "fused_lt_br_f",
+    "fused_gt_br_f",
+    "fused_le_br_f",
+    "fused_ge_br_f",
+#endif
+#ifdef SINTER_QUICKEN
+    "quick_add_ii",
+    "quick_add_ff",
+    "quick_add_strstr",
+    "quick_sub_ii",
+    "quick_sub_ff",
+    "quick_lt_ii",
+    "quick_lt_ff",
+    "quick_gt_ii",
+    "quick_gt_ff",
+    "quick_le_ii",
+    "quick_le_ff",
+    "quick_ge_ii",
+    "quick_ge_ff",
+    "quick_lt_br_f_ii",
+    "quick_lt_br_f_ff",
+    "quick_gt_br_f_ii",
+    "quick_gt_br_f_ff",
+    "quick_le_br_f_ii",
+    "quick_le_br_f_ff",
+    "quick_ge_br_f_ii",
+    "quick_ge_br_f_ff",
+#endif
   };
 
-  if (op > op_neq_b) {
+  if (op >= sizeof(opcode_names)/sizeof(*opcode_names)) {
     return "invalid_opcode";
   } else {
     return opcode_names[op];
@@ -147,17 +181,10 @@ void debug_heap_obj(const siheap_header_t *o) {
     SIDEBUG("environment with %d entries; parent at %p", env->entry_count, (void *) env->parent);
     break;
   }
-  case sitype_frame: {
-    const siheap_frame_t *fr = (const siheap_frame_t *) o;
-    SIDEBUG("frame; return address %tx, stack bottom %p, limit %p, top %p, saved environment %p",
-      fr->return_address ? (fr->return_address - sistate.program) : 0,
-      (void *) fr->saved_stack_bottom, (void *) fr->saved_stack_limit, (void *) fr->saved_stack_top, (void *) fr->saved_env);
-    break;
-  }
   case sitype_function: {
     const siheap_function_t *f = (const siheap_function_t *) o;
     SIDEBUG("function; code address %tx, environment %p",
-      (const opcode_t *) f->code - sistate.program, (void *) f->env);
+      SISTATE_PCTOADDR((const opcode_t *) f->code), (void *) f->env);
     break;
   }
   case sitype_strpair: {
@@ -177,14 +204,21 @@ void debug_heap_obj(const siheap_header_t *o) {
   }
   case sitype_array: {
     const siheap_array_t *a = (const siheap_array_t *) o;
-    SIDEBUG("array; address %p; data address %p; count %d; allocated %d", (void *) a, (void *) a->data, a->count, a->alloc_size);
+    SIDEBUG("array; address %p; data address %p%s; count %d; allocated %d", (void *) a,
+      a->data ? (const void *) a->data : (const void *) (a + 1), a->data ? "" : " (inline)", a->count, a->alloc_size);
     break;
   }
+  case sitype_pair:
+    SIDEBUG("pair; address %p", (void *) o);
+    break;
   case sitype_intcont: {
     const siheap_intcont_t *c = (const siheap_intcont_t *) o;
     SIDEBUG("function (internal continuation); argc %d", c->argc);
     break;
   }
+  case sitype_code:
+    SIDEBUG("decoded program; size %"PRIu32, (uint32_t) (o->size - sizeof(siheap_code_t)));
+    break;
   case sitype_array_data:
   case sitype_empty:
   case sitype_free:
@@ -15,16 +15,33 @@ static void debug_memorycheck_walk_do_object_1(siheap_header_t *obj) {
   assert(SIHEAP_INRANGE(siheap_next(obj)) || ((unsigned char *) obj) + obj->size == siheap + SINTER_HEAP_SIZE);
   // this object doesn't start before the heap starts
   assert(((unsigned char *) obj) >= siheap);
+  assert(!((size_t) (((unsigned char *) obj) - siheap) & (SIHEAP_ALIGN - 1)));
   // this object ends before the heap ends
   assert(((unsigned char *) obj) + obj->size <= siheap + SINTER_HEAP_SIZE);
   // the next object's prev pointer is correct
-  assert(!SIHEAP_INRANGE(siheap_next(obj)) || siheap_next(obj)->prev_node == obj);
+  assert(!SIHEAP_INRANGE(siheap_next(obj)) || siheap_prev(siheap_next(obj)) == obj);
 
   // reset the debug refcount
   obj->debug_refcount = 0;
 }
 
-static void debug_memorycheck_walk_check_nanboxes(sinanbox_t *arr, const size_t count, bool is_stack) {
+/**
+ * Check that an environment fits in its block, and that its display (if any)
+ * matches its parent chain.
+ */
+static void debug_memorycheck_check_display(siheap_env_t *env) {
+#ifdef SINTER_ENV_DISPLAY
+  assert(env->display_count <= SIENV_DISPLAY_MAX);
+  assert(SIENV_DISPLAY_SIZE(env->entry_count, env->display_count) <= env->header.size);
+  for (uint8_t i = 0; i < env->display_count; ++i) {
+    assert(sienv_display(env)[i] == sienv_getparent(env, i + 2u));
+  }
+#else
+  assert(SIENV_SIZE(env->entry_count) <= env->header.size);
+#endif
+}
+
+static void debug_memorycheck_walk_check_nanboxes(sinanbox_t *arr, const size_t count) {
   for (size_t i = 0; i < count; ++i) {
     sinanbox_t v = arr[i];
     if (!NANBOX_ISPTR(v)) {
@@ -42,6 +59,7 @@ static void debug_memorycheck_walk_check_nanboxes(sinanbox_t *arr, const size_t
       case sitype_free:
       case sitype_empty:
       case sitype_env:
+      case sitype_code:
       // string caches the result of flattening a strpair, it should never be
       // referred to in a nanbox
       case sitype_string:
@@ -51,14 +69,11 @@ static void debug_memorycheck_walk_check_nanboxes(sinanbox_t *arr, const size_t
         break;
       case sitype_function:
       case sitype_array:
+      case sitype_pair:
       case sitype_strconst:
       case sitype_strpair:
       case sitype_intcont:
         break;
-      case sitype_frame:
-        // the stack has nanboxes referring to frames (fn return information)
-        assert(is_stack);
-        break;
     }
   }
 }
@@ -68,22 +83,35 @@ static void debug_memorycheck_walk_check_nanboxes(sinanbox_t *arr, const size_t
  */
 static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
   assert(!obj->flag_displayed);
+#ifdef SINTER_SWEEP_BUDGET
+  // objects stay marked until the sweep ends, and free blocks are never swept
+  assert(!siheap_ismarked(obj) || siheap_sweep_cursor || obj->type == sitype_free);
+  // only an object that the lazy sweep left behind with a stuck count
+  assert(!obj->flag_destroying || siheap_refcount_stuck(obj));
+#else
   assert(!obj->flag_marked);
   assert(!obj->flag_destroying);
+#endif
+  assert(!obj->flag_gray && !obj->flag_white && !obj->flag_pending);
   switch (obj->type) {
   case sitype_array: {
     siheap_array_t *c = (siheap_array_t *) obj;
 
-    assert(c->data->header.type == sitype_array_data);
-
     // check that the size of the allocated array data and the allocated count in the array object tally
     // note: >= because the heap allocator could over-allocate (in case it decides not to split the block)
-    assert(c->data->header.size >= sizeof(siheap_array_data_t) + c->alloc_size*sizeof(sinanbox_t));
+    if (c->data) {
+      assert(c->data->header.type == sitype_array_data);
+      assert(c->data->header.size >= sizeof(siheap_array_data_t) + c->alloc_size*sizeof(sinanbox_t));
+
+      // increase refcount of referent
+      c->data->header.debug_refcount++;
+    } else {
+      assert(c->alloc_size <= SIARRAY_INLINE_MAX);
+      assert(c->header.size >= sizeof(siheap_array_t) + c->alloc_size*sizeof(sinanbox_t));
+    }
 
-    // increase refcount of referent
-    c->data->header.debug_refcount++;
     // increase refcount of data referents
-    debug_memorycheck_walk_check_nanboxes(c->data->data, c->count, false);
+    debug_memorycheck_walk_check_nanboxes(siarray_data(c), c->count);
     break;
   }
 
@@ -92,6 +120,17 @@ static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
     break;
   }
 
+  case sitype_pair: {
+    siheap_pair_t *c = (siheap_pair_t *) obj;
+
+    // check that the pair can be converted into an array in place
+    assert(c->header.size >= SIPAIR_SIZE);
+
+    // increase refcount of data referents
+    debug_memorycheck_walk_check_nanboxes(c->data, 2);
+    break;
+  }
+
   case sitype_intcont: {
     siheap_intcont_t *c = (siheap_intcont_t *) obj;
 
@@ -102,7 +141,7 @@ static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
     assert(c->header.size >= sizeof(siheap_intcont_t) + c->argc*sizeof(sinanbox_t));
 
     // increase refcount of data referents
-    debug_memorycheck_walk_check_nanboxes(c->argv, c->argc, false);
+    debug_memorycheck_walk_check_nanboxes(c->argv, c->argc);
     break;
   }
 
@@ -119,34 +158,13 @@ static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
     // note: <= because the heap allocator could over-allocate (in case it decides not to split the block)
     assert(sizeof(siheap_env_t) + c->entry_count*sizeof(sinanbox_t) <= c->header.size);
     assert(!c->parent || SIHEAP_INRANGE(c->parent));
+    debug_memorycheck_check_display(c);
 
     if (c->parent) {
       c->parent->header.debug_refcount++;
     }
     // increase refcount of env referents
-    debug_memorycheck_walk_check_nanboxes(c->entry, c->entry_count, false);
-    break;
-  }
-
-  case sitype_frame: {
-    siheap_frame_t *c = (siheap_frame_t *) obj;
-
-    // check that the saved env is in the heap
-    assert(!c->saved_env || SIHEAP_INRANGE(c->saved_env));
-
-    // check that the saved stack top <= the saved stack limit
-    assert(c->saved_stack_top <= c->saved_stack_limit);
-    // check that the saved stack bottom <= the saved stack top
-    assert(c->saved_stack_bottom <= c->saved_stack_top);
-
-    // check that the saved stack bottom is in the stack
-    assert(c->saved_stack_bottom >= sistack && c->saved_stack_bottom <= sistack + SINTER_STACK_ENTRIES);
-    // check that the saved stack limit is in the stack
-    assert(c->saved_stack_limit >= sistack && c->saved_stack_limit <= sistack + SINTER_STACK_ENTRIES);
-
-    if (c->saved_env) {
-      c->saved_env->header.debug_refcount++;
-    }
+    debug_memorycheck_walk_check_nanboxes(c->entry, c->entry_count);
     break;
   }
 
@@ -156,16 +174,28 @@ static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
     assert(c->header.refcount == 0);
 
     // check that the freelist pointers are correct
+    const unsigned int size_class = siheap_size_class(c->header.size);
     assert(c->next_free == NULL || c->next_free->prev_free == c);
-    assert((c->prev_free == NULL && siheap_first_free == c) || (c->prev_free && c->prev_free->next_free == c));
+    assert((c->prev_free == NULL && siheap_free_lists[size_class] == c) || (c->prev_free && c->prev_free->next_free == c));
+
+    // check that the block is in the right free list
+    assert(c->next_free == NULL || siheap_size_class(c->next_free->header.size) == size_class);
+    assert((size_class < SIHEAP_SMALL_CLASSES ? siheap_free_small_map : siheap_free_large_map)
+      & ((uint32_t) 1 << (size_class % SIHEAP_SMALL_CLASSES)));
     break;
   }
 
   case sitype_function: {
     siheap_function_t *c = (siheap_function_t *) obj;
+#ifdef SINTER_SWEEP_BUDGET
+    if (!c->env) {
+      // destroyed by the lazy sweep, but still referred to by dead objects
+      break;
+    }
+#endif
 
-    // check that the code is in the program binary
-    assert((const opcode_t *) c->code >= sistate.program && (const opcode_t *) c->code < sistate.program_end);
+    // check that the code is in the program binary (or the decoded program)
+    assert((const opcode_t *) c->code >= SISTATE_CODE && (const opcode_t *) c->code < SISTATE_CODE_END);
 
     // check that the environment is in the heap
     assert(SIHEAP_INRANGE(c->env));
@@ -197,6 +227,13 @@ static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
 
   case sitype_strpair: {
     siheap_strpair_t *c = (siheap_strpair_t *) obj;
+#ifdef SINTER_SWEEP_BUDGET
+    if (!c->left) {
+      // destroyed by the lazy sweep, but still referred to by dead objects
+      assert(!c->right);
+      break;
+    }
+#endif
 
     // check that the left pointer exists
     assert(SIHEAP_INRANGE(c->left));
@@ -220,6 +257,17 @@ static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
 
   }
 
+  case sitype_code: {
+    const siheap_code_t *c = (const siheap_code_t *) obj;
+
+    // check that this is the current program
+    assert(SISTATE_CODE == (const opcode_t *) c->code);
+
+    // increase refcount of the string constants
+    debug_memorycheck_walk_check_nanboxes(c->strings, c->string_count);
+    break;
+  }
+
   default:
     assert(false);
     break;
@@ -231,9 +279,31 @@ static void debug_memorycheck_walk_do_object_2(const siheap_header_t *obj) {
 }
 
 static void debug_memorycheck_walk_do_object_3(const siheap_header_t *obj) {
+  if (siheap_refcount_stuck(obj)) {
+    // the count is no longer exact
+    return;
+  }
   assert(obj->refcount == obj->debug_refcount + obj->internal_refcount);
 }
 
+/**
+ * Checks a reference to an environment, which may be on the environment stack,
+ * and counts it if it is on the heap.
+ */
+static void debug_memorycheck_walk_check_env(siheap_env_t *env) {
+  if (!env) {
+    return;
+  }
+#ifdef SINTER_PREDECODE
+  if (sienv_onstack(env)) {
+    assert((unsigned char *) env < sienvstack_top && env->header.type == sitype_env);
+    return;
+  }
+#endif
+  assert(SIHEAP_INRANGE(env) && env->header.type == sitype_env);
+  env->header.debug_refcount++;
+}
+
 #define WALK_HEAP(fn) do { \
   siheap_header_t *obj = (siheap_header_t *) siheap; \
   while (SIHEAP_INRANGE(obj)) { \
@@ -245,9 +315,56 @@ static void debug_memorycheck_walk_do_object_3(const siheap_header_t *obj) {
 void debug_memorycheck(void) {
   WALK_HEAP(debug_memorycheck_walk_do_object_1);
 
-  // walk the stack
-  debug_memorycheck_walk_check_nanboxes(sistack, sistack_top - sistack, true);
-  sistate.env->header.debug_refcount++;
+  debug_memorycheck_walk_check_env(sistate.env);
+  assert(sistack_segment->stack <= sistack_top && sistack_top <= sistack_segment->stack_end);
+
+  for (const sistack_segment_t *segment = sistack_segment; segment; segment = segment->below) {
+    assert(segment->below ? segment->below->above == segment : segment == &sistack_bottom_segment);
+
+    // walk the stack
+    debug_memorycheck_walk_check_nanboxes(segment->stack, sistack_segment_top(segment) - segment->stack);
+
+    // walk the control stack
+    for (siframe_t *frame = segment->frames; frame < siframes_segment_top(segment); ++frame) {
+      // the first frame of a segment saves the caller's stack, in the segment below
+      const sistack_segment_t *const caller = frame == segment->frames && segment->below ? segment->below : segment;
+
+      // check that the saved stack bottom <= the saved stack limit
+      assert(frame->saved_stack_bottom <= frame->saved_stack_limit);
+      // check that the saved stack bottom and limit are in the stack
+      assert(frame->saved_stack_bottom >= caller->stack && frame->saved_stack_limit <= caller->stack_end);
+
+      debug_memorycheck_walk_check_env(frame->saved_env);
+    }
+  }
+
+  // walk the environment cache
+  for (size_t i = 0; i < SIENV_CACHE_SIZES; ++i) {
+    siheap_env_t *const env = sienv_cache[i];
+    if (env) {
+      assert(env->entry_count == i && !env->parent);
+      debug_memorycheck_walk_check_env(env);
+    }
+  }
+
+#ifdef SINTER_PREDECODE
+  // walk the environment stack
+  assert(sienvstack_top >= sienvstack && sienvstack_top <= sienvstack + SINTER_ENV_STACK_SIZE);
+  for (unsigned char *at = sienvstack; at < sienvstack_top; at += ((siheap_header_t *) at)->size) {
+    siheap_env_t *const env = (siheap_env_t *) at;
+    assert(env->header.size && at + env->header.size <= sienvstack_top);
+    if (env->header.type == sitype_free) {
+      // promoted to the heap
+      continue;
+    }
+    assert(env->header.type == sitype_env);
+    debug_memorycheck_check_display(env);
+    debug_memorycheck_walk_check_nanboxes(env->entry, env->entry_count);
+    // a parent on the environment stack is always below its child
+    assert(!sienv_onstack(env->parent) || (unsigned char *) env->parent < at);
+    debug_memorycheck_walk_check_env(env->parent);
+  }
+#endif
 
   WALK_HEAP(debug_memorycheck_walk_do_object_2);
   WALK_HEAP(debug_memorycheck_walk_do_object_3);
@@ -287,13 +404,19 @@ static void debug_memorycheck_search_do_nanboxes(const sinanbox_t *arr, const si
 static void debug_memorycheck_search_do_object(const siheap_header_t *needle, const siheap_header_t *obj) {
   switch (obj->type) {
   case sitype_array: {
-    const siheap_array_t *c = (const siheap_array_t *) obj;
-    if (&c->data->header == needle) {
+    siheap_array_t *c = (siheap_array_t *) obj;
+    if (c->data && &c->data->header == needle) {
       SIDEBUG("Array data of ");
       SIDEBUG_HEAPOBJ(obj);
       SIDEBUG("\n");
     }
-    debug_memorycheck_search_do_nanboxes(c->data->data, c->count, needle, obj);
+    debug_memorycheck_search_do_nanboxes(siarray_data(c), c->count, needle, obj);
+    break;
+  }
+
+  case sitype_pair: {
+    const siheap_pair_t *c = (const siheap_pair_t *) obj;
+    debug_memorycheck_search_do_nanboxes(c->data, 2, needle, obj);
     break;
   }
 
@@ -316,18 +439,6 @@ static void debug_memorycheck_search_do_object(const siheap_header_t *needle, co
     break;
   }
 
-  case sitype_frame: {
-    const siheap_frame_t *c = (const siheap_frame_t *) obj;
-
-    if ((const siheap_header_t *) c->saved_env == needle) {
-      SIDEBUG("Saved env. of ");
-      SIDEBUG_HEAPOBJ(obj);
-      SIDEBUG("\n");
-    }
-
-    break;
-  }
-
   case sitype_function: {
     const siheap_function_t *c = (const siheap_function_t *) obj;
 
@@ -362,6 +473,7 @@ static void debug_memorycheck_search_do_object(const siheap_header_t *needle, co
   case sitype_free:
   case sitype_strconst:
   case sitype_string:
+  case sitype_code:
   default:
     break;
   }
@@ -374,7 +486,31 @@ void debug_memorycheck_search(const siheap_header_t *needle) {
   if (&sistate.env->header == needle) {
     SIDEBUG("Current environment\n");
   }
-  debug_memorycheck_search_do_nanboxes(sistack, sistack_top - sistack, needle, NULL);
+  for (const sistack_segment_t *segment = sistack_segment; segment; segment = segment->below) {
+    debug_memorycheck_search_do_nanboxes(segment->stack, sistack_segment_top(segment) - segment->stack, needle, NULL);
+    for (const siframe_t *frame = segment->frames; frame < siframes_segment_top(segment); ++frame) {
+      if ((const siheap_header_t *) frame->saved_env == needle) {
+        SIDEBUG("Saved env. of frame %td of segment %p\n", frame - segment->frames, (const void *) segment);
+      }
+    }
+  }
+  for (size_t i = 0; i < SIENV_CACHE_SIZES; ++i) {
+    if ((const siheap_header_t *) sienv_cache[i] == needle) {
+      SIDEBUG("Environment cache entry %zu\n", i);
+    }
+  }
+#ifdef SINTER_PREDECODE
+  for (unsigned char *at = sienvstack; at < sienvstack_top; at += ((siheap_header_t *) at)->size) {
+    const siheap_env_t *const env = (const siheap_env_t *) at;
+    if (env->header.type != sitype_env) {
+      continue;
+    }
+    if ((const siheap_header_t *) env->parent == needle) {
+      SIDEBUG("Parent of environment 0x%tx on the environment stack\n", at - sienvstack);
+    }
+    debug_memorycheck_search_do_nanboxes(env->entry, env->entry_count, needle, NULL);
+  }
+#endif
 
   siheap_header_t *obj = (siheap_header_t *) siheap;
   while (SIHEAP_INRANGE(obj)) {
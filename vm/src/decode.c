@@ -0,0 +1,741 @@
+#include <sinter/config.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sinter/opcode.h>
+#include <sinter/program.h>
+#include <sinter/decode.h>
+#include <sinter/fault.h>
+#include <sinter/heap.h>
+#include <sinter/heap_obj.h>
+#include <sinter/vm.h>
+#include <sinter/debug.h>
+
+#ifdef SINTER_PREDECODE
+/*
+ * Decoding is done in three passes over the SVML program:
+ *
+ * 1. Find all reachable instructions and functions, by following control flow
+ *    from the entry point. These are recorded in bitmaps indexed by SVML
+ *    address, along with all branch targets.
+ * 2. Lay out the decoded program, and pick the sequences to fuse. This records
+ *    the decoded offset of the start of every 32-byte chunk of the SVML
+ *    program, so that the decoded offset of any instruction can be found by
+ *    scanning at most one chunk.
+ * 3. Emit the decoded program, relocating branches and addresses, and
+ *    computing the NaN-box of every constant load. The string constant objects
+ *    are allocated right after the decoded program, which is where the first
+ *    free block starts at this point. A hash table keyed on the constant's
+ *    address finds the object of a constant that was already loaded.
+ *
+ * The bitmaps and the chunk table are placed at the top of the heap, which is
+ * empty at this point, and the hash table right below them once pass 1 has
+ * counted the string loads. The decoded program is allocated at the bottom of
+ * the heap, after checking that it does not overlap the scratch area.
+ */
+
+#define CHUNK_SHIFT 5
+
+#define BITMAP_GET(map, addr) ((map)[(addr) >> 3] & (1u << ((addr) & 7)))
+#define BITMAP_SET(map, addr) ((map)[(addr) >> 3] |= (1u << ((addr) & 7)))
+#define BITMAP_CLEAR(map, addr) ((map)[(addr) >> 3] &= ~(1u << ((addr) & 7)))
+
+static const opcode_t *program;
+static address_t program_size;
+// SVML addresses of reachable instructions
+// After pass 2, instructions that were fused into the preceding instruction are removed
+static uint8_t *instrs;
+// SVML addresses of reachable instructions that have not been followed yet
+static uint8_t *pending;
+// SVML addresses of reachable function headers
+static uint8_t *functions;
+// SVML addresses that are reached other than by falling through
+static uint8_t *targets;
+// SVML addresses of function headers whose environment may be captured
+// This reuses the space of pending, which is empty after pass 1
+static uint8_t *escaping;
+// decoded offset of each 32-byte chunk of the SVML program
+static address_t *chunk_offsets;
+// whether anything was added to pending in this pass
+static bool pending_added;
+// the number of reachable lgc_s instructions
+static address_t string_sites;
+// open-addressed hash table from string constant address to 1 + the index of
+// its object in code_obj->strings, or 0 if the slot is empty
+static address_t *string_table;
+// the number of slots in string_table, minus 1
+static address_t string_table_mask;
+// the decoded program object, while it is being emitted
+static siheap_code_t *code_obj;
+
+/**
+ * Returns the size of a decoded instruction.
+ *
+ * Instructions with a 32-bit (or 64-bit) operand, and calls (which have an
+ * inline cache), take two words; everything else fits in one.
+ */
+static address_t decoded_size(opcode_t op) {
+  if (op == op_call || op == op_call_t) {
+    return sizeof(struct sidec_op_call);
+  }
+  return siop_size(op) > sizeof(struct sidec_op) ? 2*sizeof(struct sidec_op) : sizeof(struct sidec_op);
+}
+
+/**
+ * Returns whether execution can continue to the next instruction after this one.
+ */
+static bool falls_through(opcode_t op) {
+  switch (op) {
+  case op_br:
+  case op_jmp:
+  case op_call_t:
+  case op_call_t_p:
+  case op_call_t_v:
+  case op_ret_g:
+  case op_ret_f:
+  case op_ret_b:
+  case op_ret_u:
+  case op_ret_n:
+    return false;
+  default:
+    return siop_size(op) != 0;
+  }
+}
+
+static void queue_instr(address_t addr) {
+  if (addr >= program_size) {
+    SIDEBUG("Branch to 0x%"PRIx32" is out of bounds\n", addr);
+    sifault(sinter_fault_invalid_program);
+    return;
+  }
+
+  BITMAP_SET(targets, addr);
+  if (!BITMAP_GET(instrs, addr)) {
+    BITMAP_SET(pending, addr);
+    pending_added = true;
+  }
+}
+
+static void queue_function(address_t addr) {
+  if (addr >= program_size || program_size - addr <= offsetof(svm_function_t, code)) {
+    SIDEBUG("Function at 0x%"PRIx32" is out of bounds\n", addr);
+    sifault(sinter_fault_invalid_program);
+    return;
+  }
+
+  if (!BITMAP_GET(functions, addr)) {
+    BITMAP_SET(functions, addr);
+    queue_instr(addr + offsetof(svm_function_t, code));
+  }
+}
+
+/**
+ * Returns the SVML address of the target of a branch instruction.
+ */
+static address_t branch_target(address_t addr) {
+  const struct op_offset *instr = (const struct op_offset *) (program + addr);
+  const int64_t target = (int64_t) addr + sizeof(*instr) + instr->offset;
+  if (target < 0 || target >= program_size) {
+    SIDEBUG("Branch at 0x%"PRIx32" is out of bounds\n", addr);
+    sifault(sinter_fault_invalid_program);
+    return 0;
+  }
+  return (address_t) target;
+}
+
+/**
+ * Marks all instructions reachable from the given address without branching.
+ */
+static void follow(address_t addr) {
+  while (!BITMAP_GET(instrs, addr)) {
+    BITMAP_SET(instrs, addr);
+    BITMAP_CLEAR(pending, addr);
+
+    const opcode_t op = program[addr];
+    const address_t size = siop_size(op);
+    if (program_size - addr < size) {
+      SIDEBUG("Instruction at 0x%"PRIx32" is truncated\n", addr);
+      sifault(sinter_fault_invalid_program);
+      return;
+    }
+
+    switch (op) {
+    case op_br_t:
+    case op_br_f:
+    case op_br:
+      queue_instr(branch_target(addr));
+      break;
+    case op_lgc_s:
+      ++string_sites;
+      break;
+    case op_jmp:
+      queue_instr(((const struct op_address *) (program + addr))->address);
+      break;
+    case op_new_c:
+      queue_function(((const struct op_address *) (program + addr))->address);
+      break;
+    default:
+      break;
+    }
+
+    if (!falls_through(op)) {
+      return;
+    }
+
+    addr += size;
+    if (addr >= program_size) {
+      SIDEBUG("Execution runs off the end of the program after 0x%"PRIx32"\n", addr - size);
+      sifault(sinter_fault_invalid_program);
+      return;
+    }
+  }
+}
+
+/**
+ * Returns whether a branch between the two addresses crosses a function header.
+ */
+static bool crosses_function(address_t from, address_t to) {
+  if (from > to) {
+    const address_t t = from;
+    from = to;
+    to = t;
+  }
+  for (address_t addr = from + 1; addr <= to; ++addr) {
+    if (BITMAP_GET(functions, addr)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Marks the functions whose environment may be captured.
+ *
+ * A function's code is taken to be the instructions between its header and the
+ * next one. Its environment, and those of the blocks in it, can only be captured
+ * by a new_c in that code. A function with code that branches out of that range
+ * is assumed to escape, since the code it reaches is not accounted for.
+ */
+static void find_escaping(void) {
+  bool in_function = false;
+  address_t function = 0;
+  for (address_t addr = 0; addr < program_size; ++addr) {
+    if (BITMAP_GET(functions, addr)) {
+      in_function = true;
+      function = addr;
+    }
+    if (!in_function || !BITMAP_GET(instrs, addr)) {
+      continue;
+    }
+
+    bool escapes;
+    switch (program[addr]) {
+    case op_new_c:
+      escapes = true;
+      break;
+    case op_br_t:
+    case op_br_f:
+    case op_br:
+      escapes = crosses_function(addr, branch_target(addr));
+      break;
+    case op_jmp:
+      escapes = crosses_function(addr, ((const struct op_address *) (program + addr))->address);
+      break;
+    default:
+      escapes = false;
+      break;
+    }
+    if (escapes) {
+      BITMAP_SET(escaping, function);
+    }
+  }
+}
+
+/**
+ * Returns the length of the display of the environments of the function at the
+ * given address: the number of ancestors beyond the parent that its ldp and stp
+ * instructions refer to.
+ */
+static uint8_t display_count(address_t function) {
+#ifdef SINTER_ENV_DISPLAY
+  unsigned int depth = 0;
+  for (address_t addr = function + 1; addr < program_size && !BITMAP_GET(functions, addr); ++addr) {
+    if (!BITMAP_GET(instrs, addr)) {
+      continue;
+    }
+    switch (program[addr]) {
+    case op_ldp_g:
+    case op_ldp_f:
+    case op_ldp_b:
+    case op_stp_g:
+    case op_stp_b:
+    case op_stp_f: {
+      const unsigned int envindex = ((const struct op_twoindex *) (program + addr))->envindex;
+      if (envindex > depth) {
+        depth = envindex;
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  return depth < SIENV_DISPLAY_MIN_DEPTH ? 0 : depth - 1 > SIENV_DISPLAY_MAX ? SIENV_DISPLAY_MAX : (uint8_t) (depth - 1);
+#else
+  (void) function;
+  return 0;
+#endif
+}
+
+/**
+ * A decoded instruction: either a single SVML instruction, or a fused sequence
+ * of two.
+ */
+struct item {
+  opcode_t op;
+  // the total size of the SVML instructions
+  address_t svml_size;
+  // the size of the decoded instruction; 0 if the sequence is removed entirely
+  address_t decoded_size;
+};
+
+static bool is_ldl(opcode_t op) {
+  return op == op_ldl_g || op == op_ldl_f || op == op_ldl_b;
+}
+
+/**
+ * Returns whether this instruction loads a constant operand, and so is decoded
+ * into ldc_nanbox.
+ */
+static bool is_ldc_operand(opcode_t op) {
+  switch (op) {
+  case op_ldc_i:
+  case op_lgc_i:
+  case op_ldc_f32:
+  case op_lgc_f32:
+  case op_ldc_f64:
+  case op_lgc_f64:
+  case op_lgc_s:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * Returns the decoded instruction starting at the given reachable SVML address,
+ * fusing it with the next instruction if possible.
+ */
+static struct item decode_item(address_t addr) {
+  const opcode_t op = program[addr];
+  const address_t size = siop_size(op);
+  struct item item = { op, size, decoded_size(op) };
+
+  // the next instruction can only be fused in if it is only reached from this one
+  // (pass 1 already checked that it is within the program)
+  if (!falls_through(op) || BITMAP_GET(targets, addr + size)) {
+    return item;
+  }
+
+  const opcode_t next_op = program[addr + size];
+  const address_t next_size = siop_size(next_op);
+  opcode_t fused_op = op;
+  switch (op) {
+  case op_lgc_u:
+    if (next_op == op_pop_g || next_op == op_pop_b || next_op == op_pop_f) {
+      // pushes and pops undefined; nothing to do
+      return (struct item) { op, size + next_size, 0 };
+    }
+    break;
+  case op_ldl_g:
+  case op_ldl_f:
+  case op_ldl_b:
+    if (is_ldl(next_op)) {
+      fused_op = op_fused_ldl_ldl;
+    } else if (is_ldc_operand(next_op)) {
+      fused_op = op_fused_ldl_ldc;
+    }
+    break;
+  case op_ldc_i:
+  case op_lgc_i:
+    if (next_op == op_add_g || next_op == op_add_f) {
+      fused_op = op_fused_add_i;
+    } else if (next_op == op_sub_g || next_op == op_sub_f) {
+      fused_op = op_fused_sub_i;
+    }
+    break;
+  case op_lt_g:
+  case op_lt_f:
+    fused_op = next_op == op_br_f ? op_fused_lt_br_f : op;
+    break;
+  case op_gt_g:
+  case op_gt_f:
+    fused_op = next_op == op_br_f ? op_fused_gt_br_f : op;
+    break;
+  case op_le_g:
+  case op_le_f:
+    fused_op = next_op == op_br_f ? op_fused_le_br_f : op;
+    break;
+  case op_ge_g:
+  case op_ge_f:
+    fused_op = next_op == op_br_f ? op_fused_ge_br_f : op;
+    break;
+  default:
+    break;
+  }
+
+  if (fused_op != op) {
+    item.op = fused_op;
+    item.svml_size = size + next_size;
+    item.decoded_size = fused_op == op_fused_ldl_ldl ? sizeof(struct sidec_op_twolocal) : 2*sizeof(struct sidec_op);
+  }
+  return item;
+}
+
+/**
+ * Returns the decoded offset of the given reachable instruction or function.
+ */
+static address_t decoded_offset(address_t addr) {
+  address_t offset = chunk_offsets[addr >> CHUNK_SHIFT];
+  for (address_t cur = addr & ~((1u << CHUNK_SHIFT) - 1); cur < addr; ++cur) {
+    if (BITMAP_GET(functions, cur)) {
+      offset += offsetof(svm_function_t, code);
+    }
+    if (BITMAP_GET(instrs, cur)) {
+      offset += decode_item(cur).decoded_size;
+    }
+  }
+  return offset;
+}
+
+/**
+ * Returns the string constant object for the lgc_s instruction at the given
+ * SVML address.
+ *
+ * Each distinct constant gets one object, which is owned by the decoded
+ * program. The object is permanent, so loading it does not touch its reference
+ * count.
+ */
+static sinanbox_t string_constant(address_t addr) {
+  const address_t const_addr = ((const struct op_address *) (program + addr))->address;
+  if (const_addr > program_size || program_size - const_addr < sizeof(svm_constant_t)) {
+    SIDEBUG("String constant at 0x%"PRIx32" is out of bounds\n", const_addr);
+    sifault(sinter_fault_invalid_program);
+    return NANBOX_OFUNDEF();
+  }
+
+  const svm_constant_t *const string = (const svm_constant_t *) (program + const_addr);
+  // Fibonacci hashing; the table has fewer than 2^32 slots
+  address_t slot = (address_t) (const_addr * UINT32_C(2654435769)) & string_table_mask;
+  while (string_table[slot]) {
+    const sinanbox_t v = code_obj->strings[string_table[slot] - 1];
+    if (((const siheap_strconst_t *) SIHEAP_NANBOXTOPTR(v))->string == string) {
+      return v;
+    }
+    slot = (slot + 1) & string_table_mask;
+  }
+
+  // sidecode_program made sure there is room for this right after the decoded program
+  siheap_strconst_t *const obj = sistrconst_new(string);
+  siheap_make_permanent(&obj->header);
+  const sinanbox_t v = SIHEAP_PTRTONANBOX(obj);
+  code_obj->strings[code_obj->string_count++] = v;
+  string_table[slot] = code_obj->string_count;
+  return v;
+}
+
+/**
+ * Returns the NaN-box pushed by the constant load at the given SVML address.
+ */
+static sinanbox_t constant_value(address_t addr) {
+  const opcode_t op = program[addr];
+  switch (op) {
+  case op_ldc_i:
+  case op_lgc_i:
+    return NANBOX_WRAP_INT(((const struct op_i32 *) (program + addr))->operand);
+  case op_ldc_f32:
+  case op_lgc_f32:
+    return NANBOX_OFFLOAT(((const struct op_f32 *) (program + addr))->operand);
+  case op_ldc_f64:
+  case op_lgc_f64:
+    return NANBOX_OFFLOAT(siop_f64_operand((const struct op_f64 *) (program + addr)));
+  case op_lgc_s:
+    return string_constant(addr);
+  default:
+    SIBUGV("Unhandled constant load %02x\n", op);
+    sifault(sinter_fault_internal_error);
+    return NANBOX_OFUNDEF();
+  }
+}
+
+/**
+ * Writes the decoded form of the instruction at the given SVML address.
+ */
+static void emit_instr(address_t addr, unsigned char *out, address_t offset) {
+  const opcode_t op = program[addr];
+  const address_t size = siop_size(op);
+  unsigned char *const to = out + offset;
+
+  if (op == op_call || op == op_call_t) {
+    *(struct sidec_op_call *) to = (struct sidec_op_call) {
+      .opcode = op,
+      .num_args = ((const struct op_call *) (program + addr))->num_args,
+      .cache = SIDEC_CALL_CACHE_EMPTY
+    };
+    return;
+  }
+
+  if (size <= sizeof(struct sidec_op)) {
+    // opcode, and any single-byte operands, which are in the same place
+    struct sidec_op *cell = (struct sidec_op *) to;
+    *cell = (struct sidec_op) { 0 };
+    memcpy(cell, program + addr, size ? size : sizeof(opcode_t));
+    return;
+  }
+
+  switch (op) {
+  case op_ldc_i:
+  case op_lgc_i:
+  case op_ldc_f32:
+  case op_lgc_f32:
+  case op_ldc_f64:
+  case op_lgc_f64:
+  case op_lgc_s:
+    *(struct sidec_op_nanbox *) to = (struct sidec_op_nanbox) {
+      .opcode = op_ldc_nanbox,
+      .value = constant_value(addr)
+    };
+    break;
+  case op_new_c:
+  case op_jmp:
+    *(struct sidec_op_address *) to = (struct sidec_op_address) {
+      .opcode = op,
+      .address = decoded_offset(((const struct op_address *) (program + addr))->address)
+    };
+    break;
+  case op_br_t:
+  case op_br_f:
+  case op_br:
+    *(struct sidec_op_offset *) to = (struct sidec_op_offset) {
+      .opcode = op,
+      .offset = (offset_t) (decoded_offset(branch_target(addr)) - (offset + sizeof(struct sidec_op_offset)))
+    };
+    break;
+  default:
+    SIBUGV("Unhandled wide instruction %02x\n", op);
+    sifault(sinter_fault_internal_error);
+    break;
+  }
+}
+
+/**
+ * Writes a fused instruction for the sequence at the given SVML address.
+ */
+static void emit_fused(address_t addr, struct item item, unsigned char *out, address_t offset) {
+  unsigned char *const to = out + offset;
+  const address_t next = addr + siop_size(program[addr]);
+
+  switch (item.op) {
+  case op_fused_ldl_ldl:
+    *(struct sidec_op_twolocal *) to = (struct sidec_op_twolocal) {
+      .opcode = item.op,
+      .index = ((const struct op_oneindex *) (program + addr))->index,
+      .index2 = ((const struct op_oneindex *) (program + next))->index
+    };
+    break;
+  case op_fused_ldl_ldc:
+    *(struct sidec_op_local_nanbox *) to = (struct sidec_op_local_nanbox) {
+      .opcode = item.op,
+      .index = ((const struct op_oneindex *) (program + addr))->index,
+      .value = constant_value(next)
+    };
+    break;
+  case op_fused_add_i:
+  case op_fused_sub_i:
+    *(struct sidec_op_nanbox *) to = (struct sidec_op_nanbox) {
+      .opcode = item.op,
+      .value = constant_value(addr)
+    };
+    break;
+  case op_fused_lt_br_f:
+  case op_fused_gt_br_f:
+  case op_fused_le_br_f:
+  case op_fused_ge_br_f:
+    *(struct sidec_op_offset *) to = (struct sidec_op_offset) {
+      .opcode = item.op,
+      .offset = (offset_t) (decoded_offset(branch_target(next)) - (offset + sizeof(struct sidec_op_offset)))
+    };
+    break;
+  default:
+    SIBUGV("Unhandled fused instruction %02x\n", item.op);
+    sifault(sinter_fault_internal_error);
+    break;
+  }
+}
+
+const svm_function_t *sidecode_program(void) {
+  program = sistate.program;
+  program_size = (address_t) (sistate.program_end - sistate.program);
+  if (program_size < sizeof(svm_header_t)) {
+    SIDEBUG("Program is too small\n");
+    sifault(sinter_fault_invalid_program);
+    return NULL;
+  }
+
+  // set up the scratch area at the top of the heap
+  const address_t bitmap_size = (program_size + 7) >> 3;
+  const address_t chunk_count = (program_size >> CHUNK_SHIFT) + 1;
+  const address_t scratch_size = (chunk_count*sizeof(address_t) + 4*bitmap_size + 3) & ~(address_t) 3;
+  if (scratch_size + sizeof(siheap_free_t) > SINTER_HEAP_SIZE) {
+    sifault(sinter_fault_out_of_memory);
+    return NULL;
+  }
+  unsigned char *const scratch = siheap + ((SINTER_HEAP_SIZE - scratch_size) & ~(size_t) 3);
+  chunk_offsets = (address_t *) scratch;
+  instrs = scratch + chunk_count*sizeof(address_t);
+  pending = instrs + bitmap_size;
+  functions = pending + bitmap_size;
+  targets = functions + bitmap_size;
+  memset(instrs, 0, 4*bitmap_size);
+
+  // pass 1: find reachable code
+  pending_added = false;
+  string_sites = 0;
+  queue_function(((const svm_header_t *) program)->entry);
+  while (pending_added) {
+    pending_added = false;
+    for (address_t addr = 0; addr < program_size; ++addr) {
+      if (BITMAP_GET(pending, addr)) {
+        follow(addr);
+      }
+    }
+  }
+
+  // at most half full, so that probe sequences stay short
+  string_table_mask = 1;
+  while (string_table_mask < 2*string_sites) {
+    string_table_mask <<= 1;
+  }
+  const address_t string_table_size = string_table_mask*sizeof(address_t);
+  --string_table_mask;
+  if (string_table_size > (address_t) (scratch - siheap)) {
+    sifault(sinter_fault_out_of_memory);
+    return NULL;
+  }
+  string_table = (address_t *) (scratch - string_table_size);
+  memset(string_table, 0, string_table_size);
+
+  // this must happen before pass 2 removes fused instructions from instrs
+  escaping = pending;
+  find_escaping();
+
+  // pass 2: lay out the decoded program, fusing instructions where possible
+  address_t code_size = 0;
+  address_t item_end = 0;
+  for (address_t addr = 0; addr < program_size; ++addr) {
+    if (!(addr & ((1u << CHUNK_SHIFT) - 1))) {
+      chunk_offsets[addr >> CHUNK_SHIFT] = code_size;
+    }
+    if (BITMAP_GET(functions, addr)) {
+      if (addr < item_end) {
+        SIDEBUG("Function at 0x%"PRIx32" overlaps code\n", addr);
+        sifault(sinter_fault_invalid_program);
+        return NULL;
+      }
+      code_size += offsetof(svm_function_t, code);
+      item_end = addr + offsetof(svm_function_t, code);
+    }
+    if (BITMAP_GET(instrs, addr)) {
+      if (addr < item_end) {
+        SIDEBUG("Instruction at 0x%"PRIx32" overlaps another instruction or function\n", addr);
+        sifault(sinter_fault_invalid_program);
+        return NULL;
+      }
+      const struct item item = decode_item(addr);
+      code_size += item.decoded_size;
+      item_end = addr + item.svml_size;
+      if (item.svml_size != siop_size(program[addr])) {
+        // the second instruction of the sequence is now part of this one
+        BITMAP_CLEAR(instrs, addr + siop_size(program[addr]));
+      }
+    }
+  }
+
+  // allocate the decoded program, making sure it does not overwrite the scratch area
+#ifdef SINTER_DECODE_ADDRESS_MAP
+  // one SVML address per decoded word
+  const address_t map_size = code_size / sizeof(uint32_t) * sizeof(address_t);
+#else
+  const address_t map_size = 0;
+#endif
+  const address_t alloc_size = sizeof(siheap_code_t) + code_size + map_size + string_sites*sizeof(sinanbox_t);
+  // the string constant objects are allocated after the decoded program
+  const address_t string_obj_size = siheap_round_size(sizeof(siheap_strconst_t) > sizeof(siheap_free_t)
+    ? sizeof(siheap_strconst_t) : sizeof(siheap_free_t));
+  if (siheap_round_size(alloc_size) + string_sites*string_obj_size + sizeof(siheap_free_t) > (address_t) ((unsigned char *) string_table - siheap)) {
+    sifault(sinter_fault_out_of_memory);
+    return NULL;
+  }
+  code_obj = (siheap_code_t *) siheap_malloc(alloc_size, sitype_code);
+  siheap_intref(code_obj);
+  unsigned char *const code = (unsigned char *) code_obj->code;
+  code_obj->strings = (sinanbox_t *) (code + code_size + map_size);
+  code_obj->string_count = 0;
+
+  // pass 3: emit the decoded program
+  address_t offset = 0;
+#ifdef SINTER_DECODE_ADDRESS_MAP
+  address_t *const map = (address_t *) (code + code_size);
+#endif
+  // the display length of the current function
+  uint8_t display = 0;
+  for (address_t addr = 0; addr < program_size; ++addr) {
+    const address_t item_start = offset;
+    if (BITMAP_GET(functions, addr)) {
+      memcpy(code + offset, program + addr, offsetof(svm_function_t, code));
+      display = display_count(addr);
+      ((svm_function_t *) (code + offset))->padding = (uint8_t) ((display << SIDEC_FUNCTION_DISPLAY_SHIFT)
+        | (BITMAP_GET(escaping, addr) ? 0 : SIDEC_FUNCTION_NOESCAPE));
+      offset += offsetof(svm_function_t, code);
+    }
+    if (BITMAP_GET(instrs, addr)) {
+      const struct item item = decode_item(addr);
+      if (item.op != program[addr]) {
+        emit_fused(addr, item, code, offset);
+      } else if (item.decoded_size) {
+        emit_instr(addr, code, offset);
+        if (program[addr] == op_newenv) {
+          ((struct sidec_op_oneindex *) (code + offset))->padding[0] = display;
+        }
+      }
+      offset += item.decoded_size;
+    }
+#ifdef SINTER_DECODE_ADDRESS_MAP
+    for (address_t word = item_start; word < offset; word += sizeof(uint32_t)) {
+      map[word / sizeof(uint32_t)] = addr;
+    }
+#else
+    (void) item_start;
+#endif
+  }
+
+  sistate.code = code;
+  sistate.code_end = code + code_size;
+
+  return (const svm_function_t *) (code + decoded_offset(((const svm_header_t *) program)->entry));
+}
+
+ptrdiff_t sidecode_pctoaddr(const opcode_t *pc) {
+#ifdef SINTER_DECODE_ADDRESS_MAP
+  if (pc >= sistate.code && pc < sistate.code_end) {
+    return ((const address_t *) sistate.code_end)[(pc - sistate.code) / sizeof(uint32_t)];
+  }
+#endif
+  return pc - sistate.code;
+}
+
+#endif
@@ -20,3 +20,4 @@
 #include <sinter/stack.h>
 #include <sinter/vm.h>
 #include <sinter/display.h>
+#include <sinter/aot.h>
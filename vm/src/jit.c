@@ -0,0 +1,966 @@
+// for MAP_ANONYMOUS
+#define _DEFAULT_SOURCE
+
+#include <sinter/config.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SINTER_JIT
+
+#include <sys/mman.h>
+
+#include <sinter/jit.h>
+#include <sinter/aot.h>
+#include <sinter/debug.h>
+#include <sinter/fault.h>
+#include <sinter/nanbox.h>
+#include <sinter/opcode.h>
+#include <sinter/program.h>
+#include <sinter/stack.h>
+
+/*
+ * The code for each function follows the System V x86-64 ABI, and keeps the
+ * following in callee-saved registers:
+ *
+ * - rbx: sistack_top, which is written back before calling into C, and read
+ *   again after
+ * - r12: &sistack_top
+ * - r13: sistack_limit, and r14: sistack_bottom, which do not change while
+ *   the function runs (calls restore them when they return)
+ * - r15: &sistate.env
+ *
+ * Common instructions have a fast path for the common case (integers, no
+ * reference counting, no stack overflow or underflow), which falls back to the
+ * runtime support in aot.c for everything else, including faults.
+ */
+
+// A branch target that is not in the program; jumps to the fault at the end
+// of the function
+#define INVALID_TARGET UINT32_MAX
+
+typedef struct {
+  // the offset of the rel32 to patch
+  size_t position;
+  address_t target;
+} jump_t;
+
+typedef struct {
+  address_t address;
+  size_t offset;
+} function_t;
+
+static const unsigned char *program;
+static address_t program_size;
+
+// the code being compiled, which is copied to executable memory when done
+static unsigned char *code;
+static size_t code_size;
+static size_t code_capacity;
+static bool out_of_memory;
+
+// the functions found so far
+static function_t *functions;
+static size_t function_count;
+static size_t function_capacity;
+
+// jumps in the function being compiled
+static jump_t *jumps;
+static size_t jump_count;
+static size_t jump_capacity;
+
+// the code offset of each instruction in the function being compiled, or
+// SIZE_MAX if it has not been reached
+static size_t *instr_offsets;
+
+// the addresses of the instructions compiled in the function being compiled,
+// whose entries in instr_offsets are reset before the next function
+static address_t *compiled_addrs;
+static size_t compiled_addr_count;
+static size_t compiled_addr_capacity;
+
+// the last compiled program
+static void *compiled_code;
+static size_t compiled_size;
+static siaot_function_t *compiled_functions;
+static sinter_aot_program_t compiled_program;
+
+/**
+ * Grows an array to hold at least one more element. Returns false if out of
+ * memory.
+ */
+static bool grow(void **array, size_t *capacity, size_t count, size_t element_size) {
+  if (count < *capacity) {
+    return true;
+  }
+  const size_t new_capacity = *capacity ? *capacity * 2 : 64;
+  void *new_array = realloc(*array, new_capacity * element_size);
+  if (!new_array) {
+    out_of_memory = true;
+    return false;
+  }
+  *array = new_array;
+  *capacity = new_capacity;
+  return true;
+}
+
+static void emit_u8(uint8_t v) {
+  if (grow((void **) &code, &code_capacity, code_size, 1)) {
+    code[code_size++] = v;
+  }
+}
+
+static void emit_u32(uint32_t v) {
+  for (unsigned int i = 0; i < 4; ++i) {
+    emit_u8((uint8_t) (v >> (8*i)));
+  }
+}
+
+static void emit_u64(uint64_t v) {
+  emit_u32((uint32_t) v);
+  emit_u32((uint32_t) (v >> 32));
+}
+
+/**
+ * Emits a mov of an immediate to the register holding the given integer
+ * argument of a call.
+ */
+static void emit_arg(unsigned int arg, uint32_t value) {
+  // mov edi/esi/edx/ecx, imm32
+  static const uint8_t opcodes[] = { 0xBF, 0xBE, 0xBA, 0xB9 };
+  emit_u8(opcodes[arg]);
+  emit_u32(value);
+}
+
+static void emit_bytes(const uint8_t *bytes, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    emit_u8(bytes[i]);
+  }
+}
+
+#define EMIT(...) do { \
+  const uint8_t bytes[] = { __VA_ARGS__ }; \
+  emit_bytes(bytes, sizeof(bytes)); \
+} while (0)
+
+static void emit_call_address(uintptr_t fn) {
+  // mov [r12], rbx
+  EMIT(0x49, 0x89, 0x1C, 0x24);
+  // mov rax, imm64
+  EMIT(0x48, 0xB8);
+  emit_u64(fn);
+  // call rax
+  EMIT(0xFF, 0xD0);
+  // mov rbx, [r12]
+  EMIT(0x49, 0x8B, 0x1C, 0x24);
+}
+
+#define emit_call(fn) emit_call_address((uintptr_t) (fn))
+
+// x86 condition codes, as the second byte of a jcc rel32
+#define CC_B 0x82
+#define CC_AE 0x83
+#define CC_E 0x84
+#define CC_NE 0x85
+#define CC_BE 0x86
+
+/**
+ * Emits a jump to the instruction at target. cc is 0 for an unconditional
+ * jump.
+ */
+static void emit_jump(uint8_t cc, address_t target) {
+  if (cc) {
+    EMIT(0x0F, cc);
+  } else {
+    EMIT(0xE9);
+  }
+
+  if (grow((void **) &jumps, &jump_capacity, jump_count, sizeof(jump_t))) {
+    jumps[jump_count++] = (jump_t) { .position = code_size, .target = target };
+  }
+  emit_u32(0);
+}
+
+static void emit_prologue(void) {
+  // push rbx; push r12; push r13; push r14; push r15
+  // this also aligns the stack for calls
+  EMIT(0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+  // mov r12, &sistack_top
+  EMIT(0x49, 0xBC);
+  emit_u64((uintptr_t) &sistack_top);
+  // mov rbx, [r12]
+  EMIT(0x49, 0x8B, 0x1C, 0x24);
+  // mov rax, &sistack_limit; mov r13, [rax]
+  EMIT(0x48, 0xB8);
+  emit_u64((uintptr_t) &sistack_limit);
+  EMIT(0x4C, 0x8B, 0x28);
+  // mov rax, &sistack_bottom; mov r14, [rax]
+  EMIT(0x48, 0xB8);
+  emit_u64((uintptr_t) &sistack_bottom);
+  EMIT(0x4C, 0x8B, 0x30);
+  // mov r15, &sistate.env
+  EMIT(0x49, 0xBF);
+  emit_u64((uintptr_t) &sistate.env);
+}
+
+static void emit_epilogue(void) {
+  // pop r15; pop r14; pop r13; pop r12; pop rbx; ret
+  EMIT(0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);
+}
+
+/*
+ * Jumps within the template of an instruction.
+ */
+
+// jumps to the slow path of the current instruction
+static size_t slow_jumps[8];
+static unsigned int slow_jump_count;
+
+/**
+ * Emits a jump with a rel32 to be bound later, and returns the position of the
+ * rel32. cc is 0 for an unconditional jump.
+ */
+static size_t emit_local_jump(uint8_t cc) {
+  if (cc) {
+    EMIT(0x0F, cc);
+  } else {
+    EMIT(0xE9);
+  }
+  const size_t position = code_size;
+  emit_u32(0);
+  return position;
+}
+
+/**
+ * Binds a jump emitted by emit_local_jump to the current position.
+ */
+static void bind_local_jump(size_t position) {
+  if (out_of_memory) {
+    return;
+  }
+  const uint32_t rel = (uint32_t) (code_size - (position + 4));
+  memcpy(code + position, &rel, sizeof(rel));
+}
+
+static void jump_to_slow_path(uint8_t cc) {
+  slow_jumps[slow_jump_count++] = emit_local_jump(cc);
+}
+
+/**
+ * Ends the fast path, and starts the slow path. Returns the jump from the end
+ * of the fast path, to be bound after the slow path.
+ */
+static size_t begin_slow_path(void) {
+  const size_t done = emit_local_jump(0);
+  for (unsigned int i = 0; i < slow_jump_count; ++i) {
+    bind_local_jump(slow_jumps[i]);
+  }
+  slow_jump_count = 0;
+  return done;
+}
+
+/**
+ * Emits a jump to the slow path if v is a pointer, where v is edx or ecx
+ * (encoded as 2 or 1). Clobbers the other.
+ */
+static void emit_check_not_ptr(uint8_t v) {
+  if (v == 2) {
+    // mov ecx, edx; and ecx, NANBOX_TPTR; cmp ecx, NANBOX_TPTR
+    EMIT(0x89, 0xD1, 0x81, 0xE1);
+    emit_u32(NANBOX_TPTR);
+    EMIT(0x81, 0xF9);
+  } else {
+    // mov edx, ecx; and edx, NANBOX_TPTR; cmp edx, NANBOX_TPTR
+    EMIT(0x89, 0xCA, 0x81, 0xE2);
+    emit_u32(NANBOX_TPTR);
+    EMIT(0x81, 0xFA);
+  }
+  emit_u32(NANBOX_TPTR);
+  jump_to_slow_path(CC_E);
+}
+
+/**
+ * Loads sistate.env into rax, and jumps to the slow path if index is out of
+ * bounds.
+ */
+static void emit_env_check(uint8_t index) {
+  // mov rax, [r15]
+  EMIT(0x49, 0x8B, 0x07);
+  // movzx ecx, word [rax + offsetof(entry_count)]
+  EMIT(0x0F, 0xB7, 0x48, (uint8_t) offsetof(siheap_env_t, entry_count));
+  // cmp ecx, index
+  EMIT(0x81, 0xF9);
+  emit_u32(index);
+  jump_to_slow_path(CC_BE);
+}
+
+static uint32_t env_entry_offset(uint8_t index) {
+  return (uint32_t) (offsetof(siheap_env_t, entry) + index*sizeof(sinanbox_t));
+}
+
+/**
+ * Jumps to the slow path unless there are at least count entries on the stack.
+ */
+static void emit_underflow_check(unsigned int count) {
+  // lea rax, [rbx - 4*count]; cmp rax, r14
+  EMIT(0x48, 0x8D, 0x43, (uint8_t) -(int) (count*sizeof(sinanbox_t)), 0x4C, 0x39, 0xF0);
+  jump_to_slow_path(CC_B);
+}
+
+static void emit_overflow_check(void) {
+  // cmp rbx, r13
+  EMIT(0x4C, 0x39, 0xEB);
+  jump_to_slow_path(CC_AE);
+}
+
+/**
+ * Emits the fast path of ldl: loads an entry of the current environment that
+ * is not a pointer, and pushes it.
+ */
+static void emit_ldl(uint8_t index) {
+  emit_env_check(index);
+  // mov edx, [rax + offset]
+  EMIT(0x8B, 0x90);
+  emit_u32(env_entry_offset(index));
+  // cmp edx, NANBOX_TEMPTY
+  EMIT(0x81, 0xFA);
+  emit_u32(NANBOX_TEMPTY);
+  jump_to_slow_path(CC_E);
+  emit_check_not_ptr(2);
+  emit_overflow_check();
+  // mov [rbx], edx; add rbx, 4
+  EMIT(0x89, 0x13, 0x48, 0x83, 0xC3, 0x04);
+
+  const size_t done = begin_slow_path();
+  emit_arg(0, index);
+  emit_call(siaot_ldl);
+  bind_local_jump(done);
+}
+
+/**
+ * Emits the fast path of stl: pops into an entry of the current environment
+ * that is not a pointer.
+ */
+static void emit_stl(uint8_t index) {
+  emit_underflow_check(1);
+  emit_env_check(index);
+  // mov edx, [rax + offset]
+  EMIT(0x8B, 0x90);
+  emit_u32(env_entry_offset(index));
+  emit_check_not_ptr(2);
+  // mov ecx, [rbx - 4]; mov [rax + offset], ecx; sub rbx, 4
+  EMIT(0x8B, 0x4B, 0xFC, 0x89, 0x88);
+  emit_u32(env_entry_offset(index));
+  EMIT(0x48, 0x83, 0xEB, 0x04);
+
+  const size_t done = begin_slow_path();
+  emit_arg(0, index);
+  emit_call(siaot_stl);
+  bind_local_jump(done);
+}
+
+/**
+ * Emits the fast path of pop: pops a value that is not a pointer.
+ */
+static void emit_pop(void) {
+  emit_underflow_check(1);
+  // mov ecx, [rbx - 4]
+  EMIT(0x8B, 0x4B, 0xFC);
+  emit_check_not_ptr(1);
+  // sub rbx, 4
+  EMIT(0x48, 0x83, 0xEB, 0x04);
+
+  const size_t done = begin_slow_path();
+  emit_call(siaot_pop);
+  bind_local_jump(done);
+}
+
+/**
+ * Loads the top two entries of the stack into eax and ecx, and jumps to the
+ * slow path unless they are both integers.
+ */
+static void emit_int_operands(void) {
+  emit_underflow_check(2);
+  // mov eax, [rbx - 8]; mov ecx, [rbx - 4]
+  EMIT(0x8B, 0x43, 0xF8, 0x8B, 0x4B, 0xFC);
+  // mov edx, eax; and edx, NANBOX_INTMASK; cmp edx, NANBOX_TINT
+  EMIT(0x89, 0xC2, 0x81, 0xE2);
+  emit_u32(NANBOX_INTMASK);
+  EMIT(0x81, 0xFA);
+  emit_u32(NANBOX_TINT);
+  jump_to_slow_path(CC_NE);
+  // mov edx, ecx; and edx, NANBOX_INTMASK; cmp edx, NANBOX_TINT
+  EMIT(0x89, 0xCA, 0x81, 0xE2);
+  emit_u32(NANBOX_INTMASK);
+  EMIT(0x81, 0xFA);
+  emit_u32(NANBOX_TINT);
+  jump_to_slow_path(CC_NE);
+}
+
+/**
+ * Replaces the top two entries of the stack with the value in edx.
+ */
+static void emit_replace_operands(void) {
+  // mov [rbx - 8], edx; sub rbx, 4
+  EMIT(0x89, 0x53, 0xF8, 0x48, 0x83, 0xEB, 0x04);
+}
+
+/**
+ * Emits add or sub, with a fast path for integers whose result is an integer.
+ */
+static void emit_add_sub(bool is_sub, void (*slow)(void)) {
+  emit_int_operands();
+  // sign-extend the 21-bit integers
+  // shl eax, 11; sar eax, 11; shl ecx, 11; sar ecx, 11
+  EMIT(0xC1, 0xE0, 0x0B, 0xC1, 0xF8, 0x0B, 0xC1, 0xE1, 0x0B, 0xC1, 0xF9, 0x0B);
+  if (is_sub) {
+    // sub eax, ecx
+    EMIT(0x29, 0xC8);
+  } else {
+    // add eax, ecx
+    EMIT(0x01, 0xC8);
+  }
+  // check that the result fits in 21 bits; otherwise it is a float
+  // mov edx, eax; shl edx, 11; sar edx, 11; cmp edx, eax
+  EMIT(0x89, 0xC2, 0xC1, 0xE2, 0x0B, 0xC1, 0xFA, 0x0B, 0x39, 0xC2);
+  jump_to_slow_path(CC_NE);
+  // and edx, 0x1fffff; or edx, NANBOX_TINT
+  EMIT(0x81, 0xE2);
+  emit_u32(0x1fffffu);
+  EMIT(0x81, 0xCA);
+  emit_u32(NANBOX_TINT);
+  emit_replace_operands();
+
+  const size_t done = begin_slow_path();
+  emit_call(slow);
+  bind_local_jump(done);
+}
+
+/**
+ * Emits a comparison, with a fast path for integers. setcc is the second byte
+ * of the setcc instruction for the comparison of the two operands.
+ */
+static void emit_compare(uint8_t setcc, bool sign_extend, uintptr_t slow, int slow_arg) {
+  emit_int_operands();
+  if (sign_extend) {
+    // shl eax, 11; sar eax, 11; shl ecx, 11; sar ecx, 11
+    EMIT(0xC1, 0xE0, 0x0B, 0xC1, 0xF8, 0x0B, 0xC1, 0xE1, 0x0B, 0xC1, 0xF9, 0x0B);
+  }
+  // cmp eax, ecx; setcc dl; movzx edx, dl; or edx, NANBOX_TBOOL
+  EMIT(0x39, 0xC8, 0x0F, setcc, 0xC2, 0x0F, 0xB6, 0xD2, 0x81, 0xCA);
+  emit_u32(NANBOX_TBOOL);
+  emit_replace_operands();
+
+  const size_t done = begin_slow_path();
+  if (slow_arg >= 0) {
+    emit_arg(0, (uint32_t) slow_arg);
+  }
+  emit_call_address(slow);
+  bind_local_jump(done);
+}
+
+/**
+ * Emits br.t or br.f, with a fast path for booleans.
+ */
+static void emit_branch(bool if_true, address_t target) {
+  emit_underflow_check(1);
+  // mov eax, [rbx - 4]; mov ecx, eax; and ecx, NANBOX_TYPEMASK; cmp ecx, NANBOX_TBOOL
+  EMIT(0x8B, 0x43, 0xFC, 0x89, 0xC1, 0x81, 0xE1);
+  emit_u32(NANBOX_TYPEMASK);
+  EMIT(0x81, 0xF9);
+  emit_u32(NANBOX_TBOOL);
+  jump_to_slow_path(CC_NE);
+  // sub rbx, 4; test al, 1
+  EMIT(0x48, 0x83, 0xEB, 0x04, 0xA8, 0x01);
+
+  const size_t done = begin_slow_path();
+  emit_call(siaot_pop_bool);
+  // test al, al
+  EMIT(0x84, 0xC0);
+  bind_local_jump(done);
+
+  // both paths set ZF if the value is false
+  emit_jump(if_true ? CC_NE : CC_E, target);
+}
+
+static void jit_push(uint32_t v) {
+  sistack_push(NANBOX_WITH_I32(v));
+}
+
+static void jit_invalid(void) {
+  sifault(sinter_fault_invalid_program);
+}
+
+static void emit_push(sinanbox_t v) {
+  emit_overflow_check();
+  // mov dword [rbx], imm32; add rbx, 4
+  EMIT(0xC7, 0x03);
+  emit_u32(v.as_u32);
+  EMIT(0x48, 0x83, 0xC3, 0x04);
+
+  const size_t done = begin_slow_path();
+  emit_arg(0, v.as_u32);
+  emit_call(jit_push);
+  bind_local_jump(done);
+}
+
+static address_t instr_size(address_t addr) {
+  if (addr >= program_size) {
+    return 0;
+  }
+  const address_t size = siop_size(program[addr]);
+  return size && size <= program_size - addr ? size : 0;
+}
+
+static bool is_valid_function(address_t addr) {
+  return addr <= program_size && program_size - addr >= offsetof(svm_function_t, code);
+}
+
+static bool is_valid_string(address_t addr) {
+  if (addr > program_size || program_size - addr < sizeof(svm_constant_t)) {
+    return false;
+  }
+  const svm_constant_t *constant = (const svm_constant_t *) (program + addr);
+  return constant->length <= program_size - addr - sizeof(svm_constant_t);
+}
+
+static address_t branch_target(address_t addr) {
+  int64_t t;
+  if (program[addr] == op_jmp) {
+    t = ((const struct op_address *) (program + addr))->address;
+  } else {
+    t = (int64_t) addr + (int64_t) sizeof(struct op_offset) + ((const struct op_offset *) (program + addr))->offset;
+  }
+  return t < 0 || t > program_size ? INVALID_TARGET : (address_t) t;
+}
+
+static bool falls_through(opcode_t op) {
+  switch (op) {
+  case op_br:
+  case op_jmp:
+  case op_call_t:
+  case op_call_t_p:
+  case op_call_t_v:
+  case op_ret_g:
+  case op_ret_f:
+  case op_ret_b:
+  case op_ret_u:
+  case op_ret_n:
+    return false;
+  default:
+    return true;
+  }
+}
+
+static void add_function(address_t address) {
+  for (size_t i = 0; i < function_count; ++i) {
+    if (functions[i].address == address) {
+      return;
+    }
+  }
+  if (grow((void **) &functions, &function_capacity, function_count, sizeof(function_t))) {
+    functions[function_count++] = (function_t) { .address = address, .offset = 0 };
+  }
+}
+
+/**
+ * Emits the template for the instruction at addr.
+ */
+static void emit_instr(address_t addr) {
+  if (!instr_size(addr)) {
+    emit_call(jit_invalid);
+    return;
+  }
+
+  const unsigned char *instr = program + addr;
+  const sinter_opcode_t op = (sinter_opcode_t) *instr;
+  switch (op) {
+  case op_nop:
+    break;
+  case op_ldc_i:
+  case op_lgc_i:
+    emit_push(NANBOX_WRAP_INT(((const struct op_i32 *) instr)->operand));
+    break;
+  case op_ldc_f32:
+  case op_lgc_f32:
+    emit_push(NANBOX_OFFLOAT(((const struct op_f32 *) instr)->operand));
+    break;
+  case op_ldc_f64:
+  case op_lgc_f64:
+    emit_push(NANBOX_OFFLOAT(siop_f64_operand((const struct op_f64 *) instr)));
+    break;
+  case op_ldc_b_0:
+  case op_lgc_b_0:
+    emit_push(NANBOX_OFBOOL(false));
+    break;
+  case op_ldc_b_1:
+  case op_lgc_b_1:
+    emit_push(NANBOX_OFBOOL(true));
+    break;
+  case op_lgc_u:
+    emit_push(NANBOX_OFUNDEF());
+    break;
+  case op_lgc_n:
+    emit_push(NANBOX_OFNULL());
+    break;
+  case op_lgc_s: {
+    const address_t string = ((const struct op_address *) instr)->address;
+    if (is_valid_string(string)) {
+      emit_arg(0, string);
+      emit_call(siaot_lgc_s);
+    } else {
+      emit_call(jit_invalid);
+    }
+    break;
+  }
+  case op_pop_g:
+  case op_pop_b:
+  case op_pop_f:
+    emit_pop();
+    break;
+  case op_add_g:
+    emit_add_sub(false, siaot_add_g);
+    break;
+  case op_add_f:
+    emit_add_sub(false, siaot_add_f);
+    break;
+  case op_sub_g:
+  case op_sub_f:
+    emit_add_sub(true, siaot_sub);
+    break;
+  case op_mul_g:
+  case op_mul_f:
+    emit_call(siaot_mul);
+    break;
+  case op_div_g:
+  case op_div_f:
+    emit_call(siaot_div);
+    break;
+  case op_mod_g:
+  case op_mod_f:
+    emit_call(siaot_mod);
+    break;
+  case op_not_g:
+  case op_not_b:
+    emit_call(siaot_not);
+    break;
+  case op_neg_g:
+  case op_neg_f:
+    emit_call(siaot_neg);
+    break;
+  // setl, setg, setle, setge
+  case op_lt_g:
+    emit_compare(0x9C, true, (uintptr_t) siaot_lt_g, -1);
+    break;
+  case op_lt_f:
+    emit_compare(0x9C, true, (uintptr_t) siaot_lt_f, -1);
+    break;
+  case op_gt_g:
+    emit_compare(0x9F, true, (uintptr_t) siaot_gt_g, -1);
+    break;
+  case op_gt_f:
+    emit_compare(0x9F, true, (uintptr_t) siaot_gt_f, -1);
+    break;
+  case op_le_g:
+    emit_compare(0x9E, true, (uintptr_t) siaot_le_g, -1);
+    break;
+  case op_le_f:
+    emit_compare(0x9E, true, (uintptr_t) siaot_le_f, -1);
+    break;
+  case op_ge_g:
+    emit_compare(0x9D, true, (uintptr_t) siaot_ge_g, -1);
+    break;
+  case op_ge_f:
+    emit_compare(0x9D, true, (uintptr_t) siaot_ge_f, -1);
+    break;
+  // integers are equal iff they are identical: sete, setne
+  case op_eq_g:
+  case op_eq_f:
+  case op_eq_b:
+    emit_compare(0x94, false, (uintptr_t) siaot_eq, false);
+    break;
+  case op_neq_g:
+  case op_neq_f:
+  case op_neq_b:
+    emit_compare(0x95, false, (uintptr_t) siaot_eq, true);
+    break;
+  case op_new_c: {
+    const address_t fn = ((const struct op_address *) instr)->address;
+    if (is_valid_function(fn)) {
+      emit_arg(0, fn);
+      emit_call(siaot_new_c);
+    } else {
+      emit_call(jit_invalid);
+    }
+    break;
+  }
+  case op_new_c_p:
+    emit_push(NANBOX_OFIFN_PRIMITIVE(((const struct op_oneindex *) instr)->index));
+    break;
+  case op_new_c_v:
+    emit_push(NANBOX_OFIFN_VM(((const struct op_oneindex *) instr)->index));
+    break;
+  case op_new_a:
+    emit_call(siaot_new_a);
+    break;
+  case op_ldl_g:
+  case op_ldl_f:
+  case op_ldl_b:
+    emit_ldl(((const struct op_oneindex *) instr)->index);
+    break;
+  case op_stl_g:
+  case op_stl_b:
+  case op_stl_f:
+    emit_stl(((const struct op_oneindex *) instr)->index);
+    break;
+  case op_ldp_g:
+  case op_ldp_f:
+  case op_ldp_b:
+    emit_arg(0, ((const struct op_twoindex *) instr)->index);
+    emit_arg(1, ((const struct op_twoindex *) instr)->envindex);
+    emit_call(siaot_ldp);
+    break;
+  case op_stp_g:
+  case op_stp_b:
+  case op_stp_f:
+    emit_arg(0, ((const struct op_twoindex *) instr)->index);
+    emit_arg(1, ((const struct op_twoindex *) instr)->envindex);
+    emit_call(siaot_stp);
+    break;
+  case op_lda_g:
+  case op_lda_b:
+  case op_lda_f:
+    emit_call(siaot_lda);
+    break;
+  case op_sta_g:
+  case op_sta_b:
+  case op_sta_f:
+    emit_call(siaot_sta);
+    break;
+  case op_br_t:
+  case op_br_f:
+    emit_branch(op == op_br_t, branch_target(addr));
+    break;
+  case op_br:
+  case op_jmp:
+    emit_jump(0, branch_target(addr));
+    break;
+  case op_call:
+  case op_call_t:
+    emit_arg(0, ((const struct op_call *) instr)->num_args);
+    emit_arg(1, op == op_call_t);
+    emit_call(siaot_call);
+    break;
+  case op_call_p:
+  case op_call_t_p:
+  case op_call_v:
+  case op_call_t_v:
+    emit_arg(0, ((const struct op_call_internal *) instr)->id);
+    emit_arg(1, ((const struct op_call_internal *) instr)->num_args);
+    emit_arg(2, op == op_call_p || op == op_call_t_p);
+    emit_arg(3, op == op_call_t_p || op == op_call_t_v);
+    emit_call(siaot_call_internal);
+    break;
+  case op_ret_g:
+  case op_ret_f:
+  case op_ret_b:
+    emit_call(siaot_ret);
+    break;
+  case op_ret_u:
+    emit_push(NANBOX_OFUNDEF());
+    emit_call(siaot_ret);
+    break;
+  case op_ret_n:
+    emit_push(NANBOX_OFNULL());
+    emit_call(siaot_ret);
+    break;
+  case op_dup:
+    emit_call(siaot_dup);
+    break;
+  case op_newenv:
+    emit_arg(0, ((const struct op_oneindex *) instr)->index);
+    emit_call(siaot_newenv);
+    break;
+  case op_popenv:
+    emit_call(siaot_popenv);
+    break;
+  }
+
+  // the frame is gone after a tail call or return
+  if (!falls_through(op) && op != op_br && op != op_jmp) {
+    emit_epilogue();
+  }
+}
+
+/**
+ * Compiles a function.
+ *
+ * Instructions are compiled in the order they are reached, with a jump
+ * wherever the next instruction to run has already been compiled.
+ */
+static void compile_function(function_t *fn) {
+  fn->offset = code_size;
+  jump_count = 0;
+  for (size_t i = 0; i < compiled_addr_count; ++i) {
+    instr_offsets[compiled_addrs[i]] = SIZE_MAX;
+  }
+  compiled_addr_count = 0;
+
+  emit_prologue();
+
+  // the start of each run of instructions still to be compiled
+  address_t *worklist = NULL;
+  size_t worklist_count = 0;
+  size_t worklist_capacity = 0;
+  if (grow((void **) &worklist, &worklist_capacity, worklist_count, sizeof(address_t))) {
+    worklist[worklist_count++] = fn->address + offsetof(svm_function_t, code);
+  }
+
+  while (worklist_count && !out_of_memory) {
+    address_t addr = worklist[--worklist_count];
+    while (true) {
+      if (instr_offsets[addr] != SIZE_MAX) {
+        emit_jump(0, addr);
+        break;
+      }
+      instr_offsets[addr] = code_size;
+      if (grow((void **) &compiled_addrs, &compiled_addr_capacity, compiled_addr_count, sizeof(address_t))) {
+        compiled_addrs[compiled_addr_count++] = addr;
+      }
+      emit_instr(addr);
+
+      const address_t size = instr_size(addr);
+      if (!size) {
+        break;
+      }
+
+      const opcode_t op = program[addr];
+      if (op == op_br || op == op_br_t || op == op_br_f || op == op_jmp) {
+        const address_t target = branch_target(addr);
+        if (target != INVALID_TARGET && instr_offsets[target] == SIZE_MAX
+          && grow((void **) &worklist, &worklist_capacity, worklist_count, sizeof(address_t))) {
+          worklist[worklist_count++] = target;
+        }
+      } else if (op == op_new_c) {
+        const address_t fn_addr = ((const struct op_address *) (program + addr))->address;
+        if (is_valid_function(fn_addr)) {
+          add_function(fn_addr);
+        }
+      }
+
+      if (!falls_through(op)) {
+        break;
+      }
+      addr += size;
+    }
+  }
+  free(worklist);
+
+  const size_t invalid_offset = code_size;
+  emit_call(jit_invalid);
+
+  if (out_of_memory) {
+    return;
+  }
+
+  for (size_t i = 0; i < jump_count; ++i) {
+    const size_t target = jumps[i].target == INVALID_TARGET ? invalid_offset : instr_offsets[jumps[i].target];
+    const uint32_t rel = (uint32_t) (target - (jumps[i].position + 4));
+    memcpy(code + jumps[i].position, &rel, sizeof(rel));
+  }
+}
+
+static int compare_functions(const void *a, const void *b) {
+  const address_t l = ((const siaot_function_t *) a)->address;
+  const address_t r = ((const siaot_function_t *) b)->address;
+  return (l > r) - (l < r);
+}
+
+static void release_compiled(void) {
+  if (compiled_code) {
+    munmap(compiled_code, compiled_size);
+    compiled_code = NULL;
+  }
+  free(compiled_functions);
+  compiled_functions = NULL;
+}
+
+const sinter_aot_program_t *sijit_compile(const unsigned char *prog, size_t prog_size) {
+  release_compiled();
+
+  const svm_header_t *header = (const svm_header_t *) prog;
+  if (prog_size < sizeof(svm_header_t) || prog_size >= UINT32_MAX || header->magic != SVM_MAGIC) {
+    return NULL;
+  }
+
+  program = prog;
+  program_size = (address_t) prog_size;
+  if (!is_valid_function(header->entry)) {
+    return NULL;
+  }
+
+  code_size = 0;
+  function_count = 0;
+  out_of_memory = false;
+  instr_offsets = malloc(((size_t) program_size + 1) * sizeof(size_t));
+  if (!instr_offsets) {
+    return NULL;
+  }
+  for (address_t i = 0; i <= program_size; ++i) {
+    instr_offsets[i] = SIZE_MAX;
+  }
+  compiled_addr_count = 0;
+
+  add_function(header->entry);
+  // functions are added to the list as they are found
+  for (size_t i = 0; i < function_count && !out_of_memory; ++i) {
+    compile_function(&functions[i]);
+  }
+  free(instr_offsets);
+  instr_offsets = NULL;
+
+  if (out_of_memory) {
+    SIDEBUG("Out of memory while compiling; interpreting instead\n");
+    return NULL;
+  }
+
+  // map the code writable first, then executable, so it is never both
+  void *mem = mmap(NULL, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    SIDEBUG("Failed to map memory for compiled code; interpreting instead\n");
+    return NULL;
+  }
+  memcpy(mem, code, code_size);
+  if (mprotect(mem, code_size, PROT_READ | PROT_EXEC)) {
+    SIDEBUG("Failed to make compiled code executable; interpreting instead\n");
+    munmap(mem, code_size);
+    return NULL;
+  }
+  compiled_code = mem;
+  compiled_size = code_size;
+
+  compiled_functions = malloc(function_count * sizeof(siaot_function_t));
+  if (!compiled_functions) {
+    release_compiled();
+    return NULL;
+  }
+  for (size_t i = 0; i < function_count; ++i) {
+    // ISO C does not allow casting an object pointer to a function pointer
+    const void *entry = (const unsigned char *) compiled_code + functions[i].offset;
+    compiled_functions[i].address = functions[i].address;
+    memcpy(&compiled_functions[i].fn, &entry, sizeof(entry));
+  }
+  qsort(compiled_functions, function_count, sizeof(siaot_function_t), compare_functions);
+
+  compiled_program = (sinter_aot_program_t) {
+    .program = prog,
+    .program_size = prog_size,
+    .functions = compiled_functions,
+    .function_count = function_count
+  };
+  return &compiled_program;
+}
+
+#endif
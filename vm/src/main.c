@@ -6,6 +6,11 @@
 #include <sinter/stack.h>
 #include <sinter/program.h>
 #include <sinter/vm.h>
+#include <sinter/verify.h>
+#include <sinter/aot.h>
+#include <sinter/jit.h>
+
+bool sinter_jit_enabled = false;
 
 /**
  * Validates the program header. Faults if it is invalid.
@@ -65,12 +70,13 @@ static void set_result(sinanbox_t exec_result, sinter_value_t *result) {
       result->object_value = exec_result.as_u32;
       break;
     case sitype_array:
+    case sitype_pair:
       result->type = sinter_type_array;
       result->object_value = exec_result.as_u32;
       break;
     case sitype_array_data:
     case sitype_empty:
-    case sitype_frame:
+    case sitype_code:
     case sitype_free:
     case sitype_env:
     default:
@@ -90,7 +96,11 @@ static void set_result(sinanbox_t exec_result, sinter_value_t *result) {
   }
 }
 
-sinter_fault_t sinter_run(const unsigned char *const code, const size_t code_size, sinter_value_t *result) {
+/**
+ * Runs the program in code, which is translated into C if aot is not NULL.
+ */
+static sinter_fault_t run_program(const unsigned char *const code, const size_t code_size,
+  const sinter_aot_program_t *const aot, sinter_value_t *result) {
 #ifndef SINTER_STATIC_HEAP
   if (!siheap) {
     SIDEBUG("Heap not yet initialised!\n");
@@ -104,6 +114,18 @@ sinter_fault_t sinter_run(const unsigned char *const code, const size_t code_siz
   sistate.running = true;
   sistate.pc = NULL;
   sistate.env = NULL;
+  sistate.aot = aot;
+#ifdef SINTER_COMPACT_HEAP
+  sistate.native_stack_base = 0;
+#endif
+  sinter_stats = (sinter_stats_t) { 0 };
+#ifdef SINTER_VERIFY
+  sistate.verified = false;
+#endif
+#ifdef SINTER_PREDECODE
+  sistate.code = NULL;
+  sistate.code_end = NULL;
+#endif
 
   if (SINTER_FAULTED()) {
     *result = (sinter_value_t) { 0 };
@@ -113,23 +135,62 @@ sinter_fault_t sinter_run(const unsigned char *const code, const size_t code_siz
   // Reset the heap and stack
   siheap_init();
   sistack_init();
+  memset(sienv_cache, 0, sizeof(sienv_cache));
 
   const svm_header_t *header = (const svm_header_t *) code;
   validate_header(header);
 
-  const svm_function_t *entry_fn = (const svm_function_t *) SISTATE_ADDRTOPC(header->entry);
+  const svm_function_t *entry_fn;
+  if (aot) {
+    // translated programs run on the SVML program itself
+    entry_fn = (const svm_function_t *) (code + header->entry);
+#ifdef SINTER_PREDECODE
+    sistate.code = sistate.program;
+    sistate.code_end = sistate.program_end;
+#endif
+  } else {
+#ifdef SINTER_VERIFY
+    sistate.verified = siverify_program();
+#endif
+
+#ifdef SINTER_PREDECODE
+    entry_fn = sidecode_program();
+#else
+    entry_fn = (const svm_function_t *) SISTATE_ADDRTOPC(header->entry);
+#endif
+  }
   sinanbox_t exec_result = siexec(entry_fn, NULL, 0, NULL);
   set_result(exec_result, result);
 
   return sinter_fault_none;
 }
 
+sinter_fault_t sinter_run(const unsigned char *const code, const size_t code_size, sinter_value_t *result) {
+#ifdef SINTER_JIT
+  if (sinter_jit_enabled) {
+    const sinter_aot_program_t *compiled = sijit_compile(code, code_size);
+    if (compiled) {
+      return run_program(code, code_size, compiled, result);
+    }
+  }
+#endif
+  return run_program(code, code_size, NULL, result);
+}
+
+sinter_fault_t sinter_run_aot(const sinter_aot_program_t *program, sinter_value_t *result) {
+  return run_program(program->program, program->program_size, program, result);
+}
+
 void sinter_setup_heap(void *heap, size_t size) {
 #ifdef SINTER_STATIC_HEAP
 (void) heap; (void) size;
 return;
 #else
-  siheap = heap;
-  siheap_size = size;
+  // objects must be aligned for SIHEAP_PTRTONANBOX, and beyond the largest
+  // heap, the offsets of objects do not fit in a NaN-box
+  const size_t skip = (size_t) -(uintptr_t) heap & (SIHEAP_ALIGN - 1);
+  size = size > skip ? size - skip : 0;
+  siheap = (unsigned char *) heap + skip;
+  siheap_size = size < SIHEAP_MAX_SIZE ? size : SIHEAP_MAX_SIZE;
 #endif
 }
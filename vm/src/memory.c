@@ -1,189 +1,1541 @@
 #include <sinter/config.h>
 
+#ifdef SINTER_COMPACT_HEAP
+#include <setjmp.h>
+#endif
 #include <string.h>
+#ifdef SINTER_STACK_SEGMENTS
+#include <stdlib.h>
+#endif
+
+#include <sinter/heap.h>
+#include <sinter/heap_obj.h>
+#include <sinter/stack.h>
+#include <sinter/vm.h>
+#include <sinter/nanbox.h>
+
+#ifdef SINTER_STATIC_HEAP
+_Static_assert(SINTER_HEAP_SIZE <= SIHEAP_MAX_SIZE, "SINTER_HEAP_SIZE too large to address");
+_Alignas(8) unsigned char siheap[SINTER_HEAP_SIZE] = { 0 };
+#else
+unsigned char *siheap = NULL;
+size_t siheap_size = 0;
+#endif
+
+#ifdef SINTER_DEBUG
+bool siheap_sweeping = 0;
+#endif
+
+siheap_free_t *siheap_free_lists[SIHEAP_CLASSES] = { 0 };
+uint32_t siheap_free_small_map = 0;
+uint32_t siheap_free_large_map = 0;
+
+sinanbox_t sistack[SINTER_STACK_ENTRIES];
+
+sinanbox_t *sistack_bottom = sistack;
+sinanbox_t *sistack_limit = sistack;
+sinanbox_t *sistack_top = sistack;
+
+siframe_t siframes[SINTER_FRAME_ENTRIES];
+siframe_t *siframes_top = siframes;
+
+sistack_segment_t sistack_bottom_segment = {
+  NULL, NULL, NULL, NULL,
+  sistack, sistack + SINTER_STACK_ENTRIES,
+  siframes, siframes + SINTER_FRAME_ENTRIES
+};
+sistack_segment_t *sistack_segment = &sistack_bottom_segment;
+
+siheap_env_t *sienv_cache[SIENV_CACHE_SIZES];
+
+#ifdef SINTER_PREDECODE
+_Alignas(siheap_env_t) unsigned char sienvstack[SINTER_ENV_STACK_SIZE];
+unsigned char *sienvstack_top = sienvstack;
+#endif
+
+#ifdef SINTER_CYCLE_BUDGET
+siheap_header_t *siheap_cycle_roots[SINTER_CYCLE_ROOTS];
+size_t siheap_cycle_root_count = 0;
+bool siheap_cycle_collecting = false;
+
+void siheap_possible_root(siheap_header_t *ent) {
+  if (siheap_cycle_root_count == SINTER_CYCLE_ROOTS) {
+    return;
+  }
+  switch (ent->type) {
+  case sitype_env:
+  case sitype_function:
+  case sitype_array:
+  case sitype_pair:
+    break;
+  case sitype_intcont:
+    if (((siheap_intcont_t *) ent)->argc > 0) {
+      break;
+    }
+    return;
+  case sitype_strconst:
+  case sitype_strpair:
+  case sitype_string:
+  case sitype_array_data:
+  case sitype_code:
+  case sitype_empty:
+  case sitype_free:
+  default:
+    // cannot be part of a cycle
+    return;
+  }
+
+  ent->flag_buffered = true;
+  siheap_cycle_roots[siheap_cycle_root_count++] = ent;
+  if (siheap_cycle_root_count == SINTER_CYCLE_ROOTS) {
+    siheap_cycle_collecting = true;
+  }
+}
+
+/**
+ * Removes the given object from the candidate buffer, if it is in it.
+ */
+static void cycle_forget(siheap_header_t *ent) {
+  if (!ent->flag_buffered) {
+    return;
+  }
+  ent->flag_buffered = false;
+  for (size_t i = 0; i < siheap_cycle_root_count; ++i) {
+    if (siheap_cycle_roots[i] == ent) {
+      siheap_cycle_roots[i] = siheap_cycle_roots[--siheap_cycle_root_count];
+      return;
+    }
+  }
+  assert(false);
+}
+#endif
+
+/*
+ * Objects are destroyed without recursing on the C stack, which would
+ * otherwise nest once per cell when the last reference to a long list is
+ * dropped.
+ *
+ * An object is destroyed by taking its children out one at a time and
+ * dereferencing them. When a child dies, the object is suspended, and the child
+ * is destroyed first. Suspended objects form a stack, siheap_dying, which is
+ * threaded through the objects themselves: the first child taken out of an
+ * object frees a slot, which then holds the next object on the stack. Objects
+ * on the stack have flag_destroying set, so that references to them from
+ * their descendants (i.e. cycles) are ignored.
+ *
+ * If SINTER_FREE_BUDGET is set, objects are only pushed onto the stack when
+ * they die, and at most SINTER_FREE_BUDGET objects are freed at each
+ * allocation.
+ */
+siheap_header_t *siheap_dying = NULL;
+
+#ifdef SINTER_SWEEP_BUDGET
+/**
+ * The dead object whose children dying_hollow is destroying, if any.
+ */
+static siheap_header_t *dying_hollowing = NULL;
+#endif
+
+static sinanbox_t dying_tobox(siheap_header_t *obj) {
+  return obj ? SIHEAP_PTRTONANBOX(obj) : NANBOX_OFNULL();
+}
+
+static siheap_header_t *dying_frombox(sinanbox_t v) {
+  return NANBOX_ISPTR(v) ? (siheap_header_t *) SIHEAP_NANBOXTOPTR(v) : NULL;
+}
+
+static bool dying_has_children(siheap_header_t *ent) {
+  switch (ent->type) {
+  case sitype_env:
+  case sitype_strpair:
+  case sitype_array:
+  case sitype_pair:
+  case sitype_function:
+    return true;
+  case sitype_intcont:
+    return ((siheap_intcont_t *) ent)->argc > 0;
+  case sitype_code:
+    return ((siheap_code_t *) ent)->string_count > 0;
+  case sitype_array_data:
+  case sitype_strconst:
+  case sitype_string:
+    return false;
+  default:
+  case sitype_empty:
+  case sitype_free:
+    SIBUGV("Attempting to destroy object of type %d\n", ent->type);
+    assert(false);
+    return false;
+  }
+}
+
+/**
+ * Starts destroying the given object: takes its first child out, and stores
+ * the link to the next dying object in its place.
+ *
+ * Returns the child, or NULL if there is none.
+ */
+static siheap_header_t *dying_begin(siheap_header_t *ent, siheap_header_t *next) {
+  siheap_header_t *child = NULL;
+  switch (ent->type) {
+  case sitype_env: {
+    siheap_env_t *env = (siheap_env_t *) ent;
+    child = (siheap_header_t *) env->parent;
+    env->parent = (siheap_env_t *) next;
+    break;
+  }
+  case sitype_strpair: {
+    siheap_strpair_t *obj = (siheap_strpair_t *) ent;
+    child = obj->right;
+    obj->right = next;
+    break;
+  }
+  case sitype_array:
+    ((siheap_array_t *) ent)->count = dying_tobox(next).as_u32;
+    break;
+  case sitype_pair: {
+    siheap_pair_t *pair = (siheap_pair_t *) ent;
+    child = dying_frombox(pair->data[0]);
+    pair->data[0] = dying_tobox(next);
+    break;
+  }
+  case sitype_function: {
+    siheap_function_t *fn = (siheap_function_t *) ent;
+    child = (siheap_header_t *) fn->env;
+    fn->env = (siheap_env_t *) next;
+    break;
+  }
+  case sitype_intcont: {
+    siheap_intcont_t *ic = (siheap_intcont_t *) ent;
+    child = dying_frombox(ic->argv[0]);
+    ic->argv[0] = dying_tobox(next);
+    break;
+  }
+  case sitype_code: {
+    siheap_code_t *c = (siheap_code_t *) ent;
+    child = dying_frombox(c->strings[0]);
+    c->strings[0] = dying_tobox(next);
+    break;
+  }
+  case sitype_array_data:
+  case sitype_strconst:
+  case sitype_string:
+  default:
+  case sitype_empty:
+  case sitype_free:
+    SIBUGV("Attempting to destroy object of type %d\n", ent->type);
+    assert(false);
+    break;
+  }
+  return child;
+}
+
+/**
+ * Takes the next child out of a dying object.
+ *
+ * Returns the child, or NULL if there are none left.
+ */
+static siheap_header_t *dying_take(siheap_header_t *ent) {
+  siheap_header_t *child = NULL;
+  switch (ent->type) {
+  case sitype_env: {
+    siheap_env_t *env = (siheap_env_t *) ent;
+    while (!child && env->entry_count) {
+      child = dying_frombox(env->entry[--env->entry_count]);
+    }
+    break;
+  }
+  case sitype_strpair: {
+    siheap_strpair_t *obj = (siheap_strpair_t *) ent;
+    child = obj->left;
+    obj->left = NULL;
+    break;
+  }
+  case sitype_array: {
+    siheap_array_t *array = (siheap_array_t *) ent;
+    sinanbox_t *data = siarray_data(array);
+    while (!child && array->alloc_size) {
+      child = dying_frombox(data[--array->alloc_size]);
+    }
+    if (!child && array->data) {
+      child = &array->data->header;
+      array->data = NULL;
+    }
+    break;
+  }
+  case sitype_pair: {
+    siheap_pair_t *pair = (siheap_pair_t *) ent;
+    child = dying_frombox(pair->data[1]);
+    pair->data[1] = NANBOX_OFUNDEF();
+    break;
+  }
+  case sitype_intcont: {
+    siheap_intcont_t *ic = (siheap_intcont_t *) ent;
+    while (!child && ic->argc > 1) {
+      child = dying_frombox(ic->argv[--ic->argc]);
+    }
+    break;
+  }
+  case sitype_code: {
+    siheap_code_t *c = (siheap_code_t *) ent;
+    while (!child && c->string_count > 1) {
+      child = dying_frombox(c->strings[--c->string_count]);
+    }
+    break;
+  }
+  case sitype_function:
+  case sitype_array_data:
+  case sitype_strconst:
+  case sitype_string:
+  default:
+  case sitype_empty:
+  case sitype_free:
+    break;
+  }
+  return child;
+}
+
+/**
+ * Returns the dying object below the given one on the stack.
+ */
+static siheap_header_t *dying_next(siheap_header_t *ent) {
+  switch (ent->type) {
+  case sitype_env:
+    return (siheap_header_t *) ((siheap_env_t *) ent)->parent;
+  case sitype_strpair:
+    return ((siheap_strpair_t *) ent)->right;
+  case sitype_array:
+    return dying_frombox(NANBOX_WITH_I32(((siheap_array_t *) ent)->count));
+  case sitype_pair:
+    return dying_frombox(((siheap_pair_t *) ent)->data[0]);
+  case sitype_function:
+    return (siheap_header_t *) ((siheap_function_t *) ent)->env;
+  case sitype_intcont:
+    return dying_frombox(((siheap_intcont_t *) ent)->argv[0]);
+  case sitype_code:
+    return dying_frombox(((siheap_code_t *) ent)->strings[0]);
+  case sitype_array_data:
+  case sitype_strconst:
+  case sitype_string:
+  default:
+  case sitype_empty:
+  case sitype_free:
+    SIBUGV("Attempting to destroy object of type %d\n", ent->type);
+    assert(false);
+    return NULL;
+  }
+}
+
+/**
+ * Dereferences a child taken out of a dying object. If the child dies, and
+ * has no children of its own, it is freed immediately.
+ *
+ * Returns the child if it died and has yet to be destroyed, or NULL.
+ */
+static siheap_header_t *dying_deref(siheap_header_t *child, size_t *budget) {
+  if (child->flag_destroying) {
+    // this object is in a cycle
+#ifdef SINTER_SWEEP_BUDGET
+    if (child == dying_hollowing && !siheap_refcount_stuck(child)) {
+      // the object outlives its destruction, so the reference is gone for good
+      child->refcount -= 1;
+    }
+#endif
+    return NULL;
+  }
+#ifdef SINTER_DEBUG
+  assert(child->refcount > 0 || siheap_sweeping);
+  assert(child->type != sitype_free || siheap_sweeping);
+#endif
+  if (!child->refcount || siheap_refcount_stuck(child)) {
+    return NULL;
+  }
+  child->refcount -= 1;
+  if (child->type == sitype_free) {
+    return NULL;
+  }
+  if (child->refcount) {
+#ifdef SINTER_CYCLE_BUDGET
+    if (!child->flag_buffered) {
+      siheap_possible_root(child);
+    }
+#endif
+    return NULL;
+  }
+  if (dying_has_children(child)) {
+    return child;
+  }
+  siheap_mfree_inner(child);
+  if (*budget) {
+    --*budget;
+  }
+  return NULL;
+}
+
+/**
+ * Pushes a dead object onto the dying stack, followed by its first child, and
+ * so on, as long as they die.
+ */
+static void dying_push(siheap_header_t *ent, size_t *budget) {
+  while (ent) {
+#ifdef SINTER_CYCLE_BUDGET
+    cycle_forget(ent);
+#endif
+    ent->flag_destroying = true;
+    siheap_header_t *child = dying_begin(ent, siheap_dying);
+    siheap_dying = ent;
+    ent = child ? dying_deref(child, budget) : NULL;
+  }
+}
+
+/**
+ * Destroys and frees dying objects until the stack is back down to stop, or
+ * the budget is spent. If keep is reached once it has no children left, it is
+ * left on top of the stack without being freed.
+ *
+ * Returns the block that the last object freed was merged into, or NULL if
+ * no object was freed.
+ */
+static siheap_header_t *dying_run(siheap_header_t *stop, siheap_header_t *keep, size_t *budget) {
+  siheap_header_t *merged = NULL;
+  while (siheap_dying != stop && *budget) {
+    siheap_header_t *const top = siheap_dying;
+    siheap_header_t *const child = dying_take(top);
+    if (child) {
+      dying_push(dying_deref(child, budget), budget);
+    } else if (top == keep) {
+      break;
+    } else {
+      siheap_dying = dying_next(top);
+      merged = siheap_mfree_inner(top);
+      --*budget;
+    }
+  }
+  return merged;
+}
+
+siheap_header_t *siheap_release(siheap_header_t *ent) {
+  if (!dying_has_children(ent)) {
+    return siheap_mfree_inner(ent);
+  }
+
+  siheap_header_t *const stop = siheap_dying;
+  size_t budget = SIZE_MAX;
+  dying_push(ent, &budget);
+  return dying_run(stop, NULL, &budget);
+}
+
+#ifdef SINTER_FREE_BUDGET
+void siheap_release_later(siheap_header_t *ent) {
+  if (!dying_has_children(ent)) {
+    siheap_mfree_inner(ent);
+    return;
+  }
+
+  size_t budget = SIZE_MAX;
+  dying_push(ent, &budget);
+}
+
+void siheap_release_pending(size_t budget) {
+  dying_run(NULL, NULL, &budget);
+}
+#endif
+
+#ifdef SINTER_SWEEP_BUDGET
+/**
+ * Clears the link to the next dying object out of a destroyed object, which
+ * leaves it with no children.
+ */
+static void dying_unlink(siheap_header_t *ent) {
+  switch (ent->type) {
+  case sitype_env: {
+    siheap_env_t *env = (siheap_env_t *) ent;
+    env->parent = NULL;
+#ifdef SINTER_ENV_DISPLAY
+    env->display_count = 0;
+#endif
+    break;
+  }
+  case sitype_strpair:
+    ((siheap_strpair_t *) ent)->right = NULL;
+    break;
+  case sitype_array:
+    ((siheap_array_t *) ent)->count = 0;
+    break;
+  case sitype_pair:
+    ((siheap_pair_t *) ent)->data[0] = NANBOX_OFNULL();
+    break;
+  case sitype_function:
+    ((siheap_function_t *) ent)->env = NULL;
+    break;
+  case sitype_intcont:
+    ((siheap_intcont_t *) ent)->argc = 0;
+    break;
+  case sitype_code:
+    ((siheap_code_t *) ent)->string_count = 0;
+    break;
+  case sitype_array_data:
+  case sitype_strconst:
+  case sitype_string:
+  default:
+  case sitype_empty:
+  case sitype_free:
+    break;
+  }
+}
+
+/**
+ * Destroys the children of a dead object, but only frees the object itself if
+ * nothing refers to it any more. Otherwise, the object is left allocated, with
+ * no children, for the dead objects that still refer to it to dereference, and
+ * it is freed when the last of them does.
+ *
+ * Returns the block that the object was merged into, or NULL if it was kept.
+ */
+static siheap_header_t *dying_hollow(siheap_header_t *ent) {
+  if (dying_has_children(ent)) {
+    siheap_header_t *const stop = siheap_dying;
+    size_t budget = SIZE_MAX;
+    dying_hollowing = ent;
+    dying_push(ent, &budget);
+    dying_run(stop, ent, &budget);
+    dying_hollowing = NULL;
+    siheap_dying = stop;
+    dying_unlink(ent);
+  }
+
+  if (!ent->refcount) {
+    return siheap_mfree_inner(ent);
+  }
+  // a stuck count never drops to zero, so the object is freed by the next
+  // sweep instead, by when nothing refers to it
+  ent->flag_destroying = siheap_refcount_stuck(ent);
+  // unmarked once the sweep ends
+  siheap_setmarked(ent, true);
+  return NULL;
+}
+#endif
+
+/*
+ * Marking uses an explicit stack of objects that have been marked, but whose
+ * children have not been marked yet, so that it does not recurse on the C
+ * stack. The mark stack has a fixed size, as marking runs when the heap is
+ * full. If it overflows, the object is only marked, and the heap is rescanned
+ * for marked objects after the mark stack is drained.
+ */
+static siheap_header_t *mark_stack[SINTER_MARK_STACK_ENTRIES];
+static size_t mark_stack_size = 0;
+static bool mark_stack_overflowed = false;
+
+static void siheap_mark(siheap_header_t *vent) {
+  if (!SIHEAP_INRANGE(vent) || ((unsigned char *) vent) < siheap || siheap_ismarked(vent)) {
+    return;
+  }
+
+#if SINTER_DEBUG_LOGLEVEL >= 2
+  SIDEBUG("Marking object ");
+  SIDEBUG_HEAPOBJ(vent);
+  SIDEBUG("\n");
+#endif
+
+  // object is unmarked; mark it
+  siheap_setmarked(vent, true);
+
+  if (vent->type == sitype_array_data || vent->type == sitype_strconst || vent->type == sitype_string) {
+    // These types have no children, no need to push them
+    return;
+  }
+
+  if (mark_stack_size < SINTER_MARK_STACK_ENTRIES) {
+    mark_stack[mark_stack_size++] = vent;
+  } else {
+    mark_stack_overflowed = true;
+  }
+}
+
+static inline void siheap_markbox(sinanbox_t ent) {
+  if (NANBOX_ISPTR(ent)) {
+    siheap_mark(SIHEAP_NANBOXTOPTR(ent));
+  }
+}
+
+static void siheap_mark_children(siheap_header_t *vent) {
+  switch (vent->type) {
+  case sitype_function:
+    siheap_mark(&((siheap_function_t *) vent)->env->header);
+    break;
+  case sitype_env: {
+    siheap_env_t *env = (siheap_env_t *) vent;
+    for (size_t i = 0; i < env->entry_count; i++) {
+      siheap_markbox(env->entry[i]);
+    }
+    siheap_mark(&env->parent->header);
+    break;
+  }
+  case sitype_array: {
+    siheap_array_t *a = (siheap_array_t *) vent;
+    sinanbox_t *data = siarray_data(a);
+    for (address_t i = 0; i < a->count; ++i) {
+      siheap_markbox(data[i]);
+    }
+    if (a->data) {
+      siheap_mark(&a->data->header);
+    }
+    break;
+  }
+  case sitype_pair: {
+    siheap_pair_t *p = (siheap_pair_t *) vent;
+    siheap_markbox(p->data[0]);
+    siheap_markbox(p->data[1]);
+    break;
+  }
+  case sitype_intcont: {
+    siheap_intcont_t *a = (siheap_intcont_t *) vent;
+    for (address_t i = 0; i < a->argc; ++i) {
+      siheap_markbox(a->argv[i]);
+    }
+    break;
+  }
+  case sitype_strpair: {
+    siheap_strpair_t *a = (siheap_strpair_t *) vent;
+    siheap_mark(a->left);
+    if (a->right) {
+      siheap_mark(a->right);
+    }
+    break;
+  }
+  case sitype_code: {
+    siheap_code_t *c = (siheap_code_t *) vent;
+    for (address_t i = 0; i < c->string_count; ++i) {
+      siheap_markbox(c->strings[i]);
+    }
+    break;
+  }
+  case sitype_array_data:
+  case sitype_strconst:
+  case sitype_string:
+    // These types have no children, no need to do anything
+    break;
+  case sitype_free:
+    SIBUGM("Attempting to mark free block\n");
+    break;
+  case sitype_empty:
+  default:
+    SIBUGV("Unknown type %d\n", vent->type);
+    break;
+  }
+}
+
+static void siheap_mark_drain(void) {
+  while (mark_stack_size) {
+    siheap_mark_children(mark_stack[--mark_stack_size]);
+  }
+}
+
+/**
+ * Marks everything reachable from the given object.
+ */
+static void siheap_mark_from(siheap_header_t *vent) {
+  siheap_mark(vent);
+  siheap_mark_drain();
+
+  while (mark_stack_overflowed) {
+    mark_stack_overflowed = false;
+    for (siheap_header_t *curr = (siheap_header_t *) siheap; SIHEAP_INRANGE(curr); curr = siheap_next(curr)) {
+      if (siheap_ismarked(curr) && curr->type != sitype_free) {
+        siheap_mark_children(curr);
+        siheap_mark_drain();
+      }
+    }
+  }
+}
+
+#ifdef SINTER_SWEEP_BUDGET
+/*
+ * With SINTER_SWEEP_BUDGET, the heap is swept lazily: after marking, each
+ * allocation sweeps up to SINTER_SWEEP_BUDGET blocks from the sweep cursor,
+ * stopping early once it frees a block that fits, and an allocation that finds
+ * no block sweeps until one fits.
+ *
+ * The marks are not cleared as the sweep goes. Instead, flag_marked means
+ * marked if it equals siheap_mark_epoch, which is flipped when the sweep
+ * reaches the end of the heap, unmarking every object at once. Objects
+ * allocated while the sweep is in progress are marked, so that they survive
+ * it.
+ *
+ * Unlike the eager sweep, the lazy sweep cannot free a dead object that other
+ * dead objects still refer to, as its memory may be reused before they are
+ * swept and dereference it. Instead, the children of a dead object are
+ * destroyed as usual, but the object itself is only freed if its reference
+ * count is zero. Otherwise it is left allocated with no children (see
+ * dying_hollow), and freed by the dereference from the last dead object that
+ * refers to it. The reference counts of dead objects stay exact, so every
+ * dead object is freed by the end of the sweep, except for those with a stuck
+ * count, which are freed by the next sweep.
+ */
+bool siheap_mark_epoch = true;
+siheap_header_t *siheap_sweep_cursor = NULL;
+
+void siheap_sweep_lazily(address_t size, size_t budget) {
+  siheap_header_t *curr = siheap_sweep_cursor;
+  for (; SIHEAP_INRANGE(curr) && budget; --budget) {
+    if (curr->type == sitype_free || siheap_ismarked(curr)) {
+      curr = siheap_next(curr);
+      continue;
+    }
+#if SINTER_DEBUG_LOGLEVEL >= 2
+    SIDEBUG("Sweeping object ");
+    SIDEBUG_HEAPOBJ(curr);
+    SIDEBUG("\n");
+#endif
+    assert(!curr->flag_buffered);
+    siheap_header_t *merged;
+    if (curr->flag_destroying) {
+      // left by the last sweep, and already destroyed
+      merged = siheap_mfree_inner(curr);
+    } else if (!(merged = dying_hollow(curr))) {
+      curr = siheap_next(curr);
+      continue;
+    }
+    curr = siheap_next(merged);
+    if (merged->size >= size) {
+      break;
+    }
+  }
+
+  if (SIHEAP_INRANGE(curr)) {
+    siheap_sweep_cursor = curr;
+  } else {
+    siheap_sweep_cursor = NULL;
+    siheap_mark_epoch = !siheap_mark_epoch;
+  }
+}
+#else
+static inline void siheap_sweep(void) {
+#ifdef SINTER_DEBUG
+  siheap_sweeping = 1;
+#endif
+  siheap_header_t *curr = (siheap_header_t *) siheap;
+  while (SIHEAP_INRANGE(curr)) {
+    if (!curr->flag_marked && curr->type != sitype_free) {
+      curr->refcount = 0;
+#if SINTER_DEBUG_LOGLEVEL >= 2
+      SIDEBUG("Sweeping object ");
+      SIDEBUG_HEAPOBJ(curr);
+      SIDEBUG("\n");
+#endif
+      curr = siheap_mfree(curr);
+    } else {
+      curr->flag_marked = false;
+    }
+    curr = siheap_next(curr);
+  }
+#ifdef SINTER_DEBUG
+  siheap_sweeping = 0;
+#endif
+}
+#endif
+
+void siheap_mark_sweep(void) {
+#ifdef SINTER_SWEEP_BUDGET
+   // the marks of the last collection stay set until its sweep ends
+   while (siheap_sweep_cursor) {
+     siheap_sweep_lazily(SINTER_HEAP_SIZE, SIZE_MAX);
+   }
+#endif
+#ifdef SINTER_FREE_BUDGET
+   // the dying stack is threaded through objects that may be marked
+   siheap_release_pending(SIZE_MAX);
+#endif
+#ifdef SINTER_CYCLE_BUDGET
+   // any garbage cycles are swept too
+   for (size_t i = 0; i < siheap_cycle_root_count; ++i) {
+     siheap_cycle_roots[i]->flag_buffered = false;
+   }
+   siheap_cycle_root_count = 0;
+   siheap_cycle_collecting = false;
+#endif
+   // the cache holds the only reference to its environments, and they have no
+   // children, so they are freed here rather than left for a (lazy) sweep,
+   // which would not free them while the cache's reference remains
+   for (size_t i = 0; i < SIENV_CACHE_SIZES; ++i) {
+     siheap_env_t *const env = sienv_cache[i];
+     if (env) {
+       sienv_cache[i] = NULL;
+       env->header.refcount = 0;
+       siheap_mfree(&env->header);
+     }
+   }
+   for (const sistack_segment_t *segment = sistack_segment; segment; segment = segment->below) {
+     sinanbox_t *curr = sistack_segment_top(segment) - 1;
+     while (curr >= segment->stack) {
+        sinanbox_t v = *(curr--);
+        if (NANBOX_ISPTR(v)) {
+          siheap_mark_from(SIHEAP_NANBOXTOPTR(v));
+        }
+     }
+     for (siframe_t *frame = segment->frames; frame < siframes_segment_top(segment); ++frame) {
+       siheap_mark_from(&frame->saved_env->header);
+     }
+   }
+   siheap_mark_from(&sistate.env->header);
+#ifdef SINTER_PREDECODE
+   for (unsigned char *at = sienvstack; at < sienvstack_top; at += ((siheap_header_t *) at)->size) {
+     siheap_env_t *const env = (siheap_env_t *) at;
+     if (env->header.type != sitype_env) {
+       continue;
+     }
+     for (size_t i = 0; i < env->entry_count; ++i) {
+       if (NANBOX_ISPTR(env->entry[i])) {
+         siheap_mark_from(SIHEAP_NANBOXTOPTR(env->entry[i]));
+       }
+     }
+     // this ignores parents on the environment stack
+     siheap_mark_from(&env->parent->header);
+   }
+#endif
+#ifdef SINTER_PREDECODE
+   if (sistate.code && !sistate.aot) {
+     // the decoded program is always live
+     siheap_mark_from((siheap_header_t *) (sistate.code - offsetof(siheap_code_t, code)));
+   }
+#endif
+#ifdef SINTER_SWEEP_BUDGET
+   siheap_sweep_cursor = (siheap_header_t *) siheap;
+#else
+   siheap_sweep();
+#endif
+}
+
+#ifdef SINTER_CYCLE_BUDGET
+/*
+ * Garbage cycles are collected by trial deletion (Bacon and Rajan's
+ * synchronous cycle collector), so that they do not have to wait for the heap
+ * to fill up and a mark-and-sweep to run.
+ *
+ * When the reference count of an object that can be part of a cycle drops to a
+ * non-zero value, the object may have just become cyclic garbage, so it is
+ * buffered as a candidate root (siheap_possible_root). Objects are forgotten
+ * when they die. Once the buffer fills up, up to SINTER_CYCLE_BUDGET
+ * candidates are processed at each allocation, until the buffer is empty. All
+ * remaining candidates are processed before a mark-and-sweep.
+ *
+ * Each batch of candidates is processed in three passes over the objects
+ * reachable from them:
+ *
+ * - mark gray: colour the objects gray, and take the references between them
+ *   out of their reference counts. What is left counts references from outside
+ *   the subgraph.
+ * - scan: colour the gray objects that are still referenced from outside, and
+ *   everything reachable from them, black again, and restore their reference
+ *   counts. The other gray objects are only referenced by each other, and
+ *   become white.
+ * - collect white: free the white objects.
+ *
+ * The passes use the mark stack. If it overflows, the object is flagged
+ * pending, and the heap is rescanned for pending objects once the stack is
+ * empty, as when marking. In the scan pass, a black object is pending until
+ * the reference counts of its children are restored; in the collect pass, a
+ * white object is pending until it is linked into the list of objects to free
+ * (through its first word after the header).
+ */
+typedef void (*cycle_visit_t)(siheap_header_t *ent);
+
+static void cycle_visit_box(sinanbox_t v, cycle_visit_t visit) {
+  if (NANBOX_ISPTR(v)) {
+    visit(SIHEAP_NANBOXTOPTR(v));
+  }
+}
+
+/**
+ * Visits the children that the given object holds a reference to, i.e. those
+ * that are dereferenced when it is destroyed.
+ */
+static void cycle_children(siheap_header_t *ent, cycle_visit_t visit) {
+  switch (ent->type) {
+  case sitype_env: {
+    siheap_env_t *env = (siheap_env_t *) ent;
+    for (size_t i = 0; i < env->entry_count; ++i) {
+      cycle_visit_box(env->entry[i], visit);
+    }
+    if (env->parent) {
+      visit(&env->parent->header);
+    }
+    break;
+  }
+  case sitype_function: {
+    siheap_function_t *fn = (siheap_function_t *) ent;
+    if (fn->env) {
+      visit(&fn->env->header);
+    }
+    break;
+  }
+  case sitype_array: {
+    siheap_array_t *a = (siheap_array_t *) ent;
+    sinanbox_t *data = siarray_data(a);
+    for (address_t i = 0; i < a->alloc_size; ++i) {
+      cycle_visit_box(data[i], visit);
+    }
+    if (a->data) {
+      visit(&a->data->header);
+    }
+    break;
+  }
+  case sitype_pair: {
+    siheap_pair_t *p = (siheap_pair_t *) ent;
+    cycle_visit_box(p->data[0], visit);
+    cycle_visit_box(p->data[1], visit);
+    break;
+  }
+  case sitype_intcont: {
+    siheap_intcont_t *ic = (siheap_intcont_t *) ent;
+    for (address_t i = 0; i < ic->argc; ++i) {
+      cycle_visit_box(ic->argv[i], visit);
+    }
+    break;
+  }
+  case sitype_strpair: {
+    siheap_strpair_t *obj = (siheap_strpair_t *) ent;
+    visit(obj->left);
+    if (obj->right) {
+      visit(obj->right);
+    }
+    break;
+  }
+  case sitype_code: {
+    siheap_code_t *c = (siheap_code_t *) ent;
+    for (address_t i = 0; i < c->string_count; ++i) {
+      cycle_visit_box(c->strings[i], visit);
+    }
+    break;
+  }
+  case sitype_array_data:
+  case sitype_strconst:
+  case sitype_string:
+    break;
+  case sitype_free:
+  case sitype_empty:
+  default:
+    SIBUGV("Unknown type %d\n", ent->type);
+    assert(false);
+    break;
+  }
+}
 
-#include <sinter/heap.h>
-#include <sinter/heap_obj.h>
-#include <sinter/stack.h>
-#include <sinter/vm.h>
-#include <sinter/nanbox.h>
+static void cycle_push(siheap_header_t *ent) {
+  if (mark_stack_size < SINTER_MARK_STACK_ENTRIES) {
+    mark_stack[mark_stack_size++] = ent;
+  } else {
+    ent->flag_pending = true;
+    mark_stack_overflowed = true;
+  }
+}
 
-#ifdef SINTER_STATIC_HEAP
-unsigned char siheap[SINTER_HEAP_SIZE] = { 0 };
-#else
-unsigned char *siheap = NULL;
-size_t siheap_size = 0;
-#endif
+/**
+ * Processes the given roots, and then everything pushed onto the mark stack.
+ */
+static void cycle_pass(siheap_header_t **roots, size_t count, cycle_visit_t process) {
+  for (size_t i = 0; i < count; ++i) {
+    process(roots[i]);
+  }
+  while (mark_stack_size) {
+    process(mark_stack[--mark_stack_size]);
+  }
 
-#ifdef SINTER_DEBUG
-bool siheap_sweeping = 0;
-#endif
+  while (mark_stack_overflowed) {
+    mark_stack_overflowed = false;
+    for (siheap_header_t *curr = (siheap_header_t *) siheap; SIHEAP_INRANGE(curr); curr = siheap_next(curr)) {
+      if (curr->flag_pending && curr->type != sitype_free) {
+        process(curr);
+        while (mark_stack_size) {
+          process(mark_stack[--mark_stack_size]);
+        }
+      }
+    }
+  }
+}
 
-siheap_free_t *siheap_first_free = NULL;
+static void cycle_gray_child(siheap_header_t *child) {
+  assert(child->refcount > 0);
+  if (!siheap_refcount_stuck(child)) {
+    child->refcount -= 1;
+  }
+  if (!child->flag_gray) {
+    cycle_push(child);
+  }
+}
 
-sinanbox_t sistack[SINTER_STACK_ENTRIES];
+static void cycle_mark_gray(siheap_header_t *ent) {
+  ent->flag_pending = false;
+  if (ent->flag_gray) {
+    return;
+  }
+  ent->flag_gray = true;
+  cycle_children(ent, cycle_gray_child);
+}
 
-sinanbox_t *sistack_bottom = sistack;
-sinanbox_t *sistack_limit = sistack;
-sinanbox_t *sistack_top = sistack;
+static void cycle_black_child(siheap_header_t *child) {
+  if (!siheap_refcount_stuck(child)) {
+    child->refcount += 1;
+  }
+  if (child->flag_gray || child->flag_white) {
+    child->flag_gray = child->flag_white = false;
+    child->flag_pending = true;
+    cycle_push(child);
+  }
+}
 
-/**
- * Runs the destructor for the given heap object.
+static void cycle_scan_child(siheap_header_t *child) {
+  if (child->flag_gray) {
+    cycle_push(child);
+  }
+}
+
+static void cycle_scan(siheap_header_t *ent) {
+  if (ent->flag_gray) {
+    ent->flag_gray = false;
+    ent->flag_pending = false;
+    if (!ent->refcount) {
+      ent->flag_white = true;
+      cycle_children(ent, cycle_scan_child);
+      return;
+    }
+  } else if (!ent->flag_pending) {
+    // white, or black with its children's counts already restored
+    return;
+  }
+
+  // this object is black
+  ent->flag_pending = false;
+  cycle_children(ent, cycle_black_child);
+}
+
+static siheap_header_t *cycle_garbage = NULL;
+
+static void cycle_collect_child(siheap_header_t *child) {
+  if (child->flag_white) {
+    child->flag_white = false;
+    child->flag_pending = true;
+    cycle_push(child);
+  }
+}
+
+static void cycle_collect_white(siheap_header_t *ent) {
+  if (!ent->flag_pending) {
+    return;
+  }
+  ent->flag_pending = false;
+  cycle_children(ent, cycle_collect_child);
+  cycle_forget(ent);
+  memcpy(ent + 1, &cycle_garbage, sizeof(cycle_garbage));
+  cycle_garbage = ent;
+}
+
+void siheap_collect_cycles(size_t budget) {
+  const size_t count = siheap_cycle_root_count < budget ? siheap_cycle_root_count : budget;
+  // take the batch off the end of the buffer; objects forgotten while it is
+  // processed are swapped with ones before it
+  siheap_cycle_root_count -= count;
+  siheap_header_t **const roots = siheap_cycle_roots + siheap_cycle_root_count;
+  for (size_t i = 0; i < count; ++i) {
+    roots[i]->flag_buffered = false;
+  }
+
+  cycle_pass(roots, count, cycle_mark_gray);
+  cycle_pass(roots, count, cycle_scan);
+  for (size_t i = 0; i < count; ++i) {
+    if (roots[i]->flag_white) {
+      roots[i]->flag_white = false;
+      roots[i]->flag_pending = true;
+    }
+  }
+  cycle_pass(roots, count, cycle_collect_white);
+
+  while (cycle_garbage) {
+    siheap_header_t *const ent = cycle_garbage;
+    memcpy(&cycle_garbage, ent + 1, sizeof(cycle_garbage));
+    assert(!ent->refcount);
+    siheap_mfree_inner(ent);
+  }
+
+  if (!siheap_cycle_root_count) {
+    siheap_cycle_collecting = false;
+  }
+}
+#endif
+
+#ifdef SINTER_COMPACT_HEAP
+/*
+ * Compaction slides live objects towards the start of the heap, so that the
+ * free space ends up in as few blocks as possible (Lisp-2 style). It runs
+ * right after a mark-and-sweep that failed to free a large enough block.
+ *
+ * Objects that the native stack may refer to are pinned (marked, as the sweep
+ * has unmarked everything), and do not move. Their addresses may be held
+ * in C variables of the functions that are running, which cannot be fixed up.
+ * The native stack and registers are scanned conservatively: any word that
+ * looks like a pointer into the heap, or a NaN-boxed heap pointer, pins the
+ * object containing it. The decoded program and its string constants are
+ * pinned too, as the decoded instructions refer to them directly.
  *
- * The destructor typically just decrements the reference counts
- * of objects referred to by the given object.
+ * Finding the object that contains an address takes a walk of the heap, so
+ * the addresses are collected into a buffer, and each time it fills up, they
+ * are sorted and the objects containing them are pinned in one walk.
+ *
+ * The other objects slide down until the next pinned object. The forwarding
+ * address of an object is kept in its link to the previous block (see
+ * siheap_set_prev), which is rebuilt at the end.
+ */
+#define COMPACT_PIN_BATCH 32
+
+static uintptr_t compact_pins[COMPACT_PIN_BATCH];
+static size_t compact_pin_count = 0;
+
+/**
+ * Pins the objects containing the addresses collected so far.
  */
-void siheap_mdestroy(siheap_header_t *ent) {
-  if (ent->flag_destroying) {
+static void compact_pin_flush(void) {
+  // sort the addresses (insertion sort, as there are few of them)
+  for (size_t i = 1; i < compact_pin_count; ++i) {
+    const uintptr_t addr = compact_pins[i];
+    size_t j = i;
+    for (; j > 0 && compact_pins[j - 1] > addr; --j) {
+      compact_pins[j] = compact_pins[j - 1];
+    }
+    compact_pins[j] = addr;
+  }
+
+  size_t i = 0;
+  for (siheap_header_t *curr = (siheap_header_t *) siheap; SIHEAP_INRANGE(curr) && i < compact_pin_count;
+      curr = siheap_next(curr)) {
+    const uintptr_t end = (uintptr_t) siheap_next(curr);
+    if (compact_pins[i] >= end) {
+      continue;
+    }
+    if (curr->type != sitype_free) {
+      siheap_setmarked(curr, true);
+    }
+    while (i < compact_pin_count && compact_pins[i] < end) {
+      ++i;
+    }
+  }
+  compact_pin_count = 0;
+}
+
+static void compact_pin_address(uintptr_t addr) {
+  if (addr < (uintptr_t) siheap || addr >= (uintptr_t) (siheap + SINTER_HEAP_SIZE)) {
     return;
   }
-  ent->flag_destroying = true;
+  compact_pins[compact_pin_count++] = addr;
+  if (compact_pin_count == COMPACT_PIN_BATCH) {
+    compact_pin_flush();
+  }
+}
+
+static void compact_pin_box(sinanbox_t v) {
+  // NANBOX_PTR is in units of SIHEAP_ALIGN
+  if (NANBOX_ISPTR(v) && NANBOX_PTR(v) < (SINTER_HEAP_SIZE >> SIHEAP_PTR_SHIFT)) {
+    compact_pin_address((uintptr_t) SIHEAP_NANBOXTOPTR(v));
+  }
+}
+
+static void __attribute__((noinline)) compact_pin_native_stack(void) {
+  jmp_buf regs;
+#ifdef __GNUC__
+  // spill all callee-saved registers onto the stack
+  __builtin_unwind_init();
+#endif
+  (void) setjmp(regs);
+
+  uintptr_t lo = (uintptr_t) &regs;
+  uintptr_t hi = sistate.native_stack_base;
+  if (lo > hi) {
+    const uintptr_t t = lo;
+    lo = hi;
+    hi = t;
+  }
+  lo = (lo + sizeof(uint32_t) - 1) & ~(uintptr_t) (sizeof(uint32_t) - 1);
+  for (uintptr_t addr = lo; addr + sizeof(uint32_t) <= hi; addr += sizeof(uint32_t)) {
+    compact_pin_box(NANBOX_WITH_I32(*(const uint32_t *) addr));
+    if (addr % sizeof(uintptr_t) == 0 && addr + sizeof(uintptr_t) <= hi) {
+      compact_pin_address(*(const uintptr_t *) addr);
+    }
+  }
+  compact_pin_flush();
+}
+
+static siheap_header_t *compact_forward(void *ent) {
+  return ent ? siheap_prev((siheap_header_t *) ent) : NULL;
+}
+
+static siheap_env_t *compact_forward_env(siheap_env_t *env) {
+  // environments on the environment stack do not move
+  return sienv_onstack(env) ? env : (siheap_env_t *) compact_forward(env);
+}
+
+static void compact_forward_box(sinanbox_t *v) {
+  if (NANBOX_ISPTR(*v)) {
+    *v = SIHEAP_PTRTONANBOX(compact_forward(SIHEAP_NANBOXTOPTR(*v)));
+  }
+}
+
+/**
+ * Points the references in the given object to where their targets will be.
+ */
+static void compact_fix_children(siheap_header_t *ent) {
   switch (ent->type) {
-  case sitype_env:
-    sienv_destroy((siheap_env_t *) ent);
+  case sitype_env: {
+    siheap_env_t *env = (siheap_env_t *) ent;
+    for (size_t i = 0; i < env->entry_count; ++i) {
+      compact_forward_box(&env->entry[i]);
+    }
+    env->parent = compact_forward_env(env->parent);
+#ifdef SINTER_ENV_DISPLAY
+    siheap_env_t **const display = sienv_display(env);
+    for (uint8_t i = 0; i < env->display_count; ++i) {
+      display[i] = compact_forward_env(display[i]);
+    }
+#endif
     break;
-  case sitype_strpair:
-    sistrpair_destroy((siheap_strpair_t *) ent);
+  }
+  case sitype_function: {
+    siheap_function_t *fn = (siheap_function_t *) ent;
+    fn->env = (siheap_env_t *) compact_forward(fn->env);
     break;
-  case sitype_array:
-    siarray_destroy((siheap_array_t *) ent);
+  }
+  case sitype_array: {
+    siheap_array_t *a = (siheap_array_t *) ent;
+    // the elements are fixed where they are; they move with the array or its data
+    sinanbox_t *data = siarray_data(a);
+    for (address_t i = 0; i < a->count; ++i) {
+      compact_forward_box(&data[i]);
+    }
+    a->data = (siheap_array_data_t *) compact_forward(a->data);
     break;
-  case sitype_function:
-    sifunction_destroy((siheap_function_t *) ent);
+  }
+  case sitype_pair: {
+    siheap_pair_t *p = (siheap_pair_t *) ent;
+    compact_forward_box(&p->data[0]);
+    compact_forward_box(&p->data[1]);
     break;
-  case sitype_intcont:
-    siintcont_destroy((siheap_intcont_t *) ent);
+  }
+  case sitype_intcont: {
+    siheap_intcont_t *ic = (siheap_intcont_t *) ent;
+    for (address_t i = 0; i < ic->argc; ++i) {
+      compact_forward_box(&ic->argv[i]);
+    }
+    break;
+  }
+  case sitype_strpair: {
+    siheap_strpair_t *obj = (siheap_strpair_t *) ent;
+    obj->left = compact_forward(obj->left);
+    obj->right = compact_forward(obj->right);
+    break;
+  }
+  case sitype_code: {
+    siheap_code_t *c = (siheap_code_t *) ent;
+    for (address_t i = 0; i < c->string_count; ++i) {
+      compact_forward_box(&c->strings[i]);
+    }
     break;
+  }
   case sitype_array_data:
-  case sitype_frame:
   case sitype_strconst:
   case sitype_string:
     break;
-  default:
-  case sitype_empty:
   case sitype_free:
-    SIBUGV("Attempting to destroy object of type %d\n", ent->type);
-    assert(false);
+  case sitype_empty:
+  default:
+    SIBUGV("Unknown type %d\n", ent->type);
     break;
   }
 }
 
-static void siheap_mark(siheap_header_t *vent);
-
-static inline void siheap_markbox(sinanbox_t ent) {
-  if (NANBOX_ISPTR(ent)) {
-    siheap_mark(SIHEAP_NANBOXTOPTR(ent));
+/**
+ * Fills the space between the last object moved and the next pinned object
+ * (or the end of the heap). Space too small for a free block is added to the
+ * last object moved.
+ */
+static void compact_fill(unsigned char *start, unsigned char *end, siheap_header_t *last) {
+  const address_t gap = (address_t) (end - start);
+  if (!gap) {
+    return;
   }
-}
-
-static void siheap_mark(siheap_header_t *vent) {
-  if (!SIHEAP_INRANGE(vent) || ((unsigned char *) vent) < siheap) {
+  if (gap < sizeof(siheap_free_t)) {
+    // the gap was taken up by objects that moved, so there is one
+    assert(last);
+    last->size += gap;
     return;
   }
+  *(siheap_header_t *) start = (siheap_header_t) {
+    .type = sitype_free,
+    .size = gap
+  };
+}
 
-  if (!vent->flag_marked) {
-#if SINTER_DEBUG_LOGLEVEL >= 2
-    SIDEBUG("Marking object ");
-    SIDEBUG_HEAPOBJ(vent);
-    SIDEBUG("\n");
+void siheap_compact(void) {
+  assert(sistate.native_stack_base);
+#ifdef SINTER_SWEEP_BUDGET
+  assert(!siheap_sweep_cursor);
 #endif
 
-    // object is unmarked; mark it
-    vent->flag_marked = true;
-
-    // mark any children
-    switch (vent->type) {
-    case sitype_function:
-      siheap_mark(&((siheap_function_t *) vent)->env->header);
-      break;
-    case sitype_frame:
-      siheap_mark(&((siheap_frame_t *) vent)->saved_env->header);
-      break;
-    case sitype_env: {
-      siheap_env_t *env = (siheap_env_t *) vent;
-      for (size_t i = 0; i < env->entry_count; i++) {
-        siheap_markbox(env->entry[i]);
+  compact_pin_native_stack();
+#ifdef SINTER_PREDECODE
+  if (sistate.code && !sistate.aot) {
+    siheap_code_t *c = (siheap_code_t *) (sistate.code - offsetof(siheap_code_t, code));
+    siheap_setmarked(&c->header, true);
+    for (address_t i = 0; i < c->string_count; ++i) {
+      if (NANBOX_ISPTR(c->strings[i])) {
+        siheap_setmarked(SIHEAP_NANBOXTOPTR(c->strings[i]), true);
       }
-      siheap_mark(&env->parent->header);
-      break;
     }
-    case sitype_array: {
-      siheap_array_t *a = (siheap_array_t *) vent;
-      for (address_t i = 0; i < a->count; ++i) {
-        siheap_markbox(a->data->data[i]);
-      }
-      siheap_mark(&a->data->header);
-      break;
+  }
+#endif
+
+  // compute the forwarding addresses
+  unsigned char *to = siheap;
+  for (siheap_header_t *curr = (siheap_header_t *) siheap; SIHEAP_INRANGE(curr); curr = siheap_next(curr)) {
+    if (curr->type == sitype_free) {
+      continue;
     }
-    case sitype_intcont: {
-      siheap_intcont_t *a = (siheap_intcont_t *) vent;
-      for (address_t i = 0; i < a->argc; ++i) {
-        siheap_markbox(a->argv[i]);
-      }
-      break;
+    if (siheap_ismarked(curr)) {
+      siheap_set_prev(curr, curr);
+      to = (unsigned char *) siheap_next(curr);
+    } else {
+      siheap_set_prev(curr, (siheap_header_t *) to);
+      to += curr->size;
     }
-    case sitype_strpair: {
-      siheap_strpair_t *a = (siheap_strpair_t *) vent;
-      siheap_mark(a->left);
-      if (a->right) {
-        siheap_mark(a->right);
-      }
-      break;
+  }
+
+  // fix up the references
+  for (const sistack_segment_t *segment = sistack_segment; segment; segment = segment->below) {
+    for (sinanbox_t *curr = segment->stack; curr < sistack_segment_top(segment); ++curr) {
+      compact_forward_box(curr);
     }
-    case sitype_array_data:
-    case sitype_strconst:
-    case sitype_string:
-      // These types have no children, no need to do anything
-      break;
-    case sitype_free:
-      SIBUGM("Attempting to mark free block\n");
-      break;
-    case sitype_empty:
-    default:
-      SIBUGV("Unknown type %d\n", vent->type);
-      break;
+    for (siframe_t *frame = segment->frames; frame < siframes_segment_top(segment); ++frame) {
+      frame->saved_env = compact_forward_env(frame->saved_env);
+    }
+  }
+  sistate.env = compact_forward_env(sistate.env);
+  for (size_t i = 0; i < SIENV_CACHE_SIZES; ++i) {
+    sienv_cache[i] = (siheap_env_t *) compact_forward(sienv_cache[i]);
+  }
+#ifdef SINTER_PREDECODE
+  for (unsigned char *at = sienvstack; at < sienvstack_top; at += ((siheap_header_t *) at)->size) {
+    siheap_header_t *const env = (siheap_header_t *) at;
+    if (env->type == sitype_env) {
+      compact_fix_children(env);
     }
   }
-}
-
-static inline void siheap_sweep(void) {
-#ifdef SINTER_DEBUG
-  siheap_sweeping = 1;
 #endif
-  siheap_header_t *curr = (siheap_header_t *) siheap;
-  while (SIHEAP_INRANGE(curr)) {
-    if (!curr->flag_marked && curr->type != sitype_free) {
-      curr->refcount = 0;
-#if SINTER_DEBUG_LOGLEVEL >= 2
-      SIDEBUG("Sweeping object ");
-      SIDEBUG_HEAPOBJ(curr);
-      SIDEBUG("\n");
+#ifdef SINTER_CYCLE_BUDGET
+  // the sweep may have buffered candidates
+  for (size_t i = 0; i < siheap_cycle_root_count; ++i) {
+    siheap_cycle_roots[i] = compact_forward(siheap_cycle_roots[i]);
+  }
 #endif
-      curr = siheap_mfree(curr);
+  for (siheap_header_t *curr = (siheap_header_t *) siheap; SIHEAP_INRANGE(curr); curr = siheap_next(curr)) {
+    if (curr->type != sitype_free) {
+      compact_fix_children(curr);
+    }
+  }
+
+  // move the objects
+  to = siheap;
+  siheap_header_t *last = NULL;
+  siheap_header_t *next;
+  for (siheap_header_t *curr = (siheap_header_t *) siheap; SIHEAP_INRANGE(curr); curr = next) {
+    next = siheap_next(curr);
+    if (curr->type == sitype_free) {
+      continue;
+    }
+    if (siheap_ismarked(curr)) {
+      compact_fill(to, (unsigned char *) curr, last);
+      to = (unsigned char *) next;
+      last = NULL;
     } else {
-      curr->flag_marked = false;
+      siheap_header_t *const dest = siheap_prev(curr);
+      if (dest != curr) {
+        memmove(dest, curr, curr->size);
+      }
+      to = (unsigned char *) siheap_next(dest);
+      last = dest;
     }
-    curr = siheap_next(curr);
   }
-#ifdef SINTER_DEBUG
-  siheap_sweeping = 0;
-#endif
-}
+  compact_fill(to, siheap + SINTER_HEAP_SIZE, last);
 
-void siheap_mark_sweep(void) {
-   sinanbox_t *curr = sistack_top - 1;
-   while (curr >= sistack) {
-      siheap_markbox(*(curr--));
-   }
-   siheap_mark(&sistate.env->header);
-   siheap_sweep();
+  // rebuild the links and the free lists
+  for (unsigned int i = 0; i < SIHEAP_CLASSES; ++i) {
+    siheap_free_lists[i] = NULL;
+  }
+  siheap_free_small_map = 0;
+  siheap_free_large_map = 0;
+  siheap_header_t *prev = NULL;
+  for (siheap_header_t *curr = (siheap_header_t *) siheap; SIHEAP_INRANGE(curr); curr = siheap_next(curr)) {
+    siheap_set_prev(curr, prev);
+    siheap_setmarked(curr, false);
+    if (curr->type == sitype_free) {
+      siheap_free_insert((siheap_free_t *) curr);
+    }
+    prev = curr;
+  }
 }
+#endif
 
 void sistack_init(void) {
   sistack_bottom = sistack;
   sistack_limit = sistack;
   sistack_top = sistack;
+  siframes_top = siframes;
+  // segments above the bottom one are kept for the next run
+  sistack_segment = &sistack_bottom_segment;
+#ifdef SINTER_PREDECODE
+  sienvstack_top = sienvstack;
+#endif
+}
+
+#ifdef SINTER_STACK_SEGMENTS
+static unsigned int sistack_segment_count = 0;
+
+bool sistack_grow(unsigned int size) {
+  sistack_segment_t *segment = sistack_segment->above;
+  if (!segment) {
+    if (sistack_segment_count == SINTER_STACK_SEGMENTS) {
+      return false;
+    }
+    // the frames go first, as they are at least as aligned as the entries
+    segment = (sistack_segment_t *) malloc(sizeof(sistack_segment_t)
+      + SINTER_FRAME_ENTRIES*sizeof(siframe_t) + SINTER_STACK_ENTRIES*sizeof(sinanbox_t));
+    if (!segment) {
+      return false;
+    }
+    ++sistack_segment_count;
+    segment->below = sistack_segment;
+    segment->above = NULL;
+    segment->frames = (siframe_t *) (segment + 1);
+    segment->frames_end = segment->frames + SINTER_FRAME_ENTRIES;
+    segment->stack = (sinanbox_t *) segment->frames_end;
+    segment->stack_end = segment->stack + SINTER_STACK_ENTRIES;
+    sistack_segment->above = segment;
+  }
+  if (segment->stack + size > segment->stack_end) {
+    return false;
+  }
+
+  segment->below_stack_top = sistack_top;
+  segment->below_frames_top = siframes_top;
+  sistack_segment = segment;
+  sistack_top = segment->stack;
+  siframes_top = segment->frames;
+  return true;
+}
+#endif
+
+#ifdef SINTER_ENV_DISPLAY
+void sienv_build_display(siheap_env_t *env, uint8_t display_count) {
+  siheap_env_t *const parent = env->parent;
+  if (!parent || !parent->parent) {
+    return;
+  }
+  siheap_env_t **const display = sienv_display(env);
+  display[0] = parent->parent;
+  // the parent's display starts at our great-grandparent
+  const uint8_t copied = parent->display_count < display_count - 1 ? parent->display_count : display_count - 1;
+  siheap_env_t **const from = sienv_display(parent);
+  for (uint8_t i = 0; i < copied; ++i) {
+    display[1 + i] = from[i];
+  }
+  uint8_t count = 1 + copied;
+  // the parent's display may be shorter than ours
+  for (siheap_env_t *a = display[count - 1]->parent; a && count < display_count; a = a->parent) {
+    display[count++] = a;
+  }
+  env->display_count = count;
+}
+#endif
+
+#ifdef SINTER_PREDECODE
+/**
+ * Moves one environment on the environment stack, whose parent is not on the
+ * environment stack, to the heap.
+ */
+static siheap_env_t *sienv_promote_one(siheap_env_t *env) {
+#ifdef SINTER_ENV_DISPLAY
+  const uint8_t display_count = env->display_count;
+#else
+  const uint8_t display_count = 0;
+#endif
+  siheap_env_t *const moved = (siheap_env_t *) siheap_malloc(SIENV_DISPLAY_SIZE(env->entry_count, display_count), sitype_env);
+  // the references to the parent and the entries move along
+  moved->parent = env->parent;
+  moved->entry_count = env->entry_count;
+  memcpy(moved->entry, env->entry, env->entry_count*sizeof(sinanbox_t));
+#ifdef SINTER_ENV_DISPLAY
+  // the ancestors are already on the heap
+  moved->display_count = display_count;
+  memcpy(sienv_display(moved), sienv_display(env), display_count*sizeof(siheap_env_t *));
+#endif
+
+  // only the interpreter state, frames and the environment stack can refer to
+  // an environment on the environment stack
+  uint32_t refcount = 0;
+  if (sistate.env == env) {
+    sistate.env = moved;
+    ++refcount;
+  }
+  for (const sistack_segment_t *segment = sistack_segment; segment; segment = segment->below) {
+    for (siframe_t *frame = segment->frames; frame < siframes_segment_top(segment); ++frame) {
+      if (frame->saved_env == env) {
+        frame->saved_env = moved;
+        ++refcount;
+      }
+    }
+  }
+  for (unsigned char *at = sienvstack; at < sienvstack_top; at += ((siheap_header_t *) at)->size) {
+    siheap_env_t *const child = (siheap_env_t *) at;
+    if (child->header.type != sitype_env) {
+      continue;
+    }
+    if (child->parent == env) {
+      child->parent = moved;
+      ++refcount;
+    }
+#ifdef SINTER_ENV_DISPLAY
+    siheap_env_t **const display = sienv_display(child);
+    for (uint8_t i = 0; i < child->display_count; ++i) {
+      if (display[i] == env) {
+        display[i] = moved;
+      }
+    }
+#endif
+  }
+  assert(refcount);
+  moved->header.refcount = refcount;
+
+  // leave a dead slot, unless it is at the top
+  env->header.type = sitype_free;
+  if ((unsigned char *) env + env->header.size == sienvstack_top) {
+    sienvstack_top = (unsigned char *) env;
+  }
+  return moved;
+}
+
+siheap_env_t *sienv_promote(siheap_env_t *env) {
+  // ancestors go first, so that nothing on the heap ever refers to the
+  // environment stack
+  while (sienv_onstack(env)) {
+    siheap_env_t *outermost = env;
+    while (outermost->parent && sienv_onstack(outermost->parent)) {
+      outermost = outermost->parent;
+    }
+    siheap_env_t *const moved = sienv_promote_one(outermost);
+    if (outermost == env) {
+      return moved;
+    }
+  }
+  return env;
 }
+#endif
 
 static address_t sizeof_strobj(siheap_header_t *obj) {
   switch (obj->type) {
@@ -199,16 +1551,17 @@ static address_t sizeof_strobj(siheap_header_t *obj) {
 
   case sitype_string: {
     siheap_string_t *v = (siheap_string_t *) obj;
-    return v->header.size - sizeof(siheap_string_t) - 1;
+    return v->size - 1;
   }
 
   case sitype_intcont:
   case sitype_array_data:
   case sitype_empty:
-  case sitype_frame:
+  case sitype_code:
   case sitype_free:
   case sitype_env:
   case sitype_array:
+  case sitype_pair:
   case sitype_function:
   default:
     SIBUGM("Unknown string type\n");
@@ -248,10 +1601,11 @@ static void write_strobj(siheap_header_t *obj, char **to) {
   case sitype_intcont:
   case sitype_array_data:
   case sitype_empty:
-  case sitype_frame:
+  case sitype_code:
   case sitype_free:
   case sitype_env:
   case sitype_array:
+  case sitype_pair:
   case sitype_function:
   default:
     SIBUGM("Unknown string type\n");
@@ -281,21 +1635,33 @@ siheap_string_t *sistrpair_flatten(siheap_strpair_t *obj) {
 }
 
 siheap_header_t *siheap_mrealloc(siheap_header_t *ent, address_t newsize) {
+  newsize = siheap_round_size(newsize);
   if (ent->size >= newsize) {
     // we don't support shrinking currently
     return ent;
   }
 
   siheap_header_t *next = siheap_next(ent);
-  if (SIHEAP_INRANGE(next) && next->type == sitype_free && ent->size + next->size >= newsize) {
+  // the split-off part of the next block must be able to hold a free header, or the
+  // new free node created by the split would overlap the next block's freelist pointers
+  address_t grow_size = newsize - ent->size;
+  if (grow_size < sizeof(siheap_free_t)) {
+    grow_size = siheap_round_size(sizeof(siheap_free_t));
+  }
+  if (SIHEAP_INRANGE(next) && next->type == sitype_free && next->size >= grow_size) {
     // the next block is free and large enough
 
     // do the allocation on the block
-    siheap_malloc_split((siheap_free_t *) next, newsize - ent->size, ent->type);
+    siheap_malloc_split((siheap_free_t *) next, grow_size, ent->type);
 
     // now merge our two heap blocks
     ent->size += next->size;
     siheap_fix_next(ent);
+#ifdef SINTER_SWEEP_BUDGET
+    if (siheap_sweep_cursor == next) {
+      siheap_sweep_cursor = ent;
+    }
+#endif
 
     return ent;
   }
@@ -304,33 +1670,54 @@ siheap_header_t *siheap_mrealloc(siheap_header_t *ent, address_t newsize) {
 
   // store the type, refcount and size of the current block
 #ifdef SINTER_DEBUG_MEMORY_CHECK
-  uint16_t orig_internal_refcount = ent->internal_refcount;
+  uint32_t orig_internal_refcount = ent->internal_refcount;
 #endif
   siheap_type_t orig_type = ent->type;
-  uint16_t orig_refcount = ent->refcount;
+  uint32_t orig_refcount = ent->refcount;
   address_t orig_size = ent->size;
 
-  // if the previous node is a free block, then we free BEFORE malloc
-  // so there is a chance that the new merged free block is large enough
-  // we cannot do this all the time as in some cases (if a new free node is
-  // constructed in our current memory block) our array data will be overwritten
-  const bool free_first = ((unsigned char *) ent->prev_node) >= siheap
-    && ent->prev_node->type == sitype_free;
-  ent->refcount = 0;
+  // if the previous node is a free block, and merging with it makes a block
+  // large enough, then we free BEFORE malloc and take the merged block
+  // otherwise the contents must stay allocated while we malloc, as the heap may
+  // be collected or compacted
+  siheap_header_t *const prev = siheap_prev(ent);
+  const bool prev_free = prev && prev->type == sitype_free;
+  const bool free_first = prev_free && prev->size + ent->size
+    + (SIHEAP_INRANGE(next) && next->type == sitype_free ? next->size : 0) >= newsize;
 
+  siheap_header_t *new_alloc;
   if (free_first) {
-    siheap_mfree_inner(ent);
-  }
-
-  // now allocate a new block with the new size and original type
-  siheap_header_t *new_alloc = siheap_malloc(newsize, orig_type);
+    ent->refcount = 0;
+    siheap_header_t *const merged = siheap_mfree_inner(ent);
+    // take the merged block, and move the contents down before splitting off
+    // the rest, as the new free node could otherwise be constructed in the
+    // middle of our data
+    siheap_free_remove((siheap_free_t *) merged);
+    memmove(merged + 1, ent + 1, orig_size - sizeof(siheap_header_t));
+    merged->type = orig_type;
+    merged->flag_destroying = merged->flag_displayed = merged->flag_marked = false;
+    merged->flag_buffered = merged->flag_gray = merged->flag_white = merged->flag_pending = false;
+#ifdef SINTER_SWEEP_BUDGET
+    siheap_setmarked(merged, siheap_sweep_cursor != NULL);
+#endif
+    if (newsize + sizeof(siheap_free_t) <= merged->size) {
+      siheap_free_new(((unsigned char *) merged) + newsize, merged->size - newsize, merged);
+      merged->size = newsize;
+    }
+    new_alloc = merged;
+  } else {
+    // now allocate a new block with the new size and original type
+    new_alloc = siheap_malloc(newsize, orig_type);
 
-  // move the contents over from the old block
-  memmove(new_alloc + 1, ent + 1, orig_size - sizeof(siheap_header_t));
+    // move the contents over from the old block
+    memmove(new_alloc + 1, ent + 1, orig_size - sizeof(siheap_header_t));
 
-  if (!free_first) {
+    // the old block keeps its reference count until here, in case the
+    // allocation collects cycles that refer to it
+    ent->refcount = 0;
     siheap_mfree_inner(ent);
   }
+
   // restore the refcount
   new_alloc->refcount = orig_refcount;
 #ifdef SINTER_DEBUG_MEMORY_CHECK
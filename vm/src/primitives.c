@@ -60,7 +60,7 @@ static void handle_display(unsigned int argc, sinanbox_t *argv, bool is_error) {
 static sinanbox_t sivmfn_prim_is_array(uint8_t argc, sinanbox_t *argv) {
   CHECK_ARGC(1);
   sinanbox_t v = *argv;
-  return NANBOX_OFBOOL(NANBOX_ISPTR(v) && ((siheap_header_t *) SIHEAP_NANBOXTOPTR(v))->type == sitype_array);
+  return NANBOX_OFBOOL(NANBOX_ISPTR(v) && siheap_isarray(SIHEAP_NANBOXTOPTR(v)));
 }
 
 static sinanbox_t sivmfn_prim_is_boolean(uint8_t argc, sinanbox_t *argv) {
@@ -341,35 +341,36 @@ FLOAT_ROUND_FN(trunc)
  * Pair primitives
  ******************************************************************************/
 
-static inline siheap_array_t *source_pair_ptr(sinanbox_t l, sinanbox_t r) {
-  siheap_array_t *arr = siarray_new(2);
-  siarray_put(arr, 0, l);
-  siarray_put(arr, 1, r);
-  return arr;
+static inline siheap_pair_t *source_pair_ptr(sinanbox_t l, sinanbox_t r) {
+  return sipair_new(l, r);
 }
 
 static inline sinanbox_t source_pair(sinanbox_t l, sinanbox_t r) {
   return SIHEAP_PTRTONANBOX(source_pair_ptr(l, r));
 }
 
-static inline siheap_array_t *nanbox_toarray(sinanbox_t p) {
+static inline siheap_header_t *nanbox_toarray(sinanbox_t p) {
   siheap_header_t *v = SIHEAP_NANBOXTOPTR(p);
-  siheap_array_t *a = (siheap_array_t *) v;
-  if (!NANBOX_ISPTR(p) || v->type != sitype_array) {
+  if (!NANBOX_ISPTR(p) || !siheap_isarray(v)) {
     sifault(sinter_fault_type);
     return NULL;
   }
-  return a;
+  return v;
+}
+
+static inline bool is_source_pair(sinanbox_t p) {
+  return NANBOX_ISPTR(p) && siheap_isarray(SIHEAP_NANBOXTOPTR(p))
+    && siarray_length(SIHEAP_NANBOXTOPTR(p)) == 2;
 }
 
 static inline sinanbox_t source_head(sinanbox_t p) {
-  siheap_array_t *a = nanbox_toarray(p);
-  return siarray_get(a, 0);
+  siheap_header_t *a = nanbox_toarray(p);
+  return siarray_load(a, 0);
 }
 
 static inline sinanbox_t source_tail(sinanbox_t p) {
-  siheap_array_t *a = nanbox_toarray(p);
-  return siarray_get(a, 1);
+  siheap_header_t *a = nanbox_toarray(p);
+  return siarray_load(a, 1);
 }
 
 static sinanbox_t sivmfn_prim_pair(uint8_t argc, sinanbox_t *argv) {
@@ -395,25 +396,23 @@ static sinanbox_t sivmfn_prim_tail(uint8_t argc, sinanbox_t *argv) {
 
 static sinanbox_t sivmfn_prim_set_head(uint8_t argc, sinanbox_t *argv) {
   CHECK_ARGC(2);
-  siheap_array_t *a = nanbox_toarray(argv[0]);
+  siheap_header_t *a = nanbox_toarray(argv[0]);
   siheap_refbox(argv[1]);
-  siarray_put(a, 0, argv[1]);
+  siarray_store(a, 0, argv[1]);
   return NANBOX_OFUNDEF();
 }
 
 static sinanbox_t sivmfn_prim_set_tail(uint8_t argc, sinanbox_t *argv) {
   CHECK_ARGC(2);
-  siheap_array_t *a = nanbox_toarray(argv[0]);
+  siheap_header_t *a = nanbox_toarray(argv[0]);
   siheap_refbox(argv[1]);
-  siarray_put(a, 1, argv[1]);
+  siarray_store(a, 1, argv[1]);
   return NANBOX_OFUNDEF();
 }
 
 static sinanbox_t sivmfn_prim_is_pair(uint8_t argc, sinanbox_t *argv) {
   CHECK_ARGC(1);
-  siheap_header_t *v = SIHEAP_NANBOXTOPTR(argv[0]);
-  siheap_array_t *a = (siheap_array_t *) v;
-  return NANBOX_OFBOOL(NANBOX_ISPTR(argv[0]) && v->type == sitype_array && a->count == 2);
+  return NANBOX_OFBOOL(is_source_pair(argv[0]));
 }
 
 /******************************************************************************
@@ -425,12 +424,10 @@ static sinanbox_t sivmfn_prim_is_list(uint8_t argc, sinanbox_t *argv) {
 
   sinanbox_t l = argv[0];
   while (!NANBOX_ISNULL(l)) {
-    siheap_header_t *v = SIHEAP_NANBOXTOPTR(l);
-    siheap_array_t *a = (siheap_array_t *) v;
-    if (!NANBOX_ISPTR(l) || v->type != sitype_array || a->count != 2) {
+    if (!is_source_pair(l)) {
       return NANBOX_OFBOOL(false);
     }
-    l = siarray_get(a, 1);
+    l = siarray_load(SIHEAP_NANBOXTOPTR(l), 1);
   }
 
   return NANBOX_OFBOOL(true);
@@ -463,11 +460,11 @@ static sinanbox_t sivmfn_prim_accumulate(uint8_t argc, sinanbox_t *argv) {
     size_t idx = 0;
     sinanbox_t l = argv[2];
     while (!NANBOX_ISNULL(l)) {
-      siheap_array_t *pair = nanbox_toarray(l);
-      sinanbox_t head = siarray_get(pair, 0);
+      siheap_header_t *pair = nanbox_toarray(l);
+      sinanbox_t head = siarray_load(pair, 0);
       siheap_refbox(head);
       siarray_put(flat_list, idx, head);
-      l = siarray_get(pair, 1);
+      l = siarray_load(pair, 1);
       idx += 1;
     }
     assert(idx == list_length);
@@ -500,16 +497,16 @@ static sinanbox_t sivmfn_prim_append(uint8_t argc, sinanbox_t *argv) {
     return argv[1];
   }
 
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
   while (!NANBOX_ISNULL(list)) {
-    siheap_array_t *pair = nanbox_toarray(list);
-    sinanbox_t head = siarray_get(pair, 0);
-    list = siarray_get(pair, 1);
+    siheap_header_t *pair = nanbox_toarray(list);
+    sinanbox_t head = siarray_load(pair, 0);
+    list = siarray_load(pair, 1);
     siheap_refbox(head);
-    siheap_array_t *new_pair = source_pair_ptr(head, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(head, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -518,7 +515,7 @@ static sinanbox_t sivmfn_prim_append(uint8_t argc, sinanbox_t *argv) {
   }
 
   siheap_refbox(argv[1]);
-  siarray_put(prev_pair, 1, argv[1]);
+  prev_pair->data[1] = argv[1];
   return SIHEAP_PTRTONANBOX(new_list);
 }
 
@@ -531,15 +528,15 @@ static sinanbox_t sivmfn_prim_build_list(uint8_t argc, sinanbox_t *argv) {
     return NANBOX_OFNULL();
   }
 
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
 
   for (int32_t i = 0; i < limit; ++i) {
     sinanbox_t arg = NANBOX_WRAP_INT(i);
     sinanbox_t new_val = siexec_nanbox(argv[1], 1, &arg);
-    siheap_array_t *new_pair = source_pair_ptr(new_val, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(new_val, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -556,12 +553,12 @@ static sinanbox_t sivmfn_prim_build_list(uint8_t argc, sinanbox_t *argv) {
   if (start > end) { \
     return NANBOX_OFNULL(); \
   } \
-  siheap_array_t *new_list = NULL; \
-  siheap_array_t *prev_pair = NULL; \
+  siheap_pair_t *new_list = NULL; \
+  siheap_pair_t *prev_pair = NULL; \
   for (type i = start; i <= end; i += 1) { \
-    siheap_array_t *new_pair = source_pair_ptr(each, NANBOX_OFNULL()); \
+    siheap_pair_t *new_pair = source_pair_ptr(each, NANBOX_OFNULL()); \
     if (prev_pair) { \
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair)); \
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair); \
     } \
     if (!new_list) { \
       new_list = new_pair; \
@@ -604,12 +601,12 @@ static sinanbox_t sivmfn_prim_filter(uint8_t argc, sinanbox_t *argv) {
   const sinanbox_t filter_fn = argv[0];
 
   sinanbox_t old_list = argv[1];
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
   while (!NANBOX_ISNULL(old_list)) {
-    siheap_array_t *pair = nanbox_toarray(old_list);
-    sinanbox_t cur = siarray_get(pair, 0);
-    old_list = siarray_get(pair, 1);
+    siheap_header_t *pair = nanbox_toarray(old_list);
+    sinanbox_t cur = siarray_load(pair, 0);
+    old_list = siarray_load(pair, 1);
     siheap_refbox(cur);
     sinanbox_t pred_result = siexec_nanbox(filter_fn, 1, &cur);
     if (NANBOX_ISBOOL(pred_result)) {
@@ -620,9 +617,9 @@ static sinanbox_t sivmfn_prim_filter(uint8_t argc, sinanbox_t *argv) {
       sifault(sinter_fault_type);
     }
     siheap_refbox(cur);
-    siheap_array_t *new_pair = source_pair_ptr(cur, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(cur, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -649,9 +646,9 @@ static sinanbox_t sivmfn_prim_for_each(uint8_t argc, sinanbox_t *argv) {
 
   sinanbox_t list = argv[1];
   while (!NANBOX_ISNULL(list)) {
-    siheap_array_t *pair = nanbox_toarray(list);
-    sinanbox_t cur = siarray_get(pair, 0);
-    list = siarray_get(pair, 1);
+    siheap_header_t *pair = nanbox_toarray(list);
+    sinanbox_t cur = siarray_load(pair, 0);
+    list = siarray_load(pair, 1);
     siheap_refbox(cur);
     siheap_derefbox(siexec_nanbox(for_each_fn, 1, &cur));
   }
@@ -669,14 +666,14 @@ static sinanbox_t sivmfn_prim_list(uint8_t argc, sinanbox_t *argv) {
     return NANBOX_OFNULL();
   }
 
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
 
   for (size_t i = 0; i < argc; ++i) {
     siheap_refbox(argv[i]);
-    siheap_array_t *new_pair = source_pair_ptr(argv[i], NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(argv[i], NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -710,17 +707,17 @@ static sinanbox_t sivmfn_prim_map(uint8_t argc, sinanbox_t *argv) {
   const sinanbox_t map_fn = argv[0];
 
   sinanbox_t old_list = argv[1];
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
   while (!NANBOX_ISNULL(old_list)) {
-    siheap_array_t *pair = nanbox_toarray(old_list);
-    sinanbox_t cur = siarray_get(pair, 0);
-    old_list = siarray_get(pair, 1);
+    siheap_header_t *pair = nanbox_toarray(old_list);
+    sinanbox_t cur = siarray_load(pair, 0);
+    old_list = siarray_load(pair, 1);
     siheap_refbox(cur);
     sinanbox_t newval = siexec_nanbox(map_fn, 1, &cur);
-    siheap_array_t *new_pair = source_pair_ptr(newval, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(newval, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -743,12 +740,12 @@ static sinanbox_t sivmfn_prim_member(uint8_t argc, sinanbox_t *argv) {
 
   sinanbox_t list = argv[1];
   while (!NANBOX_ISNULL(list)) {
-    siheap_array_t *pair = nanbox_toarray(list);
-    sinanbox_t cur = siarray_get(pair, 0);
+    siheap_header_t *pair = nanbox_toarray(list);
+    sinanbox_t cur = siarray_load(pair, 0);
     if (sivm_equal(needle, cur)) {
       break;
     }
-    list = siarray_get(pair, 1);
+    list = siarray_load(pair, 1);
   }
 
   siheap_refbox(list);
@@ -764,18 +761,18 @@ static sinanbox_t sivmfn_prim_remove(uint8_t argc, sinanbox_t *argv) {
   const sinanbox_t needle = argv[0];
 
   sinanbox_t list = argv[1];
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
   while (!NANBOX_ISNULL(list)) {
-    siheap_array_t *pair = nanbox_toarray(list);
-    sinanbox_t cur = siarray_get(pair, 0);
-    list = siarray_get(pair, 1);
+    siheap_header_t *pair = nanbox_toarray(list);
+    sinanbox_t cur = siarray_load(pair, 0);
+    list = siarray_load(pair, 1);
 
     if (sivm_equal(cur, needle)) {
       siheap_refbox(list);
       if (prev_pair) {
         assert(new_list);
-        siarray_put(prev_pair, 1, list);
+        prev_pair->data[1] = list;
         return SIHEAP_PTRTONANBOX(new_list);
       } else {
         return list;
@@ -783,9 +780,9 @@ static sinanbox_t sivmfn_prim_remove(uint8_t argc, sinanbox_t *argv) {
     }
 
     siheap_refbox(cur);
-    siheap_array_t *new_pair = source_pair_ptr(cur, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(cur, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -805,20 +802,20 @@ static sinanbox_t sivmfn_prim_remove_all(uint8_t argc, sinanbox_t *argv) {
   const sinanbox_t needle = argv[0];
 
   sinanbox_t list = argv[1];
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
   while (!NANBOX_ISNULL(list)) {
-    siheap_array_t *pair = nanbox_toarray(list);
-    sinanbox_t cur = siarray_get(pair, 0);
-    list = siarray_get(pair, 1);
+    siheap_header_t *pair = nanbox_toarray(list);
+    sinanbox_t cur = siarray_load(pair, 0);
+    list = siarray_load(pair, 1);
     if (sivm_equal(cur, needle)) {
       continue;
     }
 
     siheap_refbox(cur);
-    siheap_array_t *new_pair = source_pair_ptr(cur, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(cur, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -842,12 +839,12 @@ static sinanbox_t sivmfn_prim_reverse(uint8_t argc, sinanbox_t *argv) {
     return list;
   }
 
-  siheap_array_t *new_list = NULL;
+  siheap_pair_t *new_list = NULL;
 
   while (!NANBOX_ISNULL(list)) {
-    siheap_array_t *pair = nanbox_toarray(list);
-    sinanbox_t cur = siarray_get(pair, 0);
-    list = siarray_get(pair, 1);
+    siheap_header_t *pair = nanbox_toarray(list);
+    sinanbox_t cur = siarray_load(pair, 0);
+    list = siarray_load(pair, 1);
 
     siheap_refbox(cur);
     new_list = source_pair_ptr(cur, new_list ? SIHEAP_PTRTONANBOX(new_list) : NANBOX_OFNULL());
@@ -864,13 +861,12 @@ static sinanbox_t sivmfn_prim_array_length(uint8_t argc, sinanbox_t *argv) {
   CHECK_ARGC(1);
   sinanbox_t v = *argv;
   siheap_header_t *obj = SIHEAP_NANBOXTOPTR(v);
-  if (!NANBOX_ISPTR(v) || obj->type != sitype_array) {
+  if (!NANBOX_ISPTR(v) || !siheap_isarray(obj)) {
     sifault(sinter_fault_type);
     return NANBOX_OFEMPTY();
   }
 
-  siheap_array_t *arr = (siheap_array_t *) obj;
-  return NANBOX_WRAP_INT((int) arr->count);
+  return NANBOX_WRAP_INT((int) siarray_length(obj));
 }
 
 /******************************************************************************
@@ -895,9 +891,9 @@ static sinanbox_t sivmfn_prim_list_to_stream(uint8_t argc, sinanbox_t *argv) {
     return list;
   }
 
-  siheap_array_t *pair = nanbox_toarray(list);
-  sinanbox_t head = siarray_get(pair, 0);
-  sinanbox_t tail = siarray_get(pair, 1);
+  siheap_header_t *pair = nanbox_toarray(list);
+  sinanbox_t head = siarray_load(pair, 0);
+  sinanbox_t tail = siarray_load(pair, 1);
   siheap_refbox(head);
   siheap_refbox(tail);
   siheap_intcont_t *ic = siintcont_new(sivmfn_prim_list_to_stream, 1);
@@ -968,15 +964,15 @@ static sinanbox_t sivmfn_prim_eval_stream(uint8_t argc, sinanbox_t *argv) {
     return NANBOX_OFNULL();
   }
 
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
   sinanbox_t stream = argv[0];
   siheap_refbox(stream);
 
   for (int32_t i = 0; i < limit; ++i) {
-    siheap_array_t *stream_pair = nanbox_toarray(stream);
-    sinanbox_t new_val = siarray_get(stream_pair, 0);
-    sinanbox_t stream_tail = siarray_get(stream_pair, 1);
+    siheap_header_t *stream_pair = nanbox_toarray(stream);
+    sinanbox_t new_val = siarray_load(stream_pair, 0);
+    sinanbox_t stream_tail = siarray_load(stream_pair, 1);
     siheap_intref(stream_pair);
     stream = siexec_nanbox(stream_tail, 0, NULL);
     siheap_intderef(stream_pair);
@@ -984,9 +980,9 @@ static sinanbox_t sivmfn_prim_eval_stream(uint8_t argc, sinanbox_t *argv) {
     siheap_refbox(new_val);
     siheap_deref(stream_pair);
 
-    siheap_array_t *new_pair = source_pair_ptr(new_val, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(new_val, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -1041,11 +1037,11 @@ static sinanbox_t prim_stream_cont(uint8_t argc, sinanbox_t *argv) {
   ic->argv[1] = NANBOX_WRAP_UINT(idx + 1);
 
   // ref the new pair's head
-  siheap_refbox(arr->data->data[idx]);
+  siheap_refbox(siarray_data(arr)[idx]);
   // ref the array (since it's going into the continuation)
   siheap_ref(arr);
 
-  return source_pair(arr->data->data[idx], SIHEAP_PTRTONANBOX(ic));
+  return source_pair(siarray_data(arr)[idx], SIHEAP_PTRTONANBOX(ic));
 }
 
 static sinanbox_t sivmfn_prim_stream(uint8_t argc, sinanbox_t *argv) {
@@ -1063,7 +1059,7 @@ static sinanbox_t sivmfn_prim_stream(uint8_t argc, sinanbox_t *argv) {
   }
 
   siheap_array_t *arr = siarray_new(argc - 1);
-  memcpy(arr->data->data, argv + 1, (argc - 1)*sizeof(sinanbox_t));
+  memcpy(siarray_data(arr), argv + 1, (argc - 1)*sizeof(sinanbox_t));
   arr->count = argc - 1;
 
   siheap_intcont_t *ic = siintcont_new(prim_stream_cont, 2);
@@ -1093,9 +1089,9 @@ static sinanbox_t sivmfn_prim_stream_append(uint8_t argc, sinanbox_t *argv) {
     return ys;
   }
 
-  siheap_array_t *stream_pair = nanbox_toarray(argv[0]);
-  sinanbox_t stream_head = siarray_get(stream_pair, 0);
-  sinanbox_t stream_tail = siarray_get(stream_pair, 1);
+  siheap_header_t *stream_pair = nanbox_toarray(argv[0]);
+  sinanbox_t stream_head = siarray_load(stream_pair, 0);
+  sinanbox_t stream_tail = siarray_load(stream_pair, 1);
   siheap_refbox(stream_head);
   siheap_refbox(stream_tail);
 
@@ -1128,9 +1124,9 @@ static sinanbox_t sivmfn_prim_stream_filter(uint8_t argc, sinanbox_t *argv) {
 
   siheap_refbox(xs);
   while (!NANBOX_ISNULL(xs)) {
-    siheap_array_t *stream_pair = nanbox_toarray(xs);
-    sinanbox_t head = siarray_get(stream_pair, 0);
-    sinanbox_t tail = siarray_get(stream_pair, 1);
+    siheap_header_t *stream_pair = nanbox_toarray(xs);
+    sinanbox_t head = siarray_load(stream_pair, 0);
+    sinanbox_t tail = siarray_load(stream_pair, 1);
 
     siheap_intref(stream_pair);
     siheap_refbox(head);
@@ -1175,9 +1171,9 @@ static sinanbox_t sivmfn_prim_stream_for_each(uint8_t argc, sinanbox_t *argv) {
 
   siheap_refbox(stream);
   while (!NANBOX_ISNULL(stream)) {
-    siheap_array_t *stream_pair = nanbox_toarray(stream);
-    sinanbox_t head = siarray_get(stream_pair, 0);
-    sinanbox_t stream_tail = siarray_get(stream_pair, 1);
+    siheap_header_t *stream_pair = nanbox_toarray(stream);
+    sinanbox_t head = siarray_load(stream_pair, 0);
+    sinanbox_t stream_tail = siarray_load(stream_pair, 1);
     siheap_intref(stream_pair);
     siheap_refbox(head);
     siheap_derefbox(siexec_nanbox(fn, 1, &head));
@@ -1234,9 +1230,9 @@ static sinanbox_t sivmfn_prim_stream_map(uint8_t argc, sinanbox_t *argv) {
     return NANBOX_OFNULL();
   }
 
-  siheap_array_t *stream_pair = nanbox_toarray(xs);
-  sinanbox_t head = siarray_get(stream_pair, 0);
-  sinanbox_t tail = siarray_get(stream_pair, 1);
+  siheap_header_t *stream_pair = nanbox_toarray(xs);
+  sinanbox_t head = siarray_load(stream_pair, 0);
+  sinanbox_t tail = siarray_load(stream_pair, 1);
 
   siheap_refbox(head);
   sinanbox_t fn_res = siexec_nanbox(fn, 1, &head);
@@ -1259,9 +1255,9 @@ static sinanbox_t sivmfn_prim_stream_member(uint8_t argc, sinanbox_t *argv) {
 
   siheap_refbox(xs);
   while (!NANBOX_ISNULL(xs)) {
-    siheap_array_t *stream_pair = nanbox_toarray(xs);
-    sinanbox_t head = siarray_get(stream_pair, 0);
-    sinanbox_t tail = siarray_get(stream_pair, 1);
+    siheap_header_t *stream_pair = nanbox_toarray(xs);
+    sinanbox_t head = siarray_load(stream_pair, 0);
+    sinanbox_t tail = siarray_load(stream_pair, 1);
 
     if (sivm_equal(head, needle)) {
       return xs;
@@ -1318,9 +1314,9 @@ static sinanbox_t sivmfn_prim_stream_remove(uint8_t argc, sinanbox_t *argv) {
     return NANBOX_OFNULL();
   }
 
-  siheap_array_t *stream_pair = nanbox_toarray(xs);
-  sinanbox_t head = siarray_get(stream_pair, 0);
-  sinanbox_t tail = siarray_get(stream_pair, 1);
+  siheap_header_t *stream_pair = nanbox_toarray(xs);
+  sinanbox_t head = siarray_load(stream_pair, 0);
+  sinanbox_t tail = siarray_load(stream_pair, 1);
 
   if (!sivm_equal(head, needle)) {
     siheap_intcont_t *ic = siintcont_new(prim_stream_remove_cont, 2);
@@ -1359,9 +1355,9 @@ static sinanbox_t sivmfn_prim_stream_remove_all(uint8_t argc, sinanbox_t *argv)
 
   siheap_refbox(xs);
   while (!NANBOX_ISNULL(xs)) {
-    siheap_array_t *stream_pair = nanbox_toarray(xs);
-    sinanbox_t head = siarray_get(stream_pair, 0);
-    sinanbox_t tail = siarray_get(stream_pair, 1);
+    siheap_header_t *stream_pair = nanbox_toarray(xs);
+    sinanbox_t head = siarray_load(stream_pair, 0);
+    sinanbox_t tail = siarray_load(stream_pair, 1);
 
     if (!sivm_equal(needle, head)) {
       siheap_intcont_t *ic = siintcont_new(prim_stream_remove_all_cont, 2);
@@ -1406,11 +1402,11 @@ static sinanbox_t prim_stream_reverse_cont(uint8_t argc, sinanbox_t *argv) {
   ic->argv[1] = NANBOX_OFINT(idx - 1);
 
   // ref the new pair's head
-  siheap_refbox(arr->data->data[idx - 1]);
+  siheap_refbox(siarray_data(arr)[idx - 1]);
   // ref the array (since it's going into the continuation)
   siheap_ref(arr);
 
-  return source_pair(arr->data->data[idx - 1], SIHEAP_PTRTONANBOX(ic));
+  return source_pair(siarray_data(arr)[idx - 1], SIHEAP_PTRTONANBOX(ic));
 }
 
 static sinanbox_t sivmfn_prim_stream_reverse(uint8_t argc, sinanbox_t *argv) {
@@ -1427,9 +1423,9 @@ static sinanbox_t sivmfn_prim_stream_reverse(uint8_t argc, sinanbox_t *argv) {
   address_t index = 0;
   siheap_refbox(xs);
   while (!NANBOX_ISNULL(xs)) {
-    siheap_array_t *stream_pair = nanbox_toarray(xs);
-    sinanbox_t head = siarray_get(stream_pair, 0);
-    sinanbox_t tail = siarray_get(stream_pair, 1);
+    siheap_header_t *stream_pair = nanbox_toarray(xs);
+    sinanbox_t head = siarray_load(stream_pair, 0);
+    sinanbox_t tail = siarray_load(stream_pair, 1);
 
     siheap_refbox(head);
     siarray_put(stream_array, index++, head);
@@ -1470,13 +1466,13 @@ static sinanbox_t sivmfn_prim_stream_to_list(uint8_t argc, sinanbox_t *argv) {
     return NANBOX_OFNULL();
   }
 
-  siheap_array_t *new_list = NULL;
-  siheap_array_t *prev_pair = NULL;
+  siheap_pair_t *new_list = NULL;
+  siheap_pair_t *prev_pair = NULL;
   siheap_refbox(stream);
   while (!NANBOX_ISNULL(stream)) {
-    siheap_array_t *stream_pair = nanbox_toarray(stream);
-    sinanbox_t new_val = siarray_get(stream_pair, 0);
-    sinanbox_t stream_tail = siarray_get(stream_pair, 1);
+    siheap_header_t *stream_pair = nanbox_toarray(stream);
+    sinanbox_t new_val = siarray_load(stream_pair, 0);
+    sinanbox_t stream_tail = siarray_load(stream_pair, 1);
     siheap_intref(stream_pair);
     stream = siexec_nanbox(stream_tail, 0, NULL);
     siheap_intderef(stream_pair);
@@ -1484,9 +1480,9 @@ static sinanbox_t sivmfn_prim_stream_to_list(uint8_t argc, sinanbox_t *argv) {
     siheap_refbox(new_val);
     siheap_deref(stream_pair);
 
-    siheap_array_t *new_pair = source_pair_ptr(new_val, NANBOX_OFNULL());
+    siheap_pair_t *new_pair = source_pair_ptr(new_val, NANBOX_OFNULL());
     if (prev_pair) {
-      siarray_put(prev_pair, 1, SIHEAP_PTRTONANBOX(new_pair));
+      prev_pair->data[1] = SIHEAP_PTRTONANBOX(new_pair);
     }
     if (!new_list) {
       new_list = new_pair;
@@ -1506,14 +1502,14 @@ static sinanbox_t sivmfn_prim_is_stream(uint8_t argc, sinanbox_t *argv) {
 
   siheap_refbox(xs);
   while (!NANBOX_ISNULL(xs)) {
-    siheap_header_t *obj = SIHEAP_NANBOXTOPTR(xs);
-    siheap_array_t *pair = (siheap_array_t *) obj;
-    if (!NANBOX_ISPTR(xs) || obj->type != sitype_array || pair->count != 2) {
+    if (!is_source_pair(xs)) {
       siheap_derefbox(xs);
       return NANBOX_OFBOOL(false);
     }
 
-    sinanbox_t tail = siarray_get(pair, 1);
+    siheap_header_t *pair = SIHEAP_NANBOXTOPTR(xs);
+
+    sinanbox_t tail = siarray_load(pair, 1);
     siheap_header_t *tailobj = SIHEAP_NANBOXTOPTR(tail);
 
     if (!NANBOX_ISIFN(tail)
@@ -1555,20 +1551,14 @@ static inline bool structural_equal(sinanbox_t l, sinanbox_t r) {
     return false;
   }
 
-  siheap_header_t *lv = SIHEAP_NANBOXTOPTR(l);
-  siheap_header_t *rv = SIHEAP_NANBOXTOPTR(r);
-  if (lv->type != sitype_array || rv->type != sitype_array) {
-    return false;
-  }
-
-  siheap_array_t *la = (siheap_array_t *) lv;
-  siheap_array_t *ra = (siheap_array_t *) rv;
-  if (la->count != 2 || ra->count != 2) {
+  if (!is_source_pair(l) || !is_source_pair(r)) {
     return false;
   }
 
-  return structural_equal(siarray_get(la, 0), siarray_get(ra, 0))
-    && structural_equal(siarray_get(la, 1), siarray_get(ra, 1));
+  siheap_header_t *lv = SIHEAP_NANBOXTOPTR(l);
+  siheap_header_t *rv = SIHEAP_NANBOXTOPTR(r);
+  return structural_equal(siarray_load(lv, 0), siarray_load(rv, 0))
+    && structural_equal(siarray_load(lv, 1), siarray_load(rv, 1));
 }
 
 static sinanbox_t sivmfn_prim_equal(uint8_t argc, sinanbox_t *argv) {
@@ -0,0 +1,507 @@
+#include <sinter/config.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sinter/opcode.h>
+#include <sinter/program.h>
+#include <sinter/verify.h>
+#include <sinter/heap.h>
+#include <sinter/vm.h>
+#include <sinter/debug.h>
+
+#ifdef SINTER_VERIFY
+/*
+ * The verifier follows control flow from the entry point, and keeps an
+ * abstract state for every instruction it reaches: the depth of the operand
+ * stack, the stack size of the function, and the shape of the environment
+ * chain.
+ *
+ * Environment chains are kept in a table of nodes, each of which is the size of
+ * an environment and the node of its parent. A function's environment is a node
+ * whose parent is the environment the function was created in (by new.c), and a
+ * newenv block is a node whose parent is the enclosing environment. Nodes are
+ * interned, so two chains have the same shape exactly when they are the same
+ * node.
+ *
+ * An instruction that is reached more than once must be reached with the same
+ * state each time, and a function must always be created in environments of the
+ * same shape. Programs from the Source compiler always satisfy both.
+ *
+ * Like the decoder, the verifier places its scratch area at the top of the
+ * heap, which is empty at this point.
+ */
+
+#define BITMAP_GET(map, addr) ((map)[(addr) >> 3] & (1u << ((addr) & 7)))
+#define BITMAP_SET(map, addr) ((map)[(addr) >> 3] |= (1u << ((addr) & 7)))
+#define BITMAP_CLEAR(map, addr) ((map)[(addr) >> 3] &= ~(1u << ((addr) & 7)))
+
+// The parent of the entry point's environment
+#define NO_ENV UINT16_MAX
+
+struct state {
+  // the number of entries on the operand stack
+  uint8_t depth;
+  // the stack size of the current function
+  uint8_t stack_size;
+  // the node of the current environment
+  uint16_t env;
+};
+
+struct env_node {
+  uint16_t parent;
+  uint8_t size;
+  // whether this is a function's environment, rather than a newenv block
+  bool is_function;
+};
+
+static const opcode_t *program;
+static address_t program_size;
+// state of each reached instruction, indexed by SVML address
+// for function headers, env is the function's environment
+static struct state *states;
+static struct env_node *envs;
+static address_t env_count;
+static address_t env_capacity;
+// SVML addresses of reached instructions
+static uint8_t *reached;
+// SVML addresses of reached instructions that have not been followed yet
+static uint8_t *pending;
+// SVML addresses that are part of a reached instruction or function header, but not its start
+static uint8_t *interior;
+// SVML addresses of reached function headers
+static uint8_t *functions;
+// SVML addresses of string constants
+static uint8_t *constants;
+// whether anything was added to pending in this pass
+static bool pending_added;
+
+/**
+ * Marks the string constants in the constant pool.
+ */
+static bool mark_constants(void) {
+  const svm_header_t *header = (const svm_header_t *) program;
+  address_t addr = sizeof(svm_header_t);
+  for (uint32_t i = 0; i < header->constant_count; ++i) {
+    if (addr > program_size || program_size - addr < sizeof(svm_constant_t)) {
+      SIDEBUG("Verifier: constant %"PRIu32" is out of bounds\n", i);
+      return false;
+    }
+    const svm_constant_t *constant = (const svm_constant_t *) (program + addr);
+    const address_t data = addr + sizeof(svm_constant_t);
+    if (!constant->length || program_size - data < constant->length || program[data + constant->length - 1]) {
+      SIDEBUG("Verifier: constant %"PRIu32" is truncated or not terminated\n", i);
+      return false;
+    }
+    BITMAP_SET(constants, addr);
+    addr = (data + constant->length + 3) & ~(address_t) 3;
+  }
+  return true;
+}
+
+/**
+ * Gets the node for the given environment, adding it if needed. Returns NO_ENV
+ * if the table is full.
+ */
+static uint16_t intern_env(uint16_t parent, uint8_t size, bool is_function) {
+  for (address_t i = 0; i < env_count; ++i) {
+    if (envs[i].parent == parent && envs[i].size == size && envs[i].is_function == is_function) {
+      return (uint16_t) i;
+    }
+  }
+
+  if (env_count >= env_capacity) {
+    SIDEBUG("Verifier: too many environments\n");
+    return NO_ENV;
+  }
+  envs[env_count] = (struct env_node) { parent, size, is_function };
+  return (uint16_t) env_count++;
+}
+
+/**
+ * Marks [start, end) as the inside of an instruction or function header.
+ */
+static bool mark_interior(address_t start, address_t end) {
+  for (address_t addr = start; addr < end; ++addr) {
+    if (BITMAP_GET(reached, addr)) {
+      SIDEBUG("Verifier: instruction at 0x%"PRIx32" overlaps another instruction or function\n", addr);
+      return false;
+    }
+    BITMAP_SET(interior, addr);
+  }
+  return true;
+}
+
+/**
+ * Records that the instruction at addr is reached with the given state.
+ */
+static bool reach(address_t addr, struct state state) {
+  if (addr >= program_size || BITMAP_GET(interior, addr)) {
+    SIDEBUG("Verifier: 0x%"PRIx32" is not the start of an instruction\n", addr);
+    return false;
+  }
+
+  if (BITMAP_GET(reached, addr)) {
+    const struct state old = states[addr];
+    if (old.depth != state.depth || old.stack_size != state.stack_size || old.env != state.env) {
+      SIDEBUG("Verifier: instruction at 0x%"PRIx32" is reached with different stack depths or environments\n", addr);
+      return false;
+    }
+    return true;
+  }
+
+  BITMAP_SET(reached, addr);
+  BITMAP_SET(pending, addr);
+  pending_added = true;
+  states[addr] = state;
+  return true;
+}
+
+/**
+ * Records that the function at addr is created in the given environment.
+ */
+static bool reach_function(address_t addr, uint16_t outer_env) {
+  if (addr >= program_size || program_size - addr <= offsetof(svm_function_t, code)) {
+    SIDEBUG("Verifier: function at 0x%"PRIx32" is out of bounds\n", addr);
+    return false;
+  }
+
+  const svm_function_t *fn = (const svm_function_t *) (program + addr);
+  const uint16_t env = intern_env(outer_env, fn->env_size, true);
+  if (env == NO_ENV) {
+    return false;
+  }
+
+  if (BITMAP_GET(functions, addr)) {
+    if (states[addr].env != env) {
+      SIDEBUG("Verifier: function at 0x%"PRIx32" is created in different environments\n", addr);
+      return false;
+    }
+    return true;
+  }
+
+  BITMAP_SET(functions, addr);
+  if (!mark_interior(addr, addr + offsetof(svm_function_t, code))) {
+    return false;
+  }
+  states[addr].env = env;
+  return reach(addr + offsetof(svm_function_t, code), (struct state) { 0, fn->stack_size, env });
+}
+
+/**
+ * Gets the environment envindex levels up from env, or NO_ENV if there is none.
+ */
+static uint16_t parent_env(uint16_t env, unsigned int envindex) {
+  while (env != NO_ENV && envindex--) {
+    env = envs[env].parent;
+  }
+  return env;
+}
+
+/**
+ * Checks that index is within the environment envindex levels up from env.
+ */
+static bool check_env_index(uint16_t env, unsigned int envindex, unsigned int index) {
+  env = parent_env(env, envindex);
+  return env != NO_ENV && index < envs[env].size;
+}
+
+/**
+ * Follows the instructions from addr, until the end of a basic block, or an
+ * instruction that has been reached before.
+ */
+static bool follow(address_t addr) {
+  BITMAP_CLEAR(pending, addr);
+  struct state state = states[addr];
+
+  while (1) {
+    const opcode_t op = program[addr];
+    const address_t size = siop_size(op);
+    if (!size) {
+      SIDEBUG("Verifier: invalid instruction %02x at 0x%"PRIx32"\n", op, addr);
+      return false;
+    }
+    if (program_size - addr < size) {
+      SIDEBUG("Verifier: instruction at 0x%"PRIx32" is truncated\n", addr);
+      return false;
+    }
+    if (!mark_interior(addr + 1, addr + size)) {
+      return false;
+    }
+
+    unsigned int pops = 0;
+    unsigned int pushes = 0;
+    bool falls_through = true;
+    switch (op) {
+    case op_nop:
+      break;
+    case op_ldc_i:
+    case op_lgc_i:
+    case op_ldc_f32:
+    case op_lgc_f32:
+    case op_ldc_f64:
+    case op_lgc_f64:
+    case op_ldc_b_0:
+    case op_ldc_b_1:
+    case op_lgc_b_0:
+    case op_lgc_b_1:
+    case op_lgc_u:
+    case op_lgc_n:
+    case op_new_a:
+    case op_new_c_p:
+    case op_new_c_v:
+      pushes = 1;
+      break;
+    case op_lgc_s: {
+      const address_t constant = ((const struct op_address *) (program + addr))->address;
+      if (constant >= program_size || !BITMAP_GET(constants, constant)) {
+        SIDEBUG("Verifier: lgc.s at 0x%"PRIx32" does not refer to a constant\n", addr);
+        return false;
+      }
+      pushes = 1;
+      break;
+    }
+    case op_pop_g:
+    case op_pop_b:
+    case op_pop_f:
+      pops = 1;
+      break;
+    case op_add_g:
+    case op_add_f:
+    case op_sub_g:
+    case op_sub_f:
+    case op_mul_g:
+    case op_mul_f:
+    case op_div_g:
+    case op_div_f:
+    case op_mod_g:
+    case op_mod_f:
+    case op_lt_g:
+    case op_lt_f:
+    case op_gt_g:
+    case op_gt_f:
+    case op_le_g:
+    case op_le_f:
+    case op_ge_g:
+    case op_ge_f:
+    case op_eq_g:
+    case op_eq_f:
+    case op_eq_b:
+    case op_neq_g:
+    case op_neq_f:
+    case op_neq_b:
+    case op_lda_g:
+    case op_lda_b:
+    case op_lda_f:
+      pops = 2;
+      pushes = 1;
+      break;
+    case op_not_g:
+    case op_not_b:
+    case op_neg_g:
+    case op_neg_f:
+      pops = 1;
+      pushes = 1;
+      break;
+    case op_dup:
+      pops = 1;
+      pushes = 2;
+      break;
+    case op_sta_g:
+    case op_sta_b:
+    case op_sta_f:
+      pops = 3;
+      break;
+    case op_new_c:
+      if (!reach_function(((const struct op_address *) (program + addr))->address, state.env)) {
+        return false;
+      }
+      pushes = 1;
+      break;
+    case op_ldl_g:
+    case op_ldl_f:
+    case op_ldl_b:
+    case op_stl_g:
+    case op_stl_b:
+    case op_stl_f: {
+      const struct op_oneindex *instr = (const struct op_oneindex *) (program + addr);
+      if (!check_env_index(state.env, 0, instr->index)) {
+        SIDEBUG("Verifier: environment access at 0x%"PRIx32" is out of bounds\n", addr);
+        return false;
+      }
+      if (op == op_ldl_g || op == op_ldl_f || op == op_ldl_b) {
+        pushes = 1;
+      } else {
+        pops = 1;
+      }
+      break;
+    }
+    case op_ldp_g:
+    case op_ldp_f:
+    case op_ldp_b:
+    case op_stp_g:
+    case op_stp_b:
+    case op_stp_f: {
+      const struct op_twoindex *instr = (const struct op_twoindex *) (program + addr);
+      if (!check_env_index(state.env, instr->envindex, instr->index)) {
+        SIDEBUG("Verifier: environment access at 0x%"PRIx32" is out of bounds\n", addr);
+        return false;
+      }
+      if (op == op_ldp_g || op == op_ldp_f || op == op_ldp_b) {
+        pushes = 1;
+      } else {
+        pops = 1;
+      }
+      break;
+    }
+    case op_newenv:
+      state.env = intern_env(state.env, ((const struct op_oneindex *) (program + addr))->index, false);
+      if (state.env == NO_ENV) {
+        return false;
+      }
+      break;
+    case op_popenv:
+      if (envs[state.env].is_function) {
+        SIDEBUG("Verifier: popenv at 0x%"PRIx32" has no matching newenv\n", addr);
+        return false;
+      }
+      state.env = envs[state.env].parent;
+      break;
+    case op_br_t:
+    case op_br_f:
+      pops = 1;
+      break;
+    case op_br:
+    case op_jmp:
+      falls_through = false;
+      break;
+    case op_call:
+    case op_call_t:
+      pops = ((const struct op_call *) (program + addr))->num_args + 1u;
+      pushes = 1;
+      falls_through = op == op_call;
+      break;
+    case op_call_p:
+    case op_call_t_p:
+    case op_call_v:
+    case op_call_t_v:
+      pops = ((const struct op_call_internal *) (program + addr))->num_args;
+      pushes = 1;
+      falls_through = op == op_call_p || op == op_call_v;
+      break;
+    case op_ret_g:
+    case op_ret_f:
+    case op_ret_b:
+      pops = 1;
+      falls_through = false;
+      break;
+    case op_ret_u:
+    case op_ret_n:
+      falls_through = false;
+      break;
+    default:
+      SIDEBUG("Verifier: invalid instruction %02x at 0x%"PRIx32"\n", op, addr);
+      return false;
+    }
+
+    if (state.depth < pops) {
+      SIDEBUG("Verifier: stack underflow at 0x%"PRIx32"\n", addr);
+      return false;
+    }
+    if (state.depth - pops + pushes > state.stack_size) {
+      SIDEBUG("Verifier: stack overflow at 0x%"PRIx32"\n", addr);
+      return false;
+    }
+    state.depth = (uint8_t) (state.depth - pops + pushes);
+
+    switch (op) {
+    case op_br_t:
+    case op_br_f:
+    case op_br: {
+      const struct op_offset *instr = (const struct op_offset *) (program + addr);
+      const int64_t target = (int64_t) addr + sizeof(*instr) + instr->offset;
+      if (target < 0 || target >= program_size || !reach((address_t) target, state)) {
+        SIDEBUG("Verifier: branch at 0x%"PRIx32" is out of bounds\n", addr);
+        return false;
+      }
+      break;
+    }
+    case op_jmp:
+      if (!reach(((const struct op_address *) (program + addr))->address, state)) {
+        return false;
+      }
+      break;
+    default:
+      break;
+    }
+
+    if (!falls_through) {
+      return true;
+    }
+
+    addr += size;
+    const bool seen = addr < program_size && BITMAP_GET(reached, addr);
+    if (!reach(addr, state)) {
+      return false;
+    }
+    if (seen) {
+      return true;
+    }
+    BITMAP_CLEAR(pending, addr);
+  }
+}
+
+bool siverify_program(void) {
+  program = sistate.program;
+  program_size = (address_t) (sistate.program_end - sistate.program);
+  if (program_size < sizeof(svm_header_t)) {
+    return false;
+  }
+
+  // set up the scratch area at the top of the heap
+  const address_t bitmap_size = (program_size + 7) >> 3;
+  env_capacity = program_size / 2 + 1;
+  if (env_capacity > NO_ENV) {
+    env_capacity = NO_ENV;
+  }
+  const address_t scratch_size = program_size*sizeof(struct state) + env_capacity*sizeof(struct env_node) + 5*bitmap_size;
+  if (scratch_size + sizeof(siheap_free_t) > SINTER_HEAP_SIZE) {
+    SIDEBUG("Verifier: program is too large to verify\n");
+    return false;
+  }
+  unsigned char *const scratch = siheap + ((SINTER_HEAP_SIZE - scratch_size) & ~(size_t) 3);
+  states = (struct state *) scratch;
+  envs = (struct env_node *) (scratch + program_size*sizeof(struct state));
+  reached = (uint8_t *) (envs + env_capacity);
+  pending = reached + bitmap_size;
+  interior = pending + bitmap_size;
+  functions = interior + bitmap_size;
+  constants = functions + bitmap_size;
+  memset(reached, 0, 5*bitmap_size);
+  env_count = 0;
+
+  if (!mark_constants()) {
+    return false;
+  }
+
+  pending_added = false;
+  if (!reach_function(((const svm_header_t *) program)->entry, NO_ENV)) {
+    return false;
+  }
+  while (pending_added) {
+    pending_added = false;
+    for (address_t addr = 0; addr < program_size; ++addr) {
+      if (BITMAP_GET(pending, addr) && !follow(addr)) {
+        return false;
+      }
+    }
+  }
+
+  SIDEBUG("Program verified; running without runtime checks\n");
+  return true;
+}
+
+#endif
@@ -16,7 +16,9 @@
 #include <sinter/stack.h>
 #include <sinter/debug.h>
 #include <sinter/program.h>
+#include <sinter/aot.h>
 
+#ifndef SINTER_VM_UNCHECKED
 struct sistate sistate;
 
 const sivmfnptr_t *sivmfn_vminternals = NULL;
@@ -27,6 +29,8 @@ sinter_printfn_integer sinter_printer_integer = NULL;
 sinter_printfn_float sinter_printer_float = NULL;
 sinter_printfn_flush sinter_printer_flush = NULL;
 
+sinter_stats_t sinter_stats;
+
 #if 0
 static inline void unimpl_instr() {
   SIBUGV("Unimplemented instruction %02x at address 0x%tx\n", *sistate.pc, SISTATE_CURADDR);
@@ -67,13 +71,109 @@ bool sivm_equal(sinanbox_t l, sinanbox_t r) {
     return false;
   }
 }
+#endif
+
+/**
+ * Computes a % b for two integers, with the semantics of fmodf.
+ */
+static inline sinanbox_t int_mod(int32_t a, int32_t b) {
+  if (b == 0) {
+    return NANBOX_CANONICAL_NAN;
+  }
+  const int32_t r = a % b;
+  // the result has the sign of the dividend, so this is -0
+  if (r == 0 && a < 0) {
+    return NANBOX_OFFLOAT(-0.0f);
+  }
+  return NANBOX_OFINT(r);
+}
+
+static inline bool is_string(sinanbox_t v) {
+  return NANBOX_ISPTR(v) && siheap_is_string(SIHEAP_NANBOXTOPTR(v));
+}
+
+/**
+ * Concatenates two strings. Returns a new reference to the result.
+ */
+static inline sinanbox_t concat_strings(sinanbox_t v0, sinanbox_t v1) {
+  siheap_header_t *hv0 = SIHEAP_NANBOXTOPTR(v0);
+  siheap_header_t *hv1 = SIHEAP_NANBOXTOPTR(v1);
+
+  // if either are empty string, no-op
+  if (hv0->type == sitype_strconst && *(((siheap_strconst_t *) hv0)->string->data) == '\0') {
+    siheap_ref(hv1);
+    return v1;
+  } else if (hv1->type == sitype_strconst && *(((siheap_strconst_t *) hv1)->string->data) == '\0') {
+    siheap_ref(hv0);
+    return v0;
+  }
+
+  siheap_strpair_t *obj = sistrpair_new(hv0, hv1);
+  return SIHEAP_PTRTONANBOX(obj);
+}
+
+#ifdef SINTER_QUICKEN
+// The number of times in a row an instruction must see the same kind of
+// operands before it is quickened
+#define QUICKEN_THRESHOLD 8
+// Instructions that have been deoptimised this many times are left generic
+#define QUICKEN_MAX_DEOPTS 4
 
-static inline void pop_array_args(siheap_array_t **array, address_t *index) {
+/**
+ * Records the kind of the two operands on top of the stack for the current
+ * instruction, and quickens the instruction once it has seen the same kind
+ * QUICKEN_THRESHOLD times in a row.
+ *
+ * quick_ii, quick_ff and quick_strstr are the quickened opcodes for two
+ * integers, two floats and two strings respectively, or 0 if there is none.
+ */
+static inline void quicken_feedback(unsigned int quick_ii, unsigned int quick_ff, unsigned int quick_strstr) {
+  struct sidec_op_feedback *site = (struct sidec_op_feedback *) sistate.pc;
+  if (site->deopts >= QUICKEN_MAX_DEOPTS) {
+    return;
+  }
+
+  sinanbox_t v1 = sistack_peek(0);
+  sinanbox_t v0 = sistack_peek(1);
+  unsigned int kind = 0;
+  if (NANBOX_ISBOTHINT(v0, v1)) {
+    kind = quick_ii;
+  } else if (NANBOX_ISFLOAT(v0) && NANBOX_ISFLOAT(v1)) {
+    kind = quick_ff;
+  } else if (quick_strstr && is_string(v0) && is_string(v1)) {
+    kind = quick_strstr;
+  }
+
+  if (!kind || kind != site->kind) {
+    site->kind = kind;
+    site->count = 1;
+  } else if (++site->count >= QUICKEN_THRESHOLD) {
+    site->opcode = kind;
+  }
+}
+
+/**
+ * Rewrites the current quickened instruction back into generic_op.
+ */
+static inline void deoptimise(unsigned int generic_op) {
+  struct sidec_op_feedback *site = (struct sidec_op_feedback *) sistate.pc;
+  site->opcode = generic_op;
+  site->kind = 0;
+  site->count = 0;
+  ++site->deopts;
+}
+
+#define QUICKEN_FEEDBACK(quick_ii, quick_ff, quick_strstr) quicken_feedback(quick_ii, quick_ff, quick_strstr)
+#else
+#define QUICKEN_FEEDBACK(quick_ii, quick_ff, quick_strstr) ((void) 0)
+#endif
+
+static inline void pop_array_args(siheap_header_t **array, address_t *index) {
   sinanbox_t indexv = sistack_pop();
   sinanbox_t arrayv = sistack_pop();
   *array = SIHEAP_NANBOXTOPTR(arrayv);
 
-  if (!NANBOX_ISPTR(arrayv) || (*array)->header.type != sitype_array) {
+  if (!NANBOX_ISPTR(arrayv) || !siheap_isarray(*array)) {
     sifault(sinter_fault_type);
     return;
   }
@@ -96,26 +196,32 @@ static inline void pop_array_args(siheap_array_t **array, address_t *index) {
   }
 }
 
-static inline bool do_internal_function(
-  const uint8_t id,
-  const uint8_t num_args,
-  size_t sizeof_instr,
-  const bool is_primitive,
-  const bool is_tailcall,
-  const bool pop_fn) {
+/**
+ * Gets an internal function. Faults if it does not exist.
+ */
+static inline sivmfnptr_t get_internal_function(const uint8_t id, const bool is_primitive) {
   if ((is_primitive && id >= SIVMFN_PRIMITIVE_COUNT) || (!is_primitive && id >= sivmfn_vminternal_count)) {
     SIDEBUG("Invalid %s function index %d\n", is_primitive ? "primitive" : "VM-internal", id);
     sifault(sinter_fault_invalid_program);
-    return false;
+    return NULL;
   }
 
+  return (is_primitive ? sivmfn_primitives : sivmfn_vminternals)[id];
+}
+
+static inline bool call_internal_function(
+  const sivmfnptr_t fn,
+  const uint8_t num_args,
+  size_t sizeof_instr,
+  const bool is_tailcall,
+  const bool pop_fn) {
   // check that there are enough items on the stack
   if (num_args > 0) {
     sistack_peek(num_args - 1);
   }
 
   // call the function
-  sinanbox_t retv = (is_primitive ? sivmfn_primitives : sivmfn_vminternals)[id](num_args, sistack_top - num_args);
+  sinanbox_t retv = fn(num_args, sistack_top - num_args);
 
   // pop the arguments off the stack
   for (unsigned int i = 0; i < num_args; ++i) {
@@ -129,7 +235,7 @@ static inline bool do_internal_function(
 
   // if tail call, we destroy the caller's stack now, and "return" to the caller's caller
   if (is_tailcall) {
-    siheap_deref(sistate.env);
+    sienv_release(sistate.env);
     sistack_destroy(&sistate.pc, &sistate.env);
   } else {
     // otherwise we advance to the return address
@@ -146,120 +252,321 @@ static inline bool do_internal_function(
   return false;
 }
 
+static inline bool do_internal_function(
+  const uint8_t id,
+  const uint8_t num_args,
+  size_t sizeof_instr,
+  const bool is_primitive,
+  const bool is_tailcall,
+  const bool pop_fn) {
+  return call_internal_function(get_internal_function(id, is_primitive), num_args, sizeof_instr, is_tailcall, pop_fn);
+}
+
+#ifdef SINTER_PREDECODE
+// Checks the inline cache of the current call instruction
+#define CALL_CACHE_HIT(key) (instr->cache == (key) ? (SISTATS_INC(call_cache_hits), true) : (SISTATS_INC(call_cache_misses), false))
+// Fills the inline cache of the current call instruction, after the callee has
+// been checked
+#define CALL_CACHE_FILL(key) (((struct sidec_op_call *) instr)->cache = (key))
+// The cache key of a function in the decoded program
+#define CALL_CACHE_FNKEY(fn_code) ((uint32_t) ((const opcode_t *) (fn_code) - sistate.code))
+#else
+#define CALL_CACHE_HIT(key) false
+#define CALL_CACHE_FILL(key) ((void) 0)
+#define CALL_CACHE_FNKEY(fn_code) 0
+#endif
+
+#ifdef SINTER_PREDECODE
+// The length of the display of the environments of a function, and of the
+// blocks in it, as recorded by the decoder
+#define FUNCTION_DISPLAY(fn_code) ((fn_code)->padding >> SIDEC_FUNCTION_DISPLAY_SHIFT)
+#define NEWENV_DISPLAY(instr) ((instr)->padding[0])
+#else
+#define FUNCTION_DISPLAY(fn_code) 0
+#define NEWENV_DISPLAY(instr) 0
+#endif
+
+#ifdef SINTER_PREDECODE
+#define DECLOPSTRUCT(type) const struct sidec_ ## type *instr = (const struct sidec_ ## type *) sistate.pc
+#define ADVANCE_PCONE() sistate.pc += sizeof(struct sidec_op); DISPATCH()
+#else
 #define DECLOPSTRUCT(type) const struct type *instr = (const struct type *) sistate.pc
-#define ADVANCE_PCONE() sistate.pc += sizeof(opcode_t); continue
-#define ADVANCE_PCI() sistate.pc += sizeof(*instr); continue
+#define ADVANCE_PCONE() sistate.pc += sizeof(opcode_t); DISPATCH()
+#endif
+#define ADVANCE_PCI() sistate.pc += sizeof(*instr); DISPATCH()
+
+#ifdef SINTER_DEBUG_MEMORY_CHECK
+#define INSTR_PROLOGUE_MEMCHECK() debug_memorycheck()
+#else
+#define INSTR_PROLOGUE_MEMCHECK() ((void) 0)
+#endif
+
+#ifdef SINTER_DEBUG
+#define INSTR_PROLOGUE() do { \
+  INSTR_PROLOGUE_MEMCHECK(); \
+  if (sistate.pc >= SISTATE_CODE_END) { \
+    SIBUGV("Jumped out of bounds to 0x%tx after instruction at address 0x%tx\n", SISTATE_CURADDR, SISTATE_PCTOADDR(previous_pc)); \
+    sifault(sinter_fault_internal_error); \
+    return; \
+  } \
+  previous_pc = sistate.pc; \
+ \
+  SITRACE("PC: 0x%tx; opcode: %02x (%s)\n", SISTATE_CURADDR, *sistate.pc, get_opcode_name(*sistate.pc)); \
+} while (0)
+#else
+#define INSTR_PROLOGUE() INSTR_PROLOGUE_MEMCHECK()
+#endif
+
+#ifdef SINTER_THREADED_DISPATCH
+// Each handler jumps directly to the next handler through the dispatch table,
+// instead of going back to the single indirect branch of the switch. This
+// gives the branch predictor one indirect branch per handler to work with.
+//
+// The switch is still used for the first instruction executed on each entry
+// into main_loop.
+#define OPCASE(op) case op: handler_ ## op
+#define OPDEFAULT default: handler_invalid
+#define DISPATCH() do { \
+  INSTR_PROLOGUE(); \
+  this_opcode = *sistate.pc; \
+  goto *dispatch_table[this_opcode]; \
+} while (0)
+#else
+#define OPCASE(op) case op
+#define OPDEFAULT default
+#define DISPATCH() continue
+#endif
+
+#ifdef SINTER_THREADED_DISPATCH
+// Labels as values are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
 
 /**
  * Runs the main interpreter loop.
+ *
+ * vm_unchecked.c compiles this file again with SINTER_DISABLE_CHECKS, which
+ * gives the loop used for programs that pass the verifier.
  */
+#ifdef SINTER_VM_UNCHECKED
+void sivm_main_loop_unchecked(void) {
+#else
 static void main_loop(void) {
+#endif
 #ifdef SINTER_DEBUG
   const opcode_t *previous_pc = NULL;
   (void) previous_pc;
 #endif
-  while (1) {
-#ifdef SINTER_DEBUG_MEMORY_CHECK
-    debug_memorycheck();
+#ifdef SINTER_THREADED_DISPATCH
+  static const void *const dispatch_table[256] = {
+    [op_nop] = &&handler_op_nop,
+#ifdef SINTER_PREDECODE
+    // decoded into ldc_nanbox
+    [op_ldc_i] = &&handler_invalid,
+    [op_lgc_i] = &&handler_invalid,
+    [op_ldc_f32] = &&handler_invalid,
+    [op_lgc_f32] = &&handler_invalid,
+    [op_ldc_f64] = &&handler_invalid,
+    [op_lgc_f64] = &&handler_invalid,
+#else
+    [op_ldc_i] = &&handler_op_ldc_i,
+    [op_lgc_i] = &&handler_op_lgc_i,
+    [op_ldc_f32] = &&handler_op_ldc_f32,
+    [op_lgc_f32] = &&handler_op_lgc_f32,
+    [op_ldc_f64] = &&handler_op_ldc_f64,
+    [op_lgc_f64] = &&handler_op_lgc_f64,
 #endif
-#ifdef SINTER_DEBUG
-    if (sistate.pc >= sistate.program_end) {
-      SIBUGV("Jumped out of bounds to 0x%tx after instruction at address 0x%tx\n", SISTATE_CURADDR, previous_pc - sistate.program);
-      sifault(sinter_fault_internal_error);
-      return;
-    }
-    previous_pc = sistate.pc;
-
-    SITRACE("PC: 0x%tx; opcode: %02x (%s)\n", SISTATE_CURADDR, *sistate.pc, get_opcode_name(*sistate.pc));
+    [op_ldc_b_0] = &&handler_op_ldc_b_0,
+    [op_ldc_b_1] = &&handler_op_ldc_b_1,
+    [op_lgc_b_0] = &&handler_op_lgc_b_0,
+    [op_lgc_b_1] = &&handler_op_lgc_b_1,
+    [op_lgc_u] = &&handler_op_lgc_u,
+    [op_lgc_n] = &&handler_op_lgc_n,
+#ifdef SINTER_PREDECODE
+    [op_lgc_s] = &&handler_invalid,
+#else
+    [op_lgc_s] = &&handler_op_lgc_s,
 #endif
-    const opcode_t this_opcode = *sistate.pc;
+    [op_pop_g] = &&handler_op_pop_g,
+    [op_pop_b] = &&handler_op_pop_b,
+    [op_pop_f] = &&handler_op_pop_f,
+    [op_add_g] = &&handler_op_add_g,
+    [op_add_f] = &&handler_op_add_f,
+    [op_sub_g] = &&handler_op_sub_g,
+    [op_sub_f] = &&handler_op_sub_f,
+    [op_mul_g] = &&handler_op_mul_g,
+    [op_mul_f] = &&handler_op_mul_f,
+    [op_div_g] = &&handler_op_div_g,
+    [op_div_f] = &&handler_op_div_f,
+    [op_mod_g] = &&handler_op_mod_g,
+    [op_mod_f] = &&handler_op_mod_f,
+    [op_not_g] = &&handler_op_not_g,
+    [op_not_b] = &&handler_op_not_b,
+    [op_lt_g] = &&handler_op_lt_g,
+    [op_lt_f] = &&handler_op_lt_f,
+    [op_gt_g] = &&handler_op_gt_g,
+    [op_gt_f] = &&handler_op_gt_f,
+    [op_le_g] = &&handler_op_le_g,
+    [op_le_f] = &&handler_op_le_f,
+    [op_ge_g] = &&handler_op_ge_g,
+    [op_ge_f] = &&handler_op_ge_f,
+    [op_eq_g] = &&handler_op_eq_g,
+    [op_eq_f] = &&handler_op_eq_f,
+    [op_eq_b] = &&handler_op_eq_b,
+    [op_new_c] = &&handler_op_new_c,
+    [op_new_a] = &&handler_op_new_a,
+    [op_ldl_g] = &&handler_op_ldl_g,
+    [op_ldl_f] = &&handler_op_ldl_f,
+    [op_ldl_b] = &&handler_op_ldl_b,
+    [op_stl_g] = &&handler_op_stl_g,
+    [op_stl_b] = &&handler_op_stl_b,
+    [op_stl_f] = &&handler_op_stl_f,
+    [op_ldp_g] = &&handler_op_ldp_g,
+    [op_ldp_f] = &&handler_op_ldp_f,
+    [op_ldp_b] = &&handler_op_ldp_b,
+    [op_stp_g] = &&handler_op_stp_g,
+    [op_stp_b] = &&handler_op_stp_b,
+    [op_stp_f] = &&handler_op_stp_f,
+    [op_lda_g] = &&handler_op_lda_g,
+    [op_lda_b] = &&handler_op_lda_b,
+    [op_lda_f] = &&handler_op_lda_f,
+    [op_sta_g] = &&handler_op_sta_g,
+    [op_sta_b] = &&handler_op_sta_b,
+    [op_sta_f] = &&handler_op_sta_f,
+    [op_br_t] = &&handler_op_br_t,
+    [op_br_f] = &&handler_op_br_f,
+    [op_br] = &&handler_op_br,
+    [op_jmp] = &&handler_op_jmp,
+    [op_call] = &&handler_op_call,
+    [op_call_t] = &&handler_op_call_t,
+    [op_call_p] = &&handler_op_call_p,
+    [op_call_t_p] = &&handler_op_call_t_p,
+    [op_call_v] = &&handler_op_call_v,
+    [op_call_t_v] = &&handler_op_call_t_v,
+    [op_ret_g] = &&handler_op_ret_g,
+    [op_ret_f] = &&handler_op_ret_f,
+    [op_ret_b] = &&handler_op_ret_b,
+    [op_ret_u] = &&handler_op_ret_u,
+    [op_ret_n] = &&handler_op_ret_n,
+    [op_dup] = &&handler_op_dup,
+    [op_newenv] = &&handler_op_newenv,
+    [op_popenv] = &&handler_op_popenv,
+    [op_new_c_p] = &&handler_op_new_c_p,
+    [op_new_c_v] = &&handler_op_new_c_v,
+    [op_neg_g] = &&handler_op_neg_g,
+    [op_neg_f] = &&handler_op_neg_f,
+    [op_neq_g] = &&handler_op_neq_g,
+    [op_neq_f] = &&handler_op_neq_f,
+    [op_neq_b] = &&handler_op_neq_b,
+#ifdef SINTER_PREDECODE
+    [op_ldc_nanbox] = &&handler_op_ldc_nanbox,
+    [op_fused_ldl_ldl] = &&handler_op_fused_ldl_ldl,
+    [op_fused_ldl_ldc] = &&handler_op_fused_ldl_ldc,
+    [op_fused_add_i] = &&handler_op_fused_add_i,
+    [op_fused_sub_i] = &&handler_op_fused_sub_i,
+    [op_fused_lt_br_f] = &&handler_op_fused_lt_br_f,
+    [op_fused_gt_br_f] = &&handler_op_fused_gt_br_f,
+    [op_fused_le_br_f] = &&handler_op_fused_le_br_f,
+    [op_fused_ge_br_f] = &&handler_op_fused_ge_br_f,
+#endif
+#ifdef SINTER_QUICKEN
+    [op_quick_add_ii] = &&handler_op_quick_add_ii,
+    [op_quick_add_ff] = &&handler_op_quick_add_ff,
+    [op_quick_add_strstr] = &&handler_op_quick_add_strstr,
+    [op_quick_sub_ii] = &&handler_op_quick_sub_ii,
+    [op_quick_sub_ff] = &&handler_op_quick_sub_ff,
+    [op_quick_lt_ii] = &&handler_op_quick_lt_ii,
+    [op_quick_lt_ff] = &&handler_op_quick_lt_ff,
+    [op_quick_gt_ii] = &&handler_op_quick_gt_ii,
+    [op_quick_gt_ff] = &&handler_op_quick_gt_ff,
+    [op_quick_le_ii] = &&handler_op_quick_le_ii,
+    [op_quick_le_ff] = &&handler_op_quick_le_ff,
+    [op_quick_ge_ii] = &&handler_op_quick_ge_ii,
+    [op_quick_ge_ff] = &&handler_op_quick_ge_ff,
+    [op_quick_lt_br_f_ii] = &&handler_op_quick_lt_br_f_ii,
+    [op_quick_lt_br_f_ff] = &&handler_op_quick_lt_br_f_ff,
+    [op_quick_gt_br_f_ii] = &&handler_op_quick_gt_br_f_ii,
+    [op_quick_gt_br_f_ff] = &&handler_op_quick_gt_br_f_ff,
+    [op_quick_le_br_f_ii] = &&handler_op_quick_le_br_f_ii,
+    [op_quick_le_br_f_ff] = &&handler_op_quick_le_br_f_ff,
+    [op_quick_ge_br_f_ii] = &&handler_op_quick_ge_br_f_ii,
+    [op_quick_ge_br_f_ff] = &&handler_op_quick_ge_br_f_ff,
+    [op_quick_last + 1 ... 255] = &&handler_invalid
+#elif defined(SINTER_PREDECODE)
+    [op_fused_last + 1 ... 255] = &&handler_invalid
+#else
+    [op_neq_b + 1 ... 255] = &&handler_invalid
+#endif
+  };
+#endif
+  opcode_t this_opcode;
+  while (1) {
+    INSTR_PROLOGUE();
+    this_opcode = *sistate.pc;
+#ifdef SINTER_PREDECODE
+    // the fused and quickened opcodes are not part of opcode_t
+    switch ((unsigned int) this_opcode) {
+#else
     switch (this_opcode) {
-    case op_nop:
+#endif
+    OPCASE(op_nop):
       ADVANCE_PCONE();
-    case op_ldc_i:
-    case op_lgc_i: {
+#ifdef SINTER_PREDECODE
+    // ldc/lgc with an operand; the NaN-box was computed by the decoder
+    // String constants belong to the decoded program and are permanent, so this
+    // neither allocates nor counts a reference
+    OPCASE(op_ldc_nanbox): {
+      DECLOPSTRUCT(op_nanbox);
+      sistack_push(instr->value);
+      ADVANCE_PCI();
+    }
+#else
+    OPCASE(op_ldc_i):
+    OPCASE(op_lgc_i): {
       DECLOPSTRUCT(op_i32);
       sistack_push(NANBOX_WRAP_INT(instr->operand));
       ADVANCE_PCI();
     }
-    case op_ldc_f32:
-    case op_lgc_f32: {
+    OPCASE(op_ldc_f32):
+    OPCASE(op_lgc_f32): {
       DECLOPSTRUCT(op_f32);
       sistack_push(NANBOX_OFFLOAT(instr->operand));
       ADVANCE_PCI();
     }
-    case op_ldc_f64:
-    case op_lgc_f64: {
+    OPCASE(op_ldc_f64):
+    OPCASE(op_lgc_f64): {
       DECLOPSTRUCT(op_f64);
-#ifdef SINTER_SHORT_DOUBLE_WORKAROUND
-      // for systems (e.g. Arduino AVR) where double is actually an alias of float...
-      // manually convert the double into a float
-      union {
-        float value;
-        uint32_t bits;
-      } float_value;
-      _Static_assert(sizeof(float_value) == 4, "union of float and uint32_t is not 32-bit");
-
-      float_value.bits = 0;
-      // sign bit
-      if (instr->operand_u64 & (((uint64_t)1) << 63)) {
-        float_value.bits |= ((uint32_t)1) << 31;
-      }
-
-      const uint32_t offset_exponent = (instr->operand_u64 >> 52) & 0x7FFu;
-      const int32_t real_exponent = ((int32_t)offset_exponent) - 1023;
-      const uint64_t f64_mantissa = instr->operand_u64 & 0xFFFFFFFFFFFFFu;
-      // lop off the bottom 29 bits..
-      const uint32_t f32_mantissa = (instr->operand_u64 >> 29) & 0x7FFFFFu;
-      if (offset_exponent == 0x7FF) {
-        // NaN or infinity
-        // set all the exponent bits
-        float_value.bits |= 0x7F800000u;
-        if (f64_mantissa) {
-          // NaN, just set this to canonical NaN
-          float_value.bits = 0x7FC00000u;
-        }
-      } else if (offset_exponent == 0) {
-        // zero/subnormal
-        float_value.bits |= f32_mantissa;
-      } else if (real_exponent >= -126 && real_exponent <= 127) {
-        float_value.bits |= (real_exponent + 127) << 23;
-        float_value.bits |= f32_mantissa;
-      } else if (real_exponent < -126) {
-        float_value.value = -INFINITY;
-      } else if (real_exponent > 127) {
-        float_value.value = INFINITY;
-      }
-      sistack_push(NANBOX_OFFLOAT(float_value.value));
-#else
-      sistack_push(NANBOX_OFFLOAT((float)instr->operand));
-#endif
+      sistack_push(NANBOX_OFFLOAT(siop_f64_operand(instr)));
       ADVANCE_PCI();
     }
-    case op_ldc_b_0:
-    case op_lgc_b_0:
+#endif
+    OPCASE(op_ldc_b_0):
+    OPCASE(op_lgc_b_0):
       sistack_push(NANBOX_OFBOOL(false));
       ADVANCE_PCONE();
-    case op_ldc_b_1:
-    case op_lgc_b_1:
+    OPCASE(op_ldc_b_1):
+    OPCASE(op_lgc_b_1):
       sistack_push(NANBOX_OFBOOL(true));
       ADVANCE_PCONE();
-    case op_lgc_u:
+    OPCASE(op_lgc_u):
       sistack_push(NANBOX_OFUNDEF());
       ADVANCE_PCONE();
-    case op_lgc_n:
+    OPCASE(op_lgc_n):
       sistack_push(NANBOX_OFNULL());
       ADVANCE_PCONE();
-    case op_lgc_s: {
+#ifndef SINTER_PREDECODE
+    OPCASE(op_lgc_s): {
       DECLOPSTRUCT(op_address);
       const svm_constant_t *string = (const svm_constant_t *) (sistate.program + instr->address);
       siheap_strconst_t *obj = sistrconst_new(string);
       sistack_push(SIHEAP_PTRTONANBOX(obj));
       ADVANCE_PCI();
     }
-    case op_pop_g:
-    case op_pop_b:
-    case op_pop_f:
+#endif
+    OPCASE(op_pop_g):
+    OPCASE(op_pop_b):
+    OPCASE(op_pop_f):
       siheap_derefbox(sistack_pop());
       ADVANCE_PCONE();
 
@@ -268,54 +575,46 @@ static void main_loop(void) {
   return; \
 } } while (0)
 
-    // TODO: optimised _f variants
-    case op_add_g:
-    case op_add_f: {
+// Converts a value known to be a number to a float
+#define NUMERIC_TOFLOAT(v) (NANBOX_ISINT(v) ? (float) NANBOX_INT(v) : NANBOX_FLOAT(v))
+
+// Binary operation on two numbers.
+// If both operands are integers, the result is int_expr, evaluated with int32_t
+// a and b; otherwise it is float_expr, evaluated with float a and b. Anything
+// else is a type error.
+#define NUMERIC_OP(int_expr, float_expr) { \
+      sinanbox_t v1 = sistack_pop(); \
+      sinanbox_t v0 = sistack_pop(); \
+      sinanbox_t r; \
+      if (NANBOX_ISBOTHINT(v0, v1)) { \
+        const int32_t a = NANBOX_INT(v0); \
+        const int32_t b = NANBOX_INT(v1); \
+        r = (int_expr); \
+      } else { \
+        ARITHMETIC_TYPECHECK(); \
+        const float a = NUMERIC_TOFLOAT(v0); \
+        const float b = NUMERIC_TOFLOAT(v1); \
+        r = (float_expr); \
+      } \
+      sistack_push(r); \
+      /* No need to deref v0 and v1; they are either numbers (which are not on the heap) */ \
+      /* or they are not (in which case we would have faulted) */ \
+      ADVANCE_PCONE(); \
+    }
+
+    OPCASE(op_add_g): {
+      QUICKEN_FEEDBACK(op_quick_add_ii, op_quick_add_ff, op_quick_add_strstr);
       sinanbox_t v1 = sistack_pop();
       sinanbox_t v0 = sistack_pop();
       sinanbox_t r;
 
-      if (NANBOX_ISNUMERIC(v0) && NANBOX_ISNUMERIC(v1)) {
-        switch (NANBOX_ISFLOAT(v1) << 1 | NANBOX_ISFLOAT(v0)) {
-        case 0: /* neither are floats */
-          /* addition/subtraction of 2 21-bit integers won't overflow a 32-bit integer; no worries here */
-          r = NANBOX_WRAP_INT(NANBOX_INT(v0) + NANBOX_INT(v1));
-          break;
-        case 1: /* v0 is float */
-          r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) + NANBOX_INT(v1));
-          break;
-        case 2: /* v1 is float */
-          r = NANBOX_OFFLOAT(NANBOX_INT(v0) + NANBOX_FLOAT(v1));
-          break;
-        case 3: /* both are float */
-          r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) + NANBOX_FLOAT(v1));
-          break;
-        default:
-          SIBUG();
-          sifault(sinter_fault_internal_error);
-          break;
-        }
-      } else if (NANBOX_ISPTR(v0) & NANBOX_ISPTR(v1)) {
-        siheap_header_t *hv0 = SIHEAP_NANBOXTOPTR(v0);
-        siheap_header_t *hv1 = SIHEAP_NANBOXTOPTR(v1);
-
-        if (siheap_is_string(hv0) && siheap_is_string(hv1)) {
-          // if either are empty string, no-op
-          if (hv0->type == sitype_strconst && *(((siheap_strconst_t *) hv0)->string->data) == '\0') {
-            siheap_ref(hv1);
-            r = v1;
-          } else if (hv1->type == sitype_strconst && *(((siheap_strconst_t *) hv1)->string->data) == '\0') {
-            siheap_ref(hv0);
-            r = v0;
-          } else {
-            siheap_strpair_t *obj = sistrpair_new(hv0, hv1);
-            r = SIHEAP_PTRTONANBOX(obj);
-          }
-        } else {
-          SIDEBUG("Invalid operands to add.\n");
-          sifault(sinter_fault_type);
-          return;
-        }
+      if (NANBOX_ISBOTHINT(v0, v1)) {
+        /* addition/subtraction of 2 21-bit integers won't overflow a 32-bit integer; no worries here */
+        r = NANBOX_WRAP_INT(NANBOX_INT(v0) + NANBOX_INT(v1));
+      } else if (NANBOX_ISNUMERIC(v0) && NANBOX_ISNUMERIC(v1)) {
+        r = NANBOX_OFFLOAT(NUMERIC_TOFLOAT(v0) + NUMERIC_TOFLOAT(v1));
+      } else if (is_string(v0) && is_string(v1)) {
+        r = concat_strings(v0, v1);
       } else {
         SIDEBUG("Invalid operands to add.\n");
         sifault(sinter_fault_type);
@@ -327,131 +626,56 @@ static void main_loop(void) {
       siheap_derefbox(v1);
       ADVANCE_PCONE();
     }
-    break;
-    case op_sub_g:
-    case op_sub_f: {
-      sinanbox_t v1 = sistack_pop();
-      sinanbox_t v0 = sistack_pop();
-      ARITHMETIC_TYPECHECK();
-      sinanbox_t r;
-      switch (NANBOX_ISFLOAT(v1) << 1 | NANBOX_ISFLOAT(v0)) {
-      case 0: /* neither are floats */
-        /* addition/subtraction of 2 21-bit integers won't overflow a 32-bit integer; no worries here */
-        r = NANBOX_WRAP_INT(NANBOX_INT(v0) - NANBOX_INT(v1));
-        break;
-      case 1: /* v0 is float */
-        r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) - NANBOX_INT(v1));
-        break;
-      case 2: /* v1 is float */
-        r = NANBOX_OFFLOAT(NANBOX_INT(v0) - NANBOX_FLOAT(v1));
-        break;
-      case 3: /* both are float */
-        r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) - NANBOX_FLOAT(v1));
-        break;
-      default:
-        SIBUG();
-        sifault(sinter_fault_internal_error);
-        return;
-      }
-      sistack_push(r);
-      /* No need to deref v0 and v1; they are either numbers (which are not on the heap) */
-      /* or they are not (in which case we would have faulted) */
-      ADVANCE_PCONE();
-    }
 
-    case op_mul_g:
-    case op_mul_f: {
-      sinanbox_t v1 = sistack_pop();
+    // The _f variants are only emitted when both operands are known to be numbers,
+    // so they skip the string cases of the _g variants.
+    OPCASE(op_add_f):
+      NUMERIC_OP(NANBOX_WRAP_INT(a + b), NANBOX_OFFLOAT(a + b))
+
+    OPCASE(op_sub_g):
+      QUICKEN_FEEDBACK(op_quick_sub_ii, op_quick_sub_ff, 0);
+      NUMERIC_OP(NANBOX_WRAP_INT(a - b), NANBOX_OFFLOAT(a - b))
+    OPCASE(op_sub_f):
+      NUMERIC_OP(NANBOX_WRAP_INT(a - b), NANBOX_OFFLOAT(a - b))
+
+#ifdef SINTER_PREDECODE
+    // lgc_i followed by add or sub
+    // Only numbers can be added to a number; anything else is a type error
+    OPCASE(op_fused_add_i):
+    OPCASE(op_fused_sub_i): {
+      DECLOPSTRUCT(op_nanbox);
+      sinanbox_t v1 = instr->value;
       sinanbox_t v0 = sistack_pop();
-      ARITHMETIC_TYPECHECK();
+      const bool is_sub = this_opcode == op_fused_sub_i;
       sinanbox_t r;
-      switch (NANBOX_ISFLOAT(v1) << 1 | NANBOX_ISFLOAT(v0)) {
-      case 0: /* neither are floats */
-        /* this can overflow, use int64 instead */
-        r = NANBOX_WRAP_INT(((int64_t) NANBOX_INT(v0)) * ((int64_t) NANBOX_INT(v1)));
-        break;
-      case 1: /* v0 is float */
-        r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) *  NANBOX_INT(v1));
-        break;
-      case 2: /* v1 is float */
-        r = NANBOX_OFFLOAT(NANBOX_INT(v0) * NANBOX_FLOAT(v1));
-        break;
-      case 3: /* both are float */
-        r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) * NANBOX_FLOAT(v1));
-        break;
-      default:
-        SIBUG();
-        sifault(sinter_fault_internal_error);
-        return;
+      if (NANBOX_ISBOTHINT(v0, v1)) {
+        r = NANBOX_WRAP_INT(is_sub ? NANBOX_INT(v0) - NANBOX_INT(v1) : NANBOX_INT(v0) + NANBOX_INT(v1));
+      } else {
+        ARITHMETIC_TYPECHECK();
+        const float f0 = NUMERIC_TOFLOAT(v0);
+        const float f1 = NUMERIC_TOFLOAT(v1);
+        r = NANBOX_OFFLOAT(is_sub ? f0 - f1 : f0 + f1);
       }
       sistack_push(r);
-      /* No need to deref v0 and v1; they are either numbers (which are not on the heap) */
-      /* or they are not (in which case we would have faulted) */
-      ADVANCE_PCONE();
+      ADVANCE_PCI();
     }
+#endif
 
-    case op_div_g:
-    case op_div_f: {
-      sinanbox_t v1 = sistack_pop();
-      sinanbox_t v0 = sistack_pop();
-      ARITHMETIC_TYPECHECK();
-      sinanbox_t r;
-      switch (NANBOX_ISFLOAT(v1) << 1 | NANBOX_ISFLOAT(v0)) {
-      case 0: /* neither are floats */
-        r = NANBOX_OFFLOAT(((float) NANBOX_INT(v0)) / NANBOX_INT(v1));
-        break;
-      case 1: /* v0 is float */
-        r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) / NANBOX_INT(v1));
-        break;
-      case 2: /* v1 is float */
-        r = NANBOX_OFFLOAT(NANBOX_INT(v0) / NANBOX_FLOAT(v1));
-        break;
-      case 3: /* both are float */
-        r = NANBOX_OFFLOAT(NANBOX_FLOAT(v0) / NANBOX_FLOAT(v1));
-        break;
-      default:
-        SIBUG();
-        sifault(sinter_fault_internal_error);
-        return;
-      }
-      sistack_push(r);
-      /* No need to deref v0 and v1; they are either numbers (which are not on the heap) */
-      /* or they are not (in which case we would have faulted) */
-      ADVANCE_PCONE();
-    }
+    OPCASE(op_mul_g):
+    OPCASE(op_mul_f):
+      /* 2 21-bit integers can overflow a 32-bit integer, use int64 instead */
+      NUMERIC_OP(NANBOX_WRAP_INT((int64_t) a * b), NANBOX_OFFLOAT(a * b))
 
-    case op_mod_g:
-    case op_mod_f: {
-      sinanbox_t v1 = sistack_pop();
-      sinanbox_t v0 = sistack_pop();
-      ARITHMETIC_TYPECHECK();
-      sinanbox_t r;
-      switch (NANBOX_ISFLOAT(v1) << 1 | NANBOX_ISFLOAT(v0)) {
-      case 0: /* neither are floats */
-        r = NANBOX_OFFLOAT(fmodf(NANBOX_INT(v0),  NANBOX_INT(v1)));
-        break;
-      case 1: /* v0 is float */
-        r = NANBOX_OFFLOAT(fmodf(NANBOX_FLOAT(v0), NANBOX_INT(v1)));
-        break;
-      case 2: /* v1 is float */
-        r = NANBOX_OFFLOAT(fmodf(NANBOX_INT(v0), NANBOX_FLOAT(v1)));
-        break;
-      case 3: /* both are float */
-        r = NANBOX_OFFLOAT(fmodf(NANBOX_FLOAT(v0), NANBOX_FLOAT(v1)));
-        break;
-      default:
-        SIBUG();
-        sifault(sinter_fault_internal_error);
-        break;
-      }
-      sistack_push(r);
-      /* No need to deref v0 and v1; they are either numbers (which are not on the heap) */
-      /* or they are not (in which case we would have faulted) */
-      ADVANCE_PCONE();
-    }
+    OPCASE(op_div_g):
+    OPCASE(op_div_f):
+      NUMERIC_OP(NANBOX_OFFLOAT((float) a / b), NANBOX_OFFLOAT(a / b))
 
-    case op_neg_g:
-    case op_neg_f: {
+    OPCASE(op_mod_g):
+    OPCASE(op_mod_f):
+      NUMERIC_OP(int_mod(a, b), NANBOX_OFFLOAT(fmodf(a, b)))
+
+    OPCASE(op_neg_g):
+    OPCASE(op_neg_f): {
       sinanbox_t v1 = sistack_pop();
 
       if (NANBOX_ISINT(v1)) {
@@ -466,8 +690,7 @@ static void main_loop(void) {
       ADVANCE_PCONE();
     }
 
-    case op_not_g:
-    case op_not_b: {
+    OPCASE(op_not_g): {
       sinanbox_t v = sistack_pop();
       if (!NANBOX_ISBOOL(v)) {
         sifault(sinter_fault_type);
@@ -477,35 +700,32 @@ static void main_loop(void) {
       ADVANCE_PCONE();
     }
 
-#define COMPARISON_OP(op) { \
+    // The _b variants are only emitted when the operands are known to be
+    // booleans, so they only guard the type and work on the boxes directly.
+    OPCASE(op_not_b): {
+      sinanbox_t v = sistack_pop();
+      if (!NANBOX_ISBOOL(v)) {
+        sifault(sinter_fault_type);
+        return;
+      }
+      sistack_push(NANBOX_WITH_I32(v.as_u32 ^ 1u));
+      ADVANCE_PCONE();
+    }
+
+#define COMPARE_POP(op) \
       sinanbox_t v1 = sistack_pop(); \
       sinanbox_t v0 = sistack_pop(); \
-      sinanbox_t r; \
+      bool r = false; \
  \
-      if (NANBOX_ISNUMERIC(v0) && NANBOX_ISNUMERIC(v1)) { \
-        switch (NANBOX_ISFLOAT(v1) << 1 | NANBOX_ISFLOAT(v0)) { \
-        case 0: /* neither are floats */ \
-          r = NANBOX_OFBOOL(NANBOX_INT(v0) op NANBOX_INT(v1)); \
-          break; \
-        case 1: /* v0 is float */ \
-          r = NANBOX_OFBOOL(NANBOX_FLOAT(v0) op NANBOX_INT(v1)); \
-          break; \
-        case 2: /* v1 is float */ \
-          r = NANBOX_OFBOOL(NANBOX_INT(v0) op NANBOX_FLOAT(v1)); \
-          break; \
-        case 3: /* both are float */ \
-          r = NANBOX_OFBOOL(NANBOX_FLOAT(v0) op NANBOX_FLOAT(v1)); \
-          break; \
-        default: \
-          SIBUG(); \
-          sifault(sinter_fault_internal_error); \
-          break; \
-        } \
+      if (NANBOX_ISBOTHINT(v0, v1)) { \
+        r = NANBOX_INT(v0) op NANBOX_INT(v1); \
+      } else if (NANBOX_ISNUMERIC(v0) && NANBOX_ISNUMERIC(v1)) { \
+        r = NUMERIC_TOFLOAT(v0) op NUMERIC_TOFLOAT(v1); \
       } else if (NANBOX_ISPTR(v0) & NANBOX_ISPTR(v1)) { \
         siheap_header_t *hv0 = SIHEAP_NANBOXTOPTR(v0); \
         siheap_header_t *hv1 = SIHEAP_NANBOXTOPTR(v1); \
         if (siheap_is_string(hv0) && siheap_is_string(hv1)) { \
-          r = NANBOX_OFBOOL(strcmp(sistrobj_tocharptr(hv0), sistrobj_tocharptr(hv1)) op 0); \
+          r = strcmp(sistrobj_tocharptr(hv0), sistrobj_tocharptr(hv1)) op 0; \
         } else { \
           SIDEBUG("Invalid operands to comparison.\n"); \
           sifault(sinter_fault_type); \
@@ -517,33 +737,182 @@ static void main_loop(void) {
         return; \
       } \
  \
-      sistack_push(r); \
       siheap_derefbox(v0); \
-      siheap_derefbox(v1); \
+      siheap_derefbox(v1);
+
+#define COMPARISON_OP(op) { \
+      COMPARE_POP(op) \
+      sistack_push(NANBOX_OFBOOL(r)); \
       ADVANCE_PCONE(); \
     }
 
-    case op_lt_g:
-    case op_lt_f:
+// Comparison of two numbers; anything else is a type error
+#define NUMERIC_COMPARISON_OP(op) \
+      NUMERIC_OP(NANBOX_OFBOOL(a op b), NANBOX_OFBOOL(a op b))
+
+    OPCASE(op_lt_g):
+      QUICKEN_FEEDBACK(op_quick_lt_ii, op_quick_lt_ff, 0);
       COMPARISON_OP(<)
-    case op_gt_g:
-    case op_gt_f:
+    OPCASE(op_lt_f):
+      NUMERIC_COMPARISON_OP(<)
+    OPCASE(op_gt_g):
+      QUICKEN_FEEDBACK(op_quick_gt_ii, op_quick_gt_ff, 0);
       COMPARISON_OP(>)
-    case op_le_g:
-    case op_le_f:
+    OPCASE(op_gt_f):
+      NUMERIC_COMPARISON_OP(>)
+    OPCASE(op_le_g):
+      QUICKEN_FEEDBACK(op_quick_le_ii, op_quick_le_ff, 0);
       COMPARISON_OP(<=)
-    case op_ge_g:
-    case op_ge_f:
+    OPCASE(op_le_f):
+      NUMERIC_COMPARISON_OP(<=)
+    OPCASE(op_ge_g):
+      QUICKEN_FEEDBACK(op_quick_ge_ii, op_quick_ge_ff, 0);
       COMPARISON_OP(>=)
-    case op_neq_g:
-    case op_neq_f:
-    case op_neq_b:
-    case op_eq_g:
-    case op_eq_f:
-    case op_eq_b: {
+    OPCASE(op_ge_f):
+      NUMERIC_COMPARISON_OP(>=)
+#ifdef SINTER_PREDECODE
+// Comparison followed by br_f; branches if the comparison is false
+#define COMPARISON_BR_F(op) { \
+      DECLOPSTRUCT(op_offset); \
+      COMPARE_POP(op) \
+      if (!r) { \
+        sistate.pc += instr->offset + sizeof(*instr); \
+        DISPATCH(); \
+      } else { \
+        ADVANCE_PCI(); \
+      } \
+    }
+
+    OPCASE(op_fused_lt_br_f):
+      QUICKEN_FEEDBACK(op_quick_lt_br_f_ii, op_quick_lt_br_f_ff, 0);
+      COMPARISON_BR_F(<)
+    OPCASE(op_fused_gt_br_f):
+      QUICKEN_FEEDBACK(op_quick_gt_br_f_ii, op_quick_gt_br_f_ff, 0);
+      COMPARISON_BR_F(>)
+    OPCASE(op_fused_le_br_f):
+      QUICKEN_FEEDBACK(op_quick_le_br_f_ii, op_quick_le_br_f_ff, 0);
+      COMPARISON_BR_F(<=)
+    OPCASE(op_fused_ge_br_f):
+      QUICKEN_FEEDBACK(op_quick_ge_br_f_ii, op_quick_ge_br_f_ff, 0);
+      COMPARISON_BR_F(>=)
+#endif
+
+#ifdef SINTER_QUICKEN
+// Puts the operands back, and runs the current instruction again as generic_op
+#define DEOPTIMISE(generic_op) { \
+      sistack_push(v0); \
+      sistack_push(v1); \
+      deoptimise(generic_op); \
+      DISPATCH(); \
+    }
+
+#define QUICK_II (NANBOX_ISBOTHINT(v0, v1))
+#define QUICK_FF (NANBOX_ISFLOAT(v0) && NANBOX_ISFLOAT(v1))
+#define QUICK_II_OP(op) (NANBOX_INT(v0) op NANBOX_INT(v1))
+#define QUICK_FF_OP(op) (NANBOX_FLOAT(v0) op NANBOX_FLOAT(v1))
+
+// Quickened binary operation on operands that satisfy guard
+#define QUICK_OP(guard, result, generic_op) { \
+      sinanbox_t v1 = sistack_pop(); \
+      sinanbox_t v0 = sistack_pop(); \
+      if (!(guard)) DEOPTIMISE(generic_op) \
+      sistack_push(result); \
+      ADVANCE_PCONE(); \
+    }
+
+// Quickened comparison followed by br_f
+#define QUICK_COMPARISON_BR_F(guard, cond, generic_op) { \
+      DECLOPSTRUCT(op_offset); \
+      sinanbox_t v1 = sistack_pop(); \
+      sinanbox_t v0 = sistack_pop(); \
+      if (!(guard)) DEOPTIMISE(generic_op) \
+      if (!(cond)) { \
+        sistate.pc += instr->offset + sizeof(*instr); \
+        DISPATCH(); \
+      } else { \
+        ADVANCE_PCI(); \
+      } \
+    }
+
+    OPCASE(op_quick_add_ii):
+      QUICK_OP(QUICK_II, NANBOX_WRAP_INT(QUICK_II_OP(+)), op_add_g)
+    OPCASE(op_quick_add_ff):
+      QUICK_OP(QUICK_FF, NANBOX_OFFLOAT(QUICK_FF_OP(+)), op_add_g)
+    OPCASE(op_quick_add_strstr): {
+      sinanbox_t v1 = sistack_pop();
+      sinanbox_t v0 = sistack_pop();
+      if (!is_string(v0) || !is_string(v1)) DEOPTIMISE(op_add_g)
+      sistack_push(concat_strings(v0, v1));
+      siheap_derefbox(v0);
+      siheap_derefbox(v1);
+      ADVANCE_PCONE();
+    }
+    OPCASE(op_quick_sub_ii):
+      QUICK_OP(QUICK_II, NANBOX_WRAP_INT(QUICK_II_OP(-)), op_sub_g)
+    OPCASE(op_quick_sub_ff):
+      QUICK_OP(QUICK_FF, NANBOX_OFFLOAT(QUICK_FF_OP(-)), op_sub_g)
+    OPCASE(op_quick_lt_ii):
+      QUICK_OP(QUICK_II, NANBOX_OFBOOL(QUICK_II_OP(<)), op_lt_g)
+    OPCASE(op_quick_lt_ff):
+      QUICK_OP(QUICK_FF, NANBOX_OFBOOL(QUICK_FF_OP(<)), op_lt_g)
+    OPCASE(op_quick_gt_ii):
+      QUICK_OP(QUICK_II, NANBOX_OFBOOL(QUICK_II_OP(>)), op_gt_g)
+    OPCASE(op_quick_gt_ff):
+      QUICK_OP(QUICK_FF, NANBOX_OFBOOL(QUICK_FF_OP(>)), op_gt_g)
+    OPCASE(op_quick_le_ii):
+      QUICK_OP(QUICK_II, NANBOX_OFBOOL(QUICK_II_OP(<=)), op_le_g)
+    OPCASE(op_quick_le_ff):
+      QUICK_OP(QUICK_FF, NANBOX_OFBOOL(QUICK_FF_OP(<=)), op_le_g)
+    OPCASE(op_quick_ge_ii):
+      QUICK_OP(QUICK_II, NANBOX_OFBOOL(QUICK_II_OP(>=)), op_ge_g)
+    OPCASE(op_quick_ge_ff):
+      QUICK_OP(QUICK_FF, NANBOX_OFBOOL(QUICK_FF_OP(>=)), op_ge_g)
+    OPCASE(op_quick_lt_br_f_ii):
+      QUICK_COMPARISON_BR_F(QUICK_II, QUICK_II_OP(<), op_fused_lt_br_f)
+    OPCASE(op_quick_lt_br_f_ff):
+      QUICK_COMPARISON_BR_F(QUICK_FF, QUICK_FF_OP(<), op_fused_lt_br_f)
+    OPCASE(op_quick_gt_br_f_ii):
+      QUICK_COMPARISON_BR_F(QUICK_II, QUICK_II_OP(>), op_fused_gt_br_f)
+    OPCASE(op_quick_gt_br_f_ff):
+      QUICK_COMPARISON_BR_F(QUICK_FF, QUICK_FF_OP(>), op_fused_gt_br_f)
+    OPCASE(op_quick_le_br_f_ii):
+      QUICK_COMPARISON_BR_F(QUICK_II, QUICK_II_OP(<=), op_fused_le_br_f)
+    OPCASE(op_quick_le_br_f_ff):
+      QUICK_COMPARISON_BR_F(QUICK_FF, QUICK_FF_OP(<=), op_fused_le_br_f)
+    OPCASE(op_quick_ge_br_f_ii):
+      QUICK_COMPARISON_BR_F(QUICK_II, QUICK_II_OP(>=), op_fused_ge_br_f)
+    OPCASE(op_quick_ge_br_f_ff):
+      QUICK_COMPARISON_BR_F(QUICK_FF, QUICK_FF_OP(>=), op_fused_ge_br_f)
+#endif
+    OPCASE(op_neq_b):
+    OPCASE(op_eq_b): {
+      sinanbox_t v0 = sistack_pop();
+      sinanbox_t v1 = sistack_pop();
+      if (!NANBOX_ISBOOL(v0) || !NANBOX_ISBOOL(v1)) {
+        // not what the compiler promised, but still a valid comparison
+        sistack_push(NANBOX_OFBOOL(sivm_equal(v1, v0) == (this_opcode == op_eq_b)));
+        siheap_derefbox(v0);
+        siheap_derefbox(v1);
+        ADVANCE_PCONE();
+      }
+      // booleans are equal iff they are identical
+      sistack_push(NANBOX_OFBOOL(NANBOX_IDENTICAL(v0, v1) == (this_opcode == op_eq_b)));
+      ADVANCE_PCONE();
+    }
+
+    OPCASE(op_neq_g):
+    OPCASE(op_neq_f):
+    OPCASE(op_eq_g):
+    OPCASE(op_eq_f): {
       sinanbox_t v0 = sistack_pop();
       sinanbox_t v1 = sistack_pop();
-      bool r = sivm_equal(v1, v0);
+      bool r;
+      if (NANBOX_ISBOTHINT(v0, v1) || (NANBOX_ISBOOL(v0) && NANBOX_ISBOOL(v1))) {
+        // integers and booleans are equal iff they are identical
+        r = NANBOX_IDENTICAL(v0, v1);
+      } else {
+        r = sivm_equal(v1, v0);
+      }
 
       if (this_opcode >= op_neq_g) {
         r = !r;
@@ -555,35 +924,42 @@ static void main_loop(void) {
       ADVANCE_PCONE();
     }
 
-    case op_new_c: {
+    OPCASE(op_new_c): {
       DECLOPSTRUCT(op_address);
       const svm_function_t *fn_code = (const svm_function_t *) SISTATE_ADDRTOPC(instr->address);
+#ifdef SINTER_PREDECODE
+      // the decoder only places environments on the environment stack if they
+      // are never captured, but this keeps the heap from referring to one
+      if (sienv_onstack(sistate.env)) {
+        sienv_promote(sistate.env);
+      }
+#endif
       siheap_function_t *fn_obj = sifunction_new(fn_code, sistate.env);
       sistack_push(SIHEAP_PTRTONANBOX(fn_obj));
       ADVANCE_PCI();
     }
 
-    case op_new_c_p: {
+    OPCASE(op_new_c_p): {
       DECLOPSTRUCT(op_oneindex);
       sistack_push(NANBOX_OFIFN_PRIMITIVE(instr->index));
       ADVANCE_PCI();
     }
 
-    case op_new_c_v: {
+    OPCASE(op_new_c_v): {
       DECLOPSTRUCT(op_oneindex);
       sistack_push(NANBOX_OFIFN_VM(instr->index));
       ADVANCE_PCI();
     }
 
-    case op_new_a: {
+    OPCASE(op_new_a): {
       siheap_array_t *array = siarray_new(8);
       sistack_push(SIHEAP_PTRTONANBOX(array));
       ADVANCE_PCONE();
     }
 
-    case op_ldl_g:
-    case op_ldl_f:
-    case op_ldl_b: {
+    OPCASE(op_ldl_g):
+    OPCASE(op_ldl_f):
+    OPCASE(op_ldl_b): {
       DECLOPSTRUCT(op_oneindex);
       sinanbox_t v = sienv_get(sistate.env, instr->index);
       if (NANBOX_ISEMPTY(v)) {
@@ -595,24 +971,56 @@ static void main_loop(void) {
       ADVANCE_PCI();
     }
 
-    case op_stl_g:
-    case op_stl_b:
-    case op_stl_f: {
+#ifdef SINTER_PREDECODE
+    OPCASE(op_fused_ldl_ldl): {
+      DECLOPSTRUCT(op_twolocal);
+      sinanbox_t v0 = sienv_get(sistate.env, instr->index);
+      sinanbox_t v1 = sienv_get(sistate.env, instr->index2);
+      if (NANBOX_ISEMPTY(v0) || NANBOX_ISEMPTY(v1)) {
+        sifault(sinter_fault_uninitialised_load);
+        return;
+      }
+      siheap_refbox(v0);
+      siheap_refbox(v1);
+      sistack_push(v0);
+      sistack_push(v1);
+      ADVANCE_PCI();
+    }
+
+    OPCASE(op_fused_ldl_ldc): {
+      DECLOPSTRUCT(op_local_nanbox);
+      sinanbox_t v = sienv_get(sistate.env, instr->index);
+      if (NANBOX_ISEMPTY(v)) {
+        sifault(sinter_fault_uninitialised_load);
+        return;
+      }
+      siheap_refbox(v);
+      sistack_push(v);
+      sistack_push(instr->value);
+      ADVANCE_PCI();
+    }
+#endif
+
+    OPCASE(op_stl_g):
+    OPCASE(op_stl_b):
+    OPCASE(op_stl_f): {
       DECLOPSTRUCT(op_oneindex);
       sinanbox_t v = sistack_pop();
       sienv_put(sistate.env, instr->index, v);
       ADVANCE_PCI();
     }
 
-    case op_ldp_g:
-    case op_ldp_f:
-    case op_ldp_b: {
+    OPCASE(op_ldp_g):
+    OPCASE(op_ldp_f):
+    OPCASE(op_ldp_b): {
       DECLOPSTRUCT(op_twoindex);
-      siheap_env_t *env = sienv_getparent(sistate.env, instr->envindex);
+      siheap_env_t *env = sienv_ancestor(sistate.env, instr->envindex);
+#ifndef SINTER_DISABLE_CHECKS
       if (!env) {
         sifault(sinter_fault_invalid_load);
         return;
       }
+#endif
       sinanbox_t v = sienv_get(env, instr->index);
       if (NANBOX_ISEMPTY(v)) {
         sifault(sinter_fault_uninitialised_load);
@@ -623,28 +1031,30 @@ static void main_loop(void) {
       ADVANCE_PCI();
     }
 
-    case op_stp_g:
-    case op_stp_b:
-    case op_stp_f: {
+    OPCASE(op_stp_g):
+    OPCASE(op_stp_b):
+    OPCASE(op_stp_f): {
       DECLOPSTRUCT(op_twoindex);
-      siheap_env_t *env = sienv_getparent(sistate.env, instr->envindex);
+      siheap_env_t *env = sienv_ancestor(sistate.env, instr->envindex);
+#ifndef SINTER_DISABLE_CHECKS
       if (!env) {
         sifault(sinter_fault_invalid_load);
         return;
       }
+#endif
       sinanbox_t v = sistack_pop();
       sienv_put(env, instr->index, v);
       ADVANCE_PCI();
     }
 
-    case op_lda_g:
-    case op_lda_b:
-    case op_lda_f: {
-      siheap_array_t *array = NULL;
+    OPCASE(op_lda_g):
+    OPCASE(op_lda_b):
+    OPCASE(op_lda_f): {
+      siheap_header_t *array = NULL;
       address_t index = 0;
       pop_array_args(&array, &index);
 
-      sinanbox_t loadv = siarray_get(array, index);
+      sinanbox_t loadv = siarray_load(array, index);
       siheap_refbox(loadv);
       siheap_deref(array);
 
@@ -653,22 +1063,22 @@ static void main_loop(void) {
       ADVANCE_PCONE();
     }
 
-    case op_sta_g:
-    case op_sta_b:
-    case op_sta_f: {
+    OPCASE(op_sta_g):
+    OPCASE(op_sta_b):
+    OPCASE(op_sta_f): {
       sinanbox_t storev = sistack_pop();
-      siheap_array_t *array = NULL;
+      siheap_header_t *array = NULL;
       address_t index = 0;
       pop_array_args(&array, &index);
 
-      siarray_put(array, index, storev);
+      siarray_store(array, index, storev);
       siheap_deref(array);
 
       ADVANCE_PCONE();
     }
 
-    case op_br_t:
-    case op_br_f: {
+    OPCASE(op_br_t):
+    OPCASE(op_br_f): {
       DECLOPSTRUCT(op_offset);
       sinanbox_t v = sistack_pop();
       if (!NANBOX_ISBOOL(v)) {
@@ -677,26 +1087,26 @@ static void main_loop(void) {
       }
       if (NANBOX_BOOL(v) == (this_opcode == op_br_t)) {
         sistate.pc += instr->offset + sizeof(*instr);
-        break;
+        DISPATCH();
       } else {
         ADVANCE_PCI();
       }
     }
 
-    case op_br: {
+    OPCASE(op_br): {
       DECLOPSTRUCT(op_offset);
       sistate.pc += instr->offset + sizeof(*instr);
-      break;
+      DISPATCH();
     }
 
-    case op_jmp: {
+    OPCASE(op_jmp): {
       DECLOPSTRUCT(op_address);
       sistate.pc = SISTATE_ADDRTOPC(instr->address);
-      break;
+      DISPATCH();
     }
 
-    case op_call:
-    case op_call_t: {
+    OPCASE(op_call):
+    OPCASE(op_call_t): {
       // There are three types of functions:
       // - regular SVM closures (those created by new.c)
       // - internal functions (represented in a NaNbox)
@@ -710,7 +1120,17 @@ static void main_loop(void) {
       const bool is_tailcall = this_opcode == op_call_t;
 
       if (NANBOX_ISIFN(fn_ptr)) {
-        if (do_internal_function(NANBOX_IFN_NUMBER(fn_ptr), instr->num_args, sizeof(*instr), NANBOX_IFN_TYPE(fn_ptr) == 0, is_tailcall, true)) {
+        const uint8_t id = NANBOX_IFN_NUMBER(fn_ptr);
+        const bool is_primitive = NANBOX_IFN_TYPE(fn_ptr) == 0;
+        sivmfnptr_t fn;
+        if (CALL_CACHE_HIT(fn_ptr.as_u32)) {
+          fn = (is_primitive ? sivmfn_primitives : sivmfn_vminternals)[id];
+        } else {
+          fn = get_internal_function(id, is_primitive);
+          CALL_CACHE_FILL(fn_ptr.as_u32);
+        }
+
+        if (call_internal_function(fn, instr->num_args, sizeof(*instr), is_tailcall, true)) {
           return;
         }
       } else if (NANBOX_ISPTR(fn_ptr)) {
@@ -721,25 +1141,41 @@ static void main_loop(void) {
           // get the code
           const svm_function_t *fn_code = fn_obj->code;
 
-          if (instr->num_args != fn_code->num_args) {
-            sifault(sinter_fault_function_arity);
-            return;
-          }
+          // the checks only depend on the function, so we can skip them if
+          // this instruction has already called it
+          if (!CALL_CACHE_HIT(CALL_CACHE_FNKEY(fn_code))) {
+            if (instr->num_args != fn_code->num_args) {
+              sifault(sinter_fault_function_arity);
+              return;
+            }
 
-          if (fn_code->num_args > fn_code->env_size) {
-            sifault(sinter_fault_invalid_load);
-            return;
+            if (fn_code->num_args > fn_code->env_size) {
+              sifault(sinter_fault_invalid_load);
+              return;
+            }
+
+            CALL_CACHE_FILL(CALL_CACHE_FNKEY(fn_code));
           }
 
           // create the new environment
-          siheap_env_t *new_env = sienv_new(fn_obj->env, fn_code->env_size);
+          siheap_env_t *new_env = NULL;
+#ifdef SINTER_PREDECODE
+          if (fn_code->padding & SIDEC_FUNCTION_NOESCAPE) {
+            new_env = sienvstack_push(fn_obj->env, fn_code->env_size, FUNCTION_DISPLAY(fn_code));
+          }
+#endif
+          if (!new_env) {
+            new_env = sienv_new_display(fn_obj->env, fn_code->env_size, FUNCTION_DISPLAY(fn_code));
+          }
 
           // check we have enough arguments on the stack
           sistack_top -= fn_code->num_args;
+#ifndef SINTER_DISABLE_CHECKS
           if (sistack_top < sistack_bottom) {
             sifault(sinter_fault_stack_underflow);
             return;
           }
+#endif
 
           // copy the arguments from the stack to the environment
           memcpy(new_env->entry, sistack_top, fn_code->num_args*sizeof(sinanbox_t));
@@ -747,22 +1183,27 @@ static void main_loop(void) {
           // pop the function off the caller's stack, and deref it at the same time
           siheap_derefbox(sistack_pop());
 
-
           // if tail call, we destroy the caller's stack now, and "return" to the caller's caller
           if (is_tailcall) {
-            siheap_deref(sistate.env);
+            sienv_release(sistate.env);
             sistack_destroy(&sistate.pc, &sistate.env);
+#ifdef SINTER_PREDECODE
+            // the caller's environment may have been below the new one
+            new_env = sienvstack_lower(new_env);
+#endif
           } else {
             // otherwise we advance to the return address
             sistate.pc += sizeof(*instr);
           }
 
-          // create the stack frame for the callee, which stores the return address and environment
-          sistack_new(fn_code->stack_size, sistate.pc, sistate.env);
-
-          // set the environment
+          // set the environment first, so that the new environment is reachable
+          // if creating the frame runs the garbage collector
+          siheap_env_t *const return_env = sistate.env;
           sistate.env = new_env;
 
+          // create the stack frame for the callee, which stores the return address and environment
+          sistack_new(fn_code->stack_size, sistate.pc, return_env);
+
           // enter the function
           sistate.pc = &fn_code->code;
         } else if (obj->type == sitype_intcont) {
@@ -783,7 +1224,7 @@ static void main_loop(void) {
 
           // if tail call, we destroy the caller's stack now, and "return" to the caller's caller
           if (is_tailcall) {
-            siheap_deref(sistate.env);
+            sienv_release(sistate.env);
             sistack_destroy(&sistate.pc, &sistate.env);
           } else {
             // otherwise we advance to the return address
@@ -800,14 +1241,17 @@ static void main_loop(void) {
           sifault(sinter_fault_type);
           return;
         }
+      } else {
+        sifault(sinter_fault_type);
+        return;
       }
-      break;
+      DISPATCH();
     }
 
-    case op_call_v:
-    case op_call_t_v:
-    case op_call_p:
-    case op_call_t_p: {
+    OPCASE(op_call_v):
+    OPCASE(op_call_t_v):
+    OPCASE(op_call_p):
+    OPCASE(op_call_t_p): {
       DECLOPSTRUCT(op_call_internal);
       const bool is_primitive = this_opcode == op_call_p || this_opcode == op_call_t_p;
       const bool is_tailcall = this_opcode == op_call_t_v || this_opcode == op_call_t_p;
@@ -816,17 +1260,17 @@ static void main_loop(void) {
         return;
       }
 
-      break;
+      DISPATCH();
     }
 
-    case op_ret_g:
-    case op_ret_f:
-    case op_ret_b: {
+    OPCASE(op_ret_g):
+    OPCASE(op_ret_f):
+    OPCASE(op_ret_b): {
       // pop the return value
       sinanbox_t v = sistack_pop();
 
       // destroy this stack frame, and return to the caller
-      siheap_deref(sistate.env);
+      sienv_release(sistate.env);
       sistack_destroy(&sistate.pc, &sistate.env);
 
       // push the return value onto the caller's stack
@@ -837,13 +1281,13 @@ static void main_loop(void) {
         return;
       }
 
-      break;
+      DISPATCH();
     }
 
-    case op_ret_u:
-    case op_ret_n:
+    OPCASE(op_ret_u):
+    OPCASE(op_ret_n):
       // destroy this stack frame, and return to the caller
-      siheap_deref(sistate.env);
+      sienv_release(sistate.env);
       sistack_destroy(&sistate.pc, &sistate.env);
 
       // push the return value onto the caller's stack
@@ -858,32 +1302,58 @@ static void main_loop(void) {
         return;
       }
 
-      break;
+      DISPATCH();
 
-    case op_dup: {
+    OPCASE(op_dup): {
       sinanbox_t v = sistack_peek(0);
       siheap_refbox(v);
       sistack_push(v);
       ADVANCE_PCONE();
     }
 
-    case op_newenv: {
+    OPCASE(op_newenv): {
       DECLOPSTRUCT(op_oneindex);
-      siheap_env_t *new_env = sienv_new(sistate.env, instr->index);
-      siheap_deref(sistate.env);
+#ifdef SINTER_PREDECODE
+      if (sienv_onstack(sistate.env)) {
+        // the block's environment goes on the environment stack too, taking
+        // over the reference to its parent
+        siheap_env_t *new_env = sienvstack_push(sistate.env, instr->index, NEWENV_DISPLAY(instr));
+        if (new_env) {
+          sistate.env = new_env;
+          ADVANCE_PCI();
+        }
+        sienv_promote(sistate.env);
+      }
+#endif
+      siheap_env_t *new_env = sienv_cache_take(sistate.env, instr->index, NEWENV_DISPLAY(instr));
+      if (new_env) {
+        SISTATS_INC(env_cache_hits);
+      } else {
+        SISTATS_INC(env_cache_misses);
+        new_env = sienv_new_display(sistate.env, instr->index, NEWENV_DISPLAY(instr));
+        siheap_deref(sistate.env);
+      }
       sistate.env = new_env;
       ADVANCE_PCI();
     }
 
-    case op_popenv: {
+    OPCASE(op_popenv): {
       siheap_env_t *old_env = sistate.env;
+#ifdef SINTER_PREDECODE
+      if (sienv_onstack(old_env)) {
+        sistate.env = sienvstack_pop(old_env);
+        ADVANCE_PCONE();
+      }
+#endif
       sistate.env = old_env->parent;
-      siheap_ref(sistate.env);
-      siheap_deref(old_env);
+      if (!sienv_cache_put(old_env)) {
+        siheap_ref(sistate.env);
+        siheap_deref(old_env);
+      }
       ADVANCE_PCONE();
     }
 
-    default:
+    OPDEFAULT:
       SIBUGV("Invalid instruction %02x at address 0x%tx\n", this_opcode, SISTATE_CURADDR);
       sifault(sinter_fault_invalid_program);
       break;
@@ -892,6 +1362,11 @@ static void main_loop(void) {
   }
 }
 
+#ifdef SINTER_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+#ifndef SINTER_VM_UNCHECKED
 /**
  * Executes an SVM function.
  *
@@ -907,20 +1382,55 @@ sinanbox_t siexec(const svm_function_t *fn, siheap_env_t *parent_env, uint8_t ar
     return NANBOX_OFEMPTY();
   }
 
+#ifdef SINTER_COMPACT_HEAP
+  // the outermost call starts the part of the native stack that is scanned
+  // when the heap is compacted
+  const bool outermost = !sistate.native_stack_base;
+  if (outermost) {
+    sistate.native_stack_base = (uintptr_t) &old_env;
+  }
+#endif
+
   sistack_limit++; // create one entry for the return value
-  sistate.env = sienv_new(parent_env, fn->env_size);
+  sistate.env = NULL;
+#ifdef SINTER_PREDECODE
+  if (!sistate.aot && (fn->padding & SIDEC_FUNCTION_NOESCAPE)) {
+    sistate.env = sienvstack_push(parent_env, fn->env_size, FUNCTION_DISPLAY(fn));
+  }
+#endif
+  if (!sistate.env) {
+    sistate.env = sienv_new_display(parent_env, fn->env_size, sistate.aot ? 0 : FUNCTION_DISPLAY(fn));
+  }
   sistack_new(fn->stack_size, NULL, old_env);
   if (argc) {
     memcpy(sistate.env->entry, argv, argc*sizeof(sinanbox_t));
   }
   sistate.pc = &fn->code;
 
-  main_loop();
+  if (sistate.aot) {
+    siaot_run(fn);
+  } else {
+#ifdef SINTER_VERIFY
+    if (sistate.verified) {
+      sivm_main_loop_unchecked();
+    } else {
+      main_loop();
+    }
+#else
+    main_loop();
+#endif
+  }
 
   sinanbox_t ret = sistack_top == sistack_bottom ? NANBOX_OFEMPTY() : *(--sistack_top);
   sistate.env = old_env;
   sistate.pc = old_pc;
   sistack_limit--;
+#ifdef SINTER_COMPACT_HEAP
+  if (outermost) {
+    sistate.native_stack_base = 0;
+  }
+#endif
 
   return ret;
 }
+#endif
@@ -0,0 +1,22 @@
+/**
+ * The main loop used for programs that pass the verifier (see verify.h).
+ *
+ * This compiles vm.c again with SINTER_DISABLE_CHECKS, so that the stack and
+ * environment functions it uses skip their bounds checks. Only the main loop is
+ * compiled; the rest of vm.c is only compiled once.
+ *
+ * The inline functions are made static here. Otherwise, calls to them that
+ * the compiler does not inline (e.g. all of them at -O0) would go to their
+ * external definitions in inline.c, which are compiled with the checks.
+ */
+
+#define SINTER_INLINE static inline
+#include <sinter/config.h>
+
+#include <stddef.h>
+
+#ifdef SINTER_VERIFY
+#define SINTER_DISABLE_CHECKS
+#define SINTER_VM_UNCHECKED
+#include "vm.c"
+#endif
@@ -0,0 +1,8 @@
+#!/bin/bash
+
+set -o pipefail
+
+runner="$1"
+out_file="$2.out"
+
+"$runner" | diff -u "$out_file" -
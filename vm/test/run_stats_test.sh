@@ -0,0 +1,9 @@
+#!/bin/bash
+
+set -o pipefail
+
+runner="$1"
+in_file="$2.svm"
+stats_file="$2.stats"
+
+"$runner" -s "$in_file" 2>&1 >/dev/null | grep -E '^(Call|Environment) cache: ' | diff -u "$stats_file" -
@@ -5,5 +5,6 @@ set -o pipefail
 runner="$1"
 in_file="$2.svm"
 out_file="$2.out"
+shift 2
 
-"$runner" "$in_file" | diff -u "$out_file" -
+"$runner" "$@" "$in_file" | diff -u "$out_file" -